@@ -0,0 +1,32 @@
+#ifndef BARNESHUT_H
+#define BARNESHUT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../include/BodySystem.h"
+#include "../include/ForceSolver.h"
+#include "../include/Octree.h"
+
+class BarnesHutSolver : public ForceSolver {
+    /*
+    Barnes-Hut octree solver approximating distant groups of bodies by their center of mass, O(N log N)
+
+    Args:
+    opening_angle -> theta of the opening criterion, a cell of size s at distance d is opened when s / d > theta
+    tree -> octree rebuilt from the bodies on every evaluation
+    */
+    public:
+        float opening_angle;
+        Octree tree;
+
+        BarnesHutSolver(float opening_angle, int leaf_size = 8);
+        const char* name() const;
+        void compute_accelerations(const BodySystem& system, double G_const, double softening, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az);
+        int compute_target_accelerations(const BodySystem& system, double G_const, double softening, const std::vector<int>& targets, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az);
+
+    private:
+        void accelerate_body(const BodySystem& system, int idx, double G_const, double eps2, double gravity[3]);
+};
+
+#endif
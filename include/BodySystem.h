@@ -0,0 +1,70 @@
+#ifndef BODYSYSTEM_H
+#define BODYSYSTEM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <string>
+
+struct BodyView {
+    /*
+    Zero-copy read-only view over the state of a BodySystem, cheap to pass by value
+
+    The pointers alias the arrays of the system and stay valid until bodies are added to it, while the
+    values always follow the system as it is stepped
+
+    Args:
+    x, y, z, vx, vy, vz, mass, diameter, host -> arrays of the system, count entries each
+    count -> number of bodies
+    */
+    const double* x;
+    const double* y;
+    const double* z;
+    const double* vx;
+    const double* vy;
+    const double* vz;
+    const double* mass;
+    const double* diameter;
+    const int* host;
+    int count;
+
+    int size() const {
+        return this->count;
+    }
+};
+
+class BodySystem {
+    /*
+    Physics state of every body in the simulation, stored as structure of arrays and free of any OpenGL state
+
+    Args:
+    names -> name of every body as given in the bodies json file
+    x, y, z -> positions of body centers in E_val_km units
+    vx, vy, vz -> velocities in E_val_km units per second
+    mass -> masses in E_val_kg units
+    diameter -> diameters in E_val_km units
+    color -> vector of RGB values and opacity value, kept for clients that render the system
+    host -> index of the star a planet orbits (-1 for stars and planets without a known system)
+    E_val_km -> power of 10 value of the distance unit in km
+    E_val_kg -> power of 10 value of the mass unit in kg
+    */
+    public:
+        std::vector<std::string> names;
+        std::vector<double> x, y, z;
+        std::vector<double> vx, vy, vz;
+        std::vector<double> mass;
+        std::vector<double> diameter;
+        std::vector<std::vector<float>> color;
+        std::vector<int> host;
+        float E_val_km;
+        float E_val_kg;
+
+        BodySystem();
+        BodySystem(const std::string filename, float E_val_km, float E_val_kg);
+        int size() const;
+        BodyView view() const;
+        int add_body(std::string name, double mass, double diameter, double x, double y, double z, double vx, double vy, double vz, std::vector<float> color, int host);
+        int find_body_index(std::vector<std::string> body_names, std::string name);
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include "../include/BodySystem.h"
+#include "../include/Simulation.h"
+
+// Layout version of checkpoint files, bumped whenever a header field or section changes meaning
+const uint32_t checkpoint_version = 1;
+
+struct CheckpointHeader {
+    /*
+    Fixed header at the start of a checkpoint file, every field little-endian and naturally aligned
+
+    Args:
+    magic -> "CHIROCKP", identifies the file
+    version -> checkpoint_version of the writer
+    section_count -> entries of the section table following the header
+    body_count -> number of bodies, the length of every per body section
+    file_bytes -> size of the complete file, a shorter file was truncated
+    step_count, sim_time, force_evaluations -> progress of the simulation
+    time_step, G_const, softening -> physics the simulation ran with
+    E_val_km, E_val_kg -> units of the bodies
+    accelerations_current -> whether the saved accelerations belong to the saved positions
+    state_columns -> per body columns of integrator state
+    integrator -> name of the integrator owning the state
+    */
+    char magic[8];
+    uint32_t version;
+    uint32_t section_count;
+    uint64_t body_count;
+    uint64_t file_bytes;
+    int64_t step_count;
+    int64_t force_evaluations;
+    double sim_time;
+    double time_step;
+    double G_const;
+    double softening;
+    float E_val_km;
+    float E_val_kg;
+    uint32_t accelerations_current;
+    uint32_t state_columns;
+    char integrator[32];
+};
+
+struct CheckpointSection {
+    // Name of the column, its offset from the start of the file, 64 byte aligned, and its length
+    char name[16];
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+/*
+Writes the complete state of the simulation to filename, atomically
+
+The file is written next to its destination under filename + ".tmp", flushed to disk and only then
+renamed over filename, so a crash while writing leaves the previous checkpoint intact. Returns false
+and keeps the previous file if any write fails
+*/
+bool save_checkpoint(const Simulation& simulation, const std::string filename);
+
+class CheckpointFile {
+    /*
+    Checkpoint file mapped into memory and read in place
+
+    Every column is stored as one contiguous little-endian array, so opening a checkpoint only checks
+    the header and the section table and nothing is parsed or copied. bodies() views the mapped
+    columns directly, and restore copies them into a simulation to continue the run
+
+    Sections: x, y, z, vx, vy, vz, mass, diameter, ax, ay, az as doubles, host as int32, color as 4 floats
+    per body, the names of the bodies (their ids) as name_offsets, body_count + 1 uint64 offsets into
+    the names characters, and state0, state1, ... the integrator's columns as doubles
+
+    Args:
+    header -> header of the mapped file, nullptr while no file is open
+    */
+    public:
+        const CheckpointHeader* header;
+
+        CheckpointFile();
+        ~CheckpointFile();
+        CheckpointFile(const CheckpointFile&) = delete;
+        CheckpointFile& operator=(const CheckpointFile&) = delete;
+
+        bool open(const std::string filename);
+        void close();
+        const void* section(const std::string name, uint64_t& bytes) const;
+        int size() const;
+        BodyView bodies() const;
+        std::string name(int idx) const;
+        BodySystem load_system() const;
+        bool restore(Simulation& simulation) const;
+
+    private:
+        const char* data;
+        uint64_t bytes;
+#ifdef _WIN32
+        void* file_handle;
+        void* mapping_handle;
+#endif
+
+        const double* column(const char* name) const;
+        bool check_sections();
+};
+
+#endif
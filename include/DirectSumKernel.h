@@ -0,0 +1,39 @@
+#ifndef DIRECTSUMKERNEL_H
+#define DIRECTSUMKERNEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Instruction sets the direct summation kernel can run on, picked once at runtime
+enum SimdLevel {
+    simd_scalar = 0,
+    simd_avx2 = 1,
+    simd_avx512 = 2
+};
+
+// Squared separations below this are treated as coincident bodies and contribute no force
+const double min_kernel_r2 = 1e-30;
+
+SimdLevel detect_simd_level();
+const char* simd_level_name(SimdLevel level);
+
+/*
+Direct summation of the accelerations of targets [first_target, last_target) due to all count sources
+
+Sources are read from structure of arrays positions and masses, 1/r is evaluated with a hardware
+reciprocal square root estimate refined by Newton iterations on the AVX2 and AVX-512 paths
+*/
+void direct_sum_accelerations(const double* x, const double* y, const double* z, const double* mass, int count,
+    int first_target, int last_target, double G_const, double eps2, double* ax, double* ay, double* az, SimdLevel level);
+
+/*
+Direct summation of the accelerations and jerks (time derivatives of the accelerations) of targets
+[first_target, last_target), as needed by Hermite integration
+
+Scalar double precision only, the jerk needs the relative velocities of every pair as well
+*/
+void direct_sum_accelerations_jerks(const double* x, const double* y, const double* z, const double* vx, const double* vy, const double* vz,
+    const double* mass, int count, int first_target, int last_target, double G_const, double eps2,
+    double* ax, double* ay, double* az, double* jx, double* jy, double* jz);
+
+#endif
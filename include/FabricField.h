@@ -0,0 +1,89 @@
+#ifndef FABRICFIELD_H
+#define FABRICFIELD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../include/BodySystem.h"
+#include "../include/DirectSumKernel.h"
+#include "../include/ParticleMesh.h"
+#include "../include/ThreadPool.h"
+
+/*
+Sum of mass / r^2 over the count bodies seen from the node (node_x, 0, node_z), the fabric field before
+the G_const factor
+
+Separations are clamped to min_dist and bodies farther than the cutoff are skipped, both compared
+squared so no square root is taken. The AVX2 and AVX-512 paths handle 8 and 16 bodies at once
+*/
+float fabric_node_field(const float* x, const float* y, const float* z, const float* mass, int count,
+    float node_x, float node_z, float min_dist2, float cutoff2, SimdLevel level);
+
+class FabricField {
+    /*
+    Magnitude of the gravity field over the nodes of a square grid in the y = 0 plane, the depth the
+    spacetime fabric is deformed by. Free of any OpenGL state so it can be benchmarked headless
+
+    Nodes are split across the pool in contiguous rows, every node summing over the bodies with the
+    SIMD kernel, so the result is identical for any thread count. Bodies are binned into square cells of
+    at least distance_cutoff in the x-z plane, so a node only visits the 3 x 3 cells around its own and
+    the cost follows the local density of bodies instead of their total number
+
+    Args:
+    G_const -> gravitational constant scaled to the units of the bodies
+    distance_cutoff -> bodies farther than this from a node do not deform it
+    min_dist -> separations below this are evaluated at this separation
+    simd_level -> instruction set of the kernel, the best one supported by the processor by default
+    pool -> threads splitting the nodes, nullptr evaluates on the calling thread
+    mesh -> fabric field of a Particle-Mesh solver, sampled instead of summing over the bodies where it covers the node
+    spatial_index -> whether bodies are binned by cell, false sums over every body at every node
+    tolerance -> distance a body moves before update redraws its contribution, bodies moving less are left where they were drawn
+    refresh_interval -> incremental updates between two full evaluations, bounding the rounding error of the running sums
+    dirty_rows -> whether every node row was changed by the last evaluate or update
+    dirty_first_row, dirty_last_row -> bounds of the changed rows, none when first > last
+    */
+    public:
+        float G_const;
+        float distance_cutoff;
+        float min_dist;
+        SimdLevel simd_level;
+        ThreadPool* pool;
+        const FabricMeshSlice* mesh;
+        bool spatial_index;
+        float tolerance;
+        int refresh_interval;
+        std::vector<unsigned char> dirty_rows;
+        int dirty_first_row;
+        int dirty_last_row;
+
+        FabricField(float G_const, float distance_cutoff, float min_dist);
+        void load_bodies(const BodyView& bodies);
+        float field_at(float x, float z) const;
+        void evaluate(const BodyView& bodies, int nodes_per_side, float step, std::vector<float>& field);
+        void update(const BodyView& bodies, int nodes_per_side, float step, std::vector<float>& field);
+
+    private:
+        // Single precision copies of the body state read by the kernel, sorted by cell
+        std::vector<float> body_x, body_y, body_z, body_mass;
+
+        // Cell (i, j) covers x in origin + [i, i + 1) * cell_size and z in origin + [j, j + 1) * cell_size, its
+        // bodies are [cell_start[j * cells_per_side + i], cell_start[j * cells_per_side + i + 1]) of the sorted arrays
+        int cells_per_side;
+        float cell_size;
+        float cell_origin[2];
+        std::vector<int> cell_start;
+        std::vector<int> cell_fill;
+        std::vector<int> body_cell;
+
+        // State every body's contribution to the field was last drawn with, in body order
+        std::vector<double> drawn_x, drawn_y, drawn_z, drawn_mass;
+        std::vector<int> moved;
+        int drawn_nodes_per_side;
+        float drawn_step;
+        int updates_since_refresh;
+
+        void node_range(double coordinate, int nodes_per_side, float step, int& first, int& last) const;
+        void add_body(double x, double y, double z, double mass, double sign, int row, int nodes_per_side, float step, std::vector<float>& field) const;
+};
+
+#endif
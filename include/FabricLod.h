@@ -0,0 +1,98 @@
+#ifndef FABRICLOD_H
+#define FABRICLOD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <utility>
+#include "../include/BodySystem.h"
+#include "../include/FabricField.h"
+#include "../include/ThreadPool.h"
+
+struct FabricCell {
+    // Lower corner and width in lattice steps of the finest level
+    int i;
+    int j;
+    int size;
+
+    // Index of the first of 4 consecutive children, -1 for leaves
+    int first_child;
+
+    // Range of the bodies inside the cell in the body order of the tree
+    int body_begin;
+    int body_end;
+
+    // Field at the corners (low x, low z), (high x, low z), (low x, high z), (high x, high z), then at the
+    // center and the midpoints of the low z, high z, low x and high x edges
+    float corner[4];
+    float inner[5];
+
+    // Priority of splitting the cell
+    float score;
+};
+
+class FabricLod {
+    /*
+    Quadtree refined spacetime fabric over the square [-half_size, half_size]^2 of the y = 0 plane
+
+    Cells are split greedily in order of their projected error, as seen from the camera, until the vertex
+    budget is spent. The error of a cell is how far the field at its center and edge midpoints is from the
+    bilinear interpolation of its corners, so steep wells get fine cells. A well narrower than the cell can
+    hide between those points, so cells wider than the well's floor of 2 min_dist count the depth of the
+    deepest well of a body inside them as error too. Every cell also counts with its own size times
+    camera_weight, so flat regions close to the camera are refined too, at some cost to the wells. Edges
+    of coarse cells are split at the nodes of finer neighbours so the lines never leave cracks
+
+    Args:
+    max_vertices -> budget of fabric nodes
+    max_depth -> deepest level, cells are never smaller than 2 half_size / 2^max_depth
+    camera_weight -> deformation error counted per unit of cell size, refines flat regions near the camera, 0.001 by default
+    pool -> threads scoring new cells, nullptr scores them on the calling thread
+    vertices -> x, field, z of every node, the field not yet scaled into a deformation
+    indices -> pairs of nodes joined by a line
+    */
+    public:
+        int max_vertices;
+        int max_depth;
+        float camera_weight;
+        ThreadPool* pool;
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+
+        FabricLod(int max_vertices, int max_depth = 12);
+        void build(FabricField& field, const BodyView& bodies, float half_size, float deformation_scale, const float camera[3]);
+        float interpolate(float x, float z) const;
+        int leaf_count() const;
+
+    private:
+        std::vector<FabricCell> cells;
+        // Open addressing table from the key j * (lattice + 1) + i of the lattice point (i, j) to its node, a
+        // power of two at least twice the budget, and the key of every node in node order. Like every other
+        // buffer of build they keep their storage, so once the budget was reached a frame allocates nothing
+        std::vector<long long> table_keys;
+        std::vector<int> table_nodes;
+        std::vector<long long> node_keys;
+        // Cells waiting to be split, a heap of their scores
+        std::vector<std::pair<float, int>> queue;
+        // Bodies ordered so the bodies of every cell are contiguous, and the depth of their wells
+        std::vector<int> body_order;
+        std::vector<float> well_depth;
+        // Scratch of build, the first children of cells split since the last scoring and the node keys along
+        // rows and along columns
+        std::vector<int> pending;
+        std::vector<std::pair<long long, int>> row_keys, column_keys;
+        int lattice;
+        float half_size;
+        float lattice_step;
+
+        long long key(int i, int j) const;
+        int find_node(long long key) const;
+        float sample(const FabricField& field, int i, int j) const;
+        void add_node(int i, int j, float value);
+        void sample_inner(const FabricField& field, FabricCell* cells, int count) const;
+        void score_cell(const FabricField& field, FabricCell& cell, float deformation_scale, const float camera[3]) const;
+        void split_bodies(const BodyView& bodies, const FabricCell& cell, FabricCell children[4]);
+        void build_indices();
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef FASTMULTIPOLE_H
+#define FASTMULTIPOLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../include/BodySystem.h"
+#include "../include/ForceSolver.h"
+#include "../include/Octree.h"
+
+// Highest supported expansion order, bounds the scratch space of the 1/r derivative recurrence
+const int max_fmm_order = 10;
+
+// Closest two bodies of cells interacting through expansions may come, in softening lengths
+const double softening_cells = 10.0;
+
+class FastMultipoleSolver : public ForceSolver {
+    /*
+    Fast Multipole Method solver using Cartesian Taylor expansions on an octree, O(N)
+
+    Multipoles of every cell are expanded about its center of mass and converted into local
+    expansions of well separated cells through a dual tree walk, the near field is summed directly.
+    The walk is serial and cheap, the expansions and sums it schedules run on the thread pool
+
+    Expansions are of the unsoftened 1/r while the direct sums are softened, so cells whose bodies
+    could come closer than softening_cells softening lengths are always opened. Beyond that the
+    softening changes a pair force by at most 1.5 eps^2 / r^2, 1.5%, and the far field stays unsoftened
+
+    Args:
+    order -> expansion order p of the multipole and local expansions
+    opening_angle -> two cells of radii r_a and r_b at distance d interact through expansions when (r_a + r_b) / d < theta
+    tree -> octree rebuilt from the bodies on every evaluation
+    */
+    public:
+        int order;
+        float opening_angle;
+        Octree tree;
+
+        FastMultipoleSolver(int order, float opening_angle, int leaf_size = 32);
+        const char* name() const;
+        void compute_accelerations(const BodySystem& system, double G_const, double softening, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az);
+
+    private:
+        // Multi-index tables of all (t, u, v) with t + u + v <= order
+        int coefficients;
+        std::vector<int> index_t, index_u, index_v;
+        std::vector<int> index_of;
+        std::vector<double> inverse_factorial;
+        std::vector<int> m2l_target, m2l_source, m2l_sum;
+        std::vector<double> m2l_sign;
+
+        // Expansions and radii of every tree cell
+        std::vector<double> multipoles;
+        std::vector<double> locals;
+        std::vector<double> radius;
+        double walk_softening;
+
+        // Flattened (target, source) cell pairs recorded by the dual tree walk
+        std::vector<int> m2l_pairs;
+        std::vector<int> p2p_pairs;
+
+        // Pairs grouped by target cell and the subtrees handed to the threads, reused between evaluations
+        std::vector<int> m2l_offsets, m2l_sources, p2p_offsets, p2p_sources;
+        std::vector<int> subtrees;
+
+        int multi_index(int t, int u, int v) const;
+        void derivatives(double X, double Y, double Z, double* D) const;
+        void powers(double X, double Y, double Z, double* P) const;
+        void particles_to_multipole(const BodySystem& system, int leaf);
+        void children_to_multipole(int node);
+        void upward_pass(const BodySystem& system, int node, int max_count, bool above_subtrees);
+        void interact(int target, int source);
+        void multipole_to_local(int target, int source, double G_const);
+        void particles_to_particles(const BodySystem& system, int target, int source, double G_const, double eps2, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az);
+        void local_to_children(int node);
+        void local_to_particles(const BodySystem& system, int leaf, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az);
+        void downward_pass(const BodySystem& system, int node, int max_count, bool above_subtrees, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az);
+        bool is_subtree_root(int node, int max_count) const;
+        void collect_subtrees(int node, int max_count, std::vector<int>& subtrees) const;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef FORCESOLVER_H
+#define FORCESOLVER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <string>
+#include "../include/BodySystem.h"
+#include "../include/DirectSumKernel.h"
+#include "../include/ThreadPool.h"
+
+class ForceSolver {
+    /*
+    Interface of the gravity backends, evaluating the acceleration of every body from one frozen state
+
+    Args:
+    system -> bodies whose accelerations are evaluated
+    G_const -> gravitational constant in simulation units
+    softening -> Plummer softening length in E_val_km units
+    ax, ay, az -> output accelerations, resized to the number of bodies
+    targets -> bodies whose accelerations are refreshed by compute_target_accelerations, the others keep their values.
+    It returns the number of bodies it really evaluated, every body for solvers without a cheaper path for a few targets
+    pool -> worker threads the evaluation is split across, evaluated on the calling thread when null
+    */
+    public:
+        ThreadPool* pool;
+
+        ForceSolver();
+        virtual ~ForceSolver() {}
+        virtual const char* name() const = 0;
+        virtual void compute_accelerations(const BodySystem& system, double G_const, double softening, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az) = 0;
+        virtual int compute_target_accelerations(const BodySystem& system, double G_const, double softening, const std::vector<int>& targets, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az);
+
+    private:
+        // Scratch accelerations of the fallback evaluating every body when only a few targets are needed
+        std::vector<double> scratch[3];
+        bool warned_targets;
+};
+
+class DirectSumSolver : public ForceSolver {
+    /*
+    Exact O(N^2) summation over every pair of bodies
+
+    Args:
+    simd_level -> instruction set of the summation kernel, the best one supported by the processor by default
+    */
+    public:
+        SimdLevel simd_level;
+
+        DirectSumSolver();
+        DirectSumSolver(SimdLevel simd_level);
+        const char* name() const;
+        void compute_accelerations(const BodySystem& system, double G_const, double softening, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az);
+        int compute_target_accelerations(const BodySystem& system, double G_const, double softening, const std::vector<int>& targets, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az);
+};
+
+#endif
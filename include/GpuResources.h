@@ -0,0 +1,99 @@
+#ifndef GPURESOURCES_H
+#define GPURESOURCES_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glad/glad.h>
+
+// Live OpenGL objects owned by GpuBuffer, GpuVertexArray and GpuTexture, and the bytes of buffer storage they hold
+struct GpuResourceCounts {
+    int buffers;
+    int vertex_arrays;
+    int textures;
+    long long bytes;
+};
+
+GpuResourceCounts gpu_resource_counts();
+void report_gpu_resources(const char* label);
+
+class GpuBuffer {
+    /*
+    Owning handle of one OpenGL buffer object, deleted with the handle and never copied
+
+    The object is created on first use, so handles can be members of models built before their
+    buffers are needed. Uploads of the same size update the storage in place, orphaning it first so
+    the driver never stalls on a frame still reading the old contents, and only a size change
+    reallocates it. update rewrites part of the existing storage without orphaning the rest
+
+    Args:
+    target -> binding point of the buffer, GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER or GL_TEXTURE_BUFFER
+    usage -> usage hint of the storage, GL_STATIC_DRAW for data uploaded once and GL_DYNAMIC_DRAW for per frame data
+    */
+    public:
+        GpuBuffer(GLenum target = GL_ARRAY_BUFFER, GLenum usage = GL_STATIC_DRAW);
+        ~GpuBuffer();
+        GpuBuffer(const GpuBuffer&) = delete;
+        GpuBuffer& operator=(const GpuBuffer&) = delete;
+        GpuBuffer(GpuBuffer&& other);
+        GpuBuffer& operator=(GpuBuffer&& other);
+
+        GLuint id();
+        long long size() const;
+        void bind();
+        void upload(const void* data, long long bytes);
+        void update(long long offset, const void* data, long long bytes);
+        void release();
+
+    private:
+        GLuint handle;
+        GLenum target;
+        GLenum usage;
+        long long bytes;
+};
+
+class GpuVertexArray {
+    /*
+    Owning handle of one OpenGL vertex array object, created on first use and deleted with the handle
+    */
+    public:
+        GpuVertexArray();
+        ~GpuVertexArray();
+        GpuVertexArray(const GpuVertexArray&) = delete;
+        GpuVertexArray& operator=(const GpuVertexArray&) = delete;
+        GpuVertexArray(GpuVertexArray&& other);
+        GpuVertexArray& operator=(GpuVertexArray&& other);
+
+        GLuint id();
+        void bind();
+        void release();
+
+    private:
+        GLuint handle;
+};
+
+class GpuTexture {
+    /*
+    Owning handle of one OpenGL texture object, created on first use and deleted with the handle
+
+    Args:
+    target -> binding point of the texture, GL_TEXTURE_BUFFER for a texture reading its texels from a GpuBuffer
+    */
+    public:
+        GpuTexture(GLenum target = GL_TEXTURE_2D);
+        ~GpuTexture();
+        GpuTexture(const GpuTexture&) = delete;
+        GpuTexture& operator=(const GpuTexture&) = delete;
+        GpuTexture(GpuTexture&& other);
+        GpuTexture& operator=(GpuTexture&& other);
+
+        GLuint id();
+        void bind();
+        void release();
+
+    private:
+        GLuint handle;
+        GLenum target;
+};
+
+#endif
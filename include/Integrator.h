@@ -0,0 +1,141 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../include/BodySystem.h"
+
+class Simulation;
+
+class Integrator {
+    /*
+    Interface of the time integration schemes advancing a Simulation by one time_step
+
+    Accelerations are always evaluated for every body at once from a frozen state before any body
+    moves, so results never depend on the order bodies are stored in
+    */
+    public:
+        virtual ~Integrator() {}
+        virtual const char* name() const = 0;
+        virtual void step(Simulation& simulation) = 0;
+
+        // Per body columns the scheme carries from one step to the next besides the accelerations, saved with
+        // checkpoints so a restarted run continues exactly. Schemes keeping nothing have no columns
+        virtual int state_columns() const { return 0; }
+        virtual void save_state(int, double*) const {}
+        virtual void load_state(int, const double*, int) {}
+};
+
+class EulerIntegrator : public Integrator {
+    /*
+    First order scheme of the original simulator, v += a dt and x += v dt + a dt^2 / 2
+    */
+    public:
+        const char* name() const;
+        void step(Simulation& simulation);
+};
+
+class LeapfrogIntegrator : public Integrator {
+    /*
+    Second order symplectic kick-drift-kick leapfrog (velocity Verlet), one force evaluation per step
+
+    The closing acceleration of a step is reused as the opening kick of the next one
+    */
+    public:
+        const char* name() const;
+        void step(Simulation& simulation);
+};
+
+class HermiteIntegrator : public Integrator {
+    /*
+    Fourth order Hermite predictor-corrector using the accelerations and their time derivatives (jerks)
+
+    Positions and velocities are predicted by a Taylor series, accelerations and jerks are evaluated
+    once at the predicted state and a Hermite interpolation corrects the prediction. Accelerations and
+    jerks always come from exact direct summation, whatever the force_solver configuration
+    */
+    public:
+        const char* name() const;
+        void step(Simulation& simulation);
+        int state_columns() const;
+        void save_state(int column, double* values) const;
+        void load_state(int column, const double* values, int size);
+
+    private:
+        std::vector<double> jx, jy, jz;
+        // Accelerations, jerks and state at the start of the step
+        std::vector<double> old_a[3], old_j[3], old_x[3], old_v[3];
+
+        void evaluate(Simulation& simulation);
+};
+
+class WisdomHolmanIntegrator : public Integrator {
+    /*
+    Wisdom-Holman mixed variable symplectic integrator in democratic heliocentric coordinates
+
+    Every star with its planets (the host of BodySystem) forms a system. Planets move analytically on
+    Kepler orbits about their host with heliocentric positions and barycentric velocities, while the
+    weak planet-planet and system-system forces are applied as kicks. Time steps can be a small fraction
+    of the innermost orbital period instead of the close approach time of a Cartesian integrator.
+    Host-planet pairs are never softened, softening only applies to the kicks
+
+    Like Hermite, the interactions are always summed directly over every pair other than the host-planet
+    ones, whatever the force solver, so an approximate solver's error never leaks into the kicks
+    */
+    public:
+        const char* name() const;
+        void step(Simulation& simulation);
+
+    private:
+        // Interaction accelerations, the totals without the host-planet attraction, of the last evaluated positions
+        std::vector<double> kick_a[3];
+        // System barycenters indexed by host, heliocentric positions and barycentric velocities indexed by planet
+        std::vector<double> center[3], center_velocity[3], total_mass;
+        std::vector<double> relative[3], relative_velocity[3];
+        // Per system sums of the planets' mass weighted positions and velocities
+        std::vector<double> planet_offset[3], planet_momentum[3];
+
+        int host_of(const BodySystem& system, int idx) const;
+        void interaction_accelerations(Simulation& simulation);
+        void kick(BodySystem& system, double dt);
+        void to_heliocentric(const BodySystem& system);
+        void jump(const BodySystem& system, double dt);
+        void from_heliocentric(BodySystem& system);
+};
+
+class BlockTimestepIntegrator : public Integrator {
+    /*
+    Kick-drift-kick leapfrog with individual power-of-two block timesteps
+
+    Every body sits on a level k with timestep time_step / 2^k, chosen from how fast its acceleration
+    changes. Only the bodies ending their timestep have their forces recomputed, all bodies drift
+    together, and every level is synchronized again at the end of each time_step
+
+    Args:
+    accuracy -> eta of the timestep criterion dt = eta |a| / |da/dt|
+    max_level -> deepest level, bodies never take timesteps below time_step / 2^max_level
+    levels -> current level of every body
+    */
+    public:
+        double accuracy;
+        int max_level;
+        std::vector<int> levels;
+
+        BlockTimestepIntegrator(double accuracy, int max_level);
+        const char* name() const;
+        void step(Simulation& simulation);
+        int state_columns() const;
+        void save_state(int column, double* values) const;
+        void load_state(int column, const double* values, int size);
+
+    private:
+        // Accelerations at the start of every body's current timestep, used to estimate da/dt
+        std::vector<double> start_ax, start_ay, start_az;
+        std::vector<int> active;
+
+        int choose_level(double dt_max, double timestep) const;
+        void initialize_levels(Simulation& simulation);
+};
+
+#endif
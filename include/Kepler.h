@@ -0,0 +1,20 @@
+#ifndef KEPLER_H
+#define KEPLER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+Advances a body on its two-body Kepler orbit about a fixed center for time dt, in place
+
+Uses universal variables with Stumpff functions, so elliptic, parabolic and hyperbolic orbits are all
+handled and dt may span several periods
+
+Args:
+mu -> gravitational parameter G (M + m) of the orbit
+position, velocity -> position and velocity relative to the center
+dt -> time to advance, may be negative
+*/
+void kepler_drift(double mu, double position[3], double velocity[3], double dt);
+
+#endif
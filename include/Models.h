@@ -4,9 +4,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <vector>
-#include "../include/json.hpp"
-#include <fstream>
 #include <string>
+#include "../include/BodySystem.h"
+#include "../include/GpuResources.h"
 
 #include <glad/glad.h>
 #include <glm/gtc/type_ptr.hpp>
@@ -17,44 +17,59 @@ extern int columnsCount;
 extern const float pi;
 extern float precision;
 
+// Floats per body in the instance buffer, center and radius followed by the RGBA color
+const int instanceFloats = 8;
+
 class Body {
     /*
-    Class for Models in simulation
-    
+    Class for Models in simulation, rendering the state of a body simulated by the BodySystem core
+
     Args:
+    mass -> mass of body mirrored from the simulation, read by the spacetime fabric
     diameter -> diameter of body in OpenGL axis measurements
     position -> spatial position of center of sphere
     color -> vector of RGB values and opacity value in float
-    shader -> shaders program script compiled, loaded, and linked into the graphics memory
     */
     public:
-        GLuint VAO, VBO;
         std::string name;
         float mass;
         float diameter;
         glm::vec3 position;
-        std::vector<float> vertices;
-        glm::vec3 velocity;
         std::vector<float> color;
-        GLuint shader;
-        float time_step;
 
-        Body(std::string name, float mass, float diameter, glm::vec3 position, glm::vec3 init_velocity, std::vector<float> color, GLuint shader, float time_step);
-        void compute_vertices();
-        void create_body();
-        void draw_body();
-        void update_body(std::vector<Body> bodies, int bodies_num, float G_const);
+        Body(std::string name, float mass, float diameter, glm::vec3 position, std::vector<float> color);
+        void update_body(glm::vec3 position);
 };
 
 class Bodies {
+    /*
+    Every body of the simulation drawn as an instance of one shared unit sphere mesh
+
+    The sphere is built and uploaded once, each frame only the center, radius and color of every body
+    are streamed into the instance buffer and all bodies are drawn by a single instanced draw call
+
+    Args:
+    bodies -> models of the bodies in the order of the BodySystem
+    vertices -> triangles of the unit sphere
+    instances -> instanceFloats values per body, uploaded to instanceVBO
+    shader -> instanced shaders program reading the per body attributes
+    */
     public:
+        GpuVertexArray VAO;
+        GpuBuffer meshVBO, instanceVBO;
         std::vector<Body> bodies;
-        float E_val_km;
-        float E_val_kg;
-    
-        Bodies(const std::string filename, float E_val_km, float E_val_kg, GLuint shader, float time_step);
-        int find_body_index(std::vector<std::string> body_names, std::string name);
-        std::vector<Body> get_bodies();
+        std::vector<float> vertices;
+        std::vector<float> instances;
+        GLuint shader;
+
+        Bodies(const BodySystem& system, GLuint shader);
+        const std::vector<Body>& get_bodies() const;
+        void compute_vertices();
+        void create_bodies();
+        void update_bodies(const BodyView& state);
+        void compute_instances(const BodyView& state);
+        void upload_instances();
+        void draw_bodies();
 };
 
-#endif
\ No newline at end of file
+#endif
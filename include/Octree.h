@@ -0,0 +1,68 @@
+#ifndef OCTREE_H
+#define OCTREE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../include/BodySystem.h"
+
+// Cells are not split any further past this depth, guards against coincident bodies
+const int max_tree_depth = 48;
+
+// Grows a buffer to half more than needed once it has less than a quarter to spare, so the small changes of a
+// tree and its interactions from one step to the next stay within its capacity instead of reallocating it
+template <typename T>
+inline void keep_headroom(std::vector<T>& list, size_t needed) {
+    if (list.capacity() < needed + needed / 4) {
+        list.reserve(needed + needed / 2);
+    }
+
+    return;
+}
+
+struct OctreeNode {
+    // Geometry of the cubic cell
+    double center[3];
+    double half_size;
+
+    // Monopole of all bodies inside the cell
+    double mass;
+    double com[3];
+
+    // Distance from the cell center to its center of mass, widens the opening radius
+    double com_offset;
+
+    // Range of the cell's bodies inside the tree's sorted index array
+    int begin;
+    int end;
+
+    // Index of the first of 8 consecutive children, -1 for leaves
+    int first_child;
+};
+
+class Octree {
+    /*
+    Octree over the bodies of a system, shared by the tree based force solvers
+
+    Args:
+    leaf_size -> maximum number of bodies kept in one leaf cell
+    nodes -> cells of the tree, the root first and the 8 children of a cell stored consecutively
+    order -> body indices sorted so that every cell owns a contiguous range
+    */
+    public:
+        int leaf_size;
+        std::vector<OctreeNode> nodes;
+        std::vector<int> order;
+
+        Octree(int leaf_size = 8);
+        void build(const BodySystem& system);
+
+    private:
+        // Scratch of the per cell counting sorts, kept between builds so rebuilding does not allocate
+        std::vector<int> octants;
+        std::vector<int> sorted;
+
+        void build_node(const BodySystem& system, int node, int depth);
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef P3M_H
+#define P3M_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../include/BodySystem.h"
+#include "../include/ForceSolver.h"
+#include "../include/ParticleMesh.h"
+
+class P3MSolver : public ParticleMeshSolver {
+    /*
+    Particle-Particle Particle-Mesh solver, mesh cost with close to direct summation accuracy in clumps
+
+    The 1/r interaction is split at a scale r_s into a smooth long range part erf(r / 2 r_s) / r solved
+    on the Particle-Mesh mesh and a short range part erfc(r / 2 r_s) / r summed exactly over the pairs
+    closer than the cutoff, found through a cell list. The mesh only holds the long range field
+
+    Args:
+    distance_cutoff -> radius of the pair sums, r_s = cutoff / 5. Never below 5 mesh cells, as the mesh
+    cannot resolve a finer split, nor above the extent of the mesh, with a warning whenever it is clamped.
+    0 splits at 1.25 mesh cells, the cheapest pair sums the mesh resolves accurately
+    min_dist -> pairs closer than this are evaluated at this separation
+    */
+    public:
+        double distance_cutoff;
+        double min_dist;
+
+        P3MSolver(int grid_size, double distance_cutoff, double min_dist);
+        const char* name() const;
+        void compute_accelerations(const BodySystem& system, double G_const, double softening, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az);
+
+    private:
+        // Bodies sorted by cell, the bodies of cell c are cell_bodies[cell_start[c] .. cell_start[c + 1])
+        int cells_per_side;
+        double cell_size;
+        double cell_origin[3];
+        std::vector<int> cell_start;
+        std::vector<int> cell_bodies;
+        std::vector<int> body_cell;
+        std::vector<int> cell_fill;
+
+        // Short range share of the force tabulated against r / cutoff, the split is a fixed fraction of the cutoff
+        std::vector<double> share_table;
+        // Whether the clamping of the cutoff was reported, only its first occurrence is
+        bool warned_clamp;
+
+        void build_cells(const BodySystem& system, double cutoff);
+        void short_range(const BodySystem& system, int idx, double G_const, double eps2, double cutoff, double gravity[3]) const;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef PARTICLEMESH_H
+#define PARTICLEMESH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <complex>
+#include "../include/BodySystem.h"
+#include "../include/ForceSolver.h"
+
+// Bodies are kept this many cells away from the mesh edges so every stencil stays inside it
+const int mesh_border = 3;
+
+struct FabricMeshSlice {
+    /*
+    Fabric field of a Particle-Mesh solver on one horizontal plane of its mesh, small enough to be copied
+    out of the solver and handed to another thread
+
+    Args:
+    origin -> x and z of node (0, 0), node (i, k) sits at origin + (i, k) * spacing
+    spacing -> distance between two nodes
+    size -> nodes per side
+    values -> sum of mass / r^2 over the bodies at node (i, k) in values[i * size + k], the fabric field before the G_const factor
+    valid -> whether the plane was inside the mesh, nothing can be sampled otherwise
+    */
+    double origin[2];
+    double spacing;
+    int size;
+    std::vector<float> values;
+    bool valid;
+
+    FabricMeshSlice();
+    bool sample(double x, double z, float& value) const;
+};
+
+class ParticleMeshSolver : public ForceSolver {
+    /*
+    Particle-Mesh solver for dense, smooth distributions, O(N + M log M) for M mesh nodes
+
+    Masses are deposited onto a cubic mesh around the bodies with cloud-in-cell weights, Poisson's
+    equation is solved by FFT convolution with the 1/r Green's function on a zero padded mesh (isolated,
+    not periodic, boundaries) and the mesh field is interpolated back with the same weights. Forces are
+    smoothed over about a cell, so close pairs are far weaker than with the other solvers
+
+    The potential and field of the last evaluation stay on the mesh and can be sampled anywhere inside it.
+    With a fabric cutoff set, every evaluation also convolves the deposit with the kernel of the spacetime
+    fabric, 1 / max(r^2, fabric_min_dist^2) up to fabric_cutoff, so the fabric reads the same quantity
+    on the mesh as it sums over the bodies away from it. That costs one more product and inverse transform,
+    and a transform of the kernel whenever the spacing drifts by more than 1% from the one it was built for
+
+    Softening is Plummer softening added to the half cell smoothing of the Green's function
+
+    Args:
+    grid_size -> mesh nodes per side, rounded up to a power of two
+    fabric_min_dist, fabric_cutoff -> clamp and cutoff of the fabric kernel, no fabric field while the cutoff is 0
+    */
+    public:
+        int grid_size;
+        double fabric_min_dist;
+        double fabric_cutoff;
+
+        ParticleMeshSolver(int grid_size);
+        const char* name() const;
+        void compute_accelerations(const BodySystem& system, double G_const, double softening, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az);
+        bool potential_at(double x, double y, double z, double& potential) const;
+        bool field_at(double x, double y, double z, double gravity[3]) const;
+        bool fabric_slice(double y, FabricMeshSlice& slice) const;
+
+    protected:
+        // Mesh placement of the last evaluation, node (i, j, k) sits at origin + (i, j, k) * spacing
+        double origin[3];
+        double spacing;
+        bool evaluated;
+
+        std::vector<double> potential;
+        std::vector<double> field[3];
+
+        // Transform of the Green's function in mesh units on the padded mesh, rebuilt only when its split or softening changes
+        std::vector<std::complex<double>> green;
+        std::vector<std::complex<double>> padded;
+        double green_split;
+        double green_softening;
+
+        // Transform of the fabric kernel for the spacing it was built with, and the fabric field on the mesh
+        std::vector<std::complex<double>> fabric_green;
+        std::vector<std::complex<double>> fabric_padded;
+        double fabric_green_spacing;
+        double fabric_green_min_dist;
+        double fabric_green_cutoff;
+        std::vector<double> fabric;
+
+        // Bit reversal permutation and one line buffer per worker of the FFT, kept between evaluations
+        std::vector<int> bit_reversed;
+        std::vector<std::complex<double>> lines;
+
+        int node(int i, int j, int k) const;
+        bool cloud_in_cell(double x, double y, double z, int cell[3], double weights[3]) const;
+        void transform(std::vector<std::complex<double>>& data, int size, bool inverse, int used);
+        void build_green(double split, double softening);
+        void build_fabric_green();
+        void place_mesh(const BodySystem& system);
+        void solve_mesh(const BodySystem& system, double G_const);
+};
+
+#endif
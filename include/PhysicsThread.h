@@ -0,0 +1,85 @@
+#ifndef PHYSICSTHREAD_H
+#define PHYSICSTHREAD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "../include/BodySystem.h"
+#include "../include/Simulation.h"
+#include "../include/SimulationClock.h"
+#include "../include/TripleBuffer.h"
+#include "../include/ParticleMesh.h"
+
+struct BodySnapshot {
+    /*
+    Copy of the bodies published by the physics thread after its steps, never changed while the renderer reads it
+
+    Args:
+    x, y, z, previous_x, previous_y, previous_z -> positions after the last step and before it
+    vx, vy, vz, mass, diameter, host -> state of the bodies after the last step
+    sim_time, step_count -> simulated time and steps of the simulation after the last step
+    alpha -> fraction of a step owed by the clock when the snapshot was published
+    step_rate -> steps per wall second the clock was running at
+    published -> wall time the snapshot was published at
+    fabric_mesh -> fabric field of a Particle-Mesh solver in the y = 0 plane after the last step, invalid for other solvers or without a fabric cutoff
+    */
+    std::vector<double> x, y, z;
+    std::vector<double> previous_x, previous_y, previous_z;
+    std::vector<double> vx, vy, vz;
+    std::vector<double> mass;
+    std::vector<double> diameter;
+    std::vector<int> host;
+    double sim_time;
+    long step_count;
+    double alpha;
+    double step_rate;
+    std::chrono::steady_clock::time_point published;
+    FabricMeshSlice fabric_mesh;
+};
+
+class PhysicsThread {
+    /*
+    Simulation stepped on its own thread, paced by a SimulationClock, and read by a renderer that never waits for it
+
+    After every round of steps the thread copies the bodies into a snapshot and publishes it through a
+    triple buffer. bodies() takes the newest snapshot without blocking and blends its two positions by
+    the wall time since it was published, so the renderer keeps its frame rate however long a step
+    takes and still draws smooth motion. The simulation belongs to the thread once started, so its pool
+    and solver must not be used by anyone else
+
+    Args:
+    time_warp -> multiplier of the simulated speed, settable from any thread
+    paused -> whether the simulation is held, settable from any thread
+    */
+    public:
+        std::atomic<double> time_warp;
+        std::atomic<bool> paused;
+
+        PhysicsThread(Simulation simulation, SimulationClock clock);
+        ~PhysicsThread();
+        PhysicsThread(const PhysicsThread&) = delete;
+        PhysicsThread& operator=(const PhysicsThread&) = delete;
+
+        void start();
+        void stop();
+        BodyView bodies();
+        const BodySnapshot& snapshot() const;
+
+    private:
+        Simulation simulation;
+        SimulationClock clock;
+        TripleBuffer<BodySnapshot> snapshots;
+        std::thread worker;
+        std::atomic<bool> running;
+
+        // Positions blended by bodies, owned by the reader
+        std::vector<double> blended_x, blended_y, blended_z;
+
+        void run();
+        void publish();
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include "../include/BodySystem.h"
+#include "../include/ForceSolver.h"
+#include "../include/ThreadPool.h"
+#include "../include/Integrator.h"
+
+// Physics configurations gathered from Configurations.json file
+struct SimulationConfig {
+    float E_val_km;
+    float E_val_kg;
+    float G_const;
+    float softening;
+    float time_step;
+    std::string integrator;
+    float timestep_accuracy;
+    int max_timestep_level;
+    std::string force_solver;
+    float opening_angle;
+    int fmm_order;
+    int pm_grid;
+    float p3m_cutoff;
+    float min_dist;
+    int threads;
+    std::string trajectory_compression;
+    float trajectory_quantum;
+    int trajectory_chunk_frames;
+};
+
+SimulationConfig load_simulation_config(const std::string filename);
+std::unique_ptr<ForceSolver> create_force_solver(const SimulationConfig& configs);
+std::unique_ptr<Integrator> create_integrator(const SimulationConfig& configs);
+
+class Simulation {
+    /*
+    Headless N-body simulation stepping a BodySystem forward in time
+
+    Args:
+    system -> physics state of all bodies being simulated
+    G_const -> gravitational constant scaled to E_val_km and E_val_kg units
+    softening -> Plummer softening length in E_val_km units, keeps close encounters finite
+    time_step -> simulated seconds advanced by every call to step
+    integrator -> time integration scheme chosen by the integrator configuration
+    accelerations_current -> whether ax, ay and az still belong to the current positions of the bodies
+    force_evaluations -> number of single body accelerations evaluated so far, the cost measure of the integrators
+    solver -> gravity backend chosen by the force_solver configuration
+    pool -> persistent worker threads shared by the force evaluations, sized by the threads configuration
+
+    Clients read the bodies through the zero-copy view returned by bodies(), stepping never reallocates it
+    */
+    public:
+        BodySystem system;
+        std::vector<double> ax, ay, az;
+        double G_const;
+        double softening;
+        double time_step;
+        double sim_time;
+        long step_count;
+        std::unique_ptr<ThreadPool> pool;
+        std::unique_ptr<ForceSolver> solver;
+        std::unique_ptr<Integrator> integrator;
+        bool accelerations_current;
+        long long force_evaluations;
+
+        Simulation(BodySystem system, SimulationConfig configs);
+        void compute_accelerations();
+        void compute_accelerations(const std::vector<int>& targets);
+        BodyView bodies() const;
+        void step();
+        void run(int steps);
+        double total_energy();
+};
+
+#endif
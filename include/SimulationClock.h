@@ -0,0 +1,52 @@
+#ifndef SIMULATIONCLOCK_H
+#define SIMULATIONCLOCK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../include/BodySystem.h"
+#include "../include/Simulation.h"
+
+class SimulationClock {
+    /*
+    Fixed timestep accumulator pacing a Simulation by wall-clock time instead of by rendered frames
+
+    Every frame adds the elapsed wall time, times steps_per_second and time_warp, to the accumulator and
+    runs one step per whole step it holds, so the simulated speed no longer depends on the refresh rate.
+    A frame never runs more than max_substeps steps nor keeps stepping past frame_budget wall seconds,
+    and time that did not fit is dropped rather than carried over, so a slow frame cannot make every
+    frame after it slower. The positions before the last step are kept, and view() blends them with the
+    current ones by the fraction of a step left in the accumulator, so bodies move smoothly however the
+    steps fall between frames
+
+    Args:
+    steps_per_second -> physics steps run per wall second at a time_warp of 1
+    time_warp -> multiplier of the simulated speed, 0 pauses the simulation
+    max_substeps -> most steps run in a single frame
+    frame_budget -> wall seconds a frame may spend stepping before the remaining steps are dropped
+    accumulator -> steps owed to the simulation, the fraction below 1 is how far the view is past the previous state
+    steps -> steps run by the last advance
+    dropped_steps -> steps dropped by every advance so far because of max_substeps or frame_budget
+    */
+    public:
+        double steps_per_second;
+        double time_warp;
+        int max_substeps;
+        double frame_budget;
+        double accumulator;
+        int steps;
+        long long dropped_steps;
+
+        SimulationClock(double steps_per_second, double time_warp = 1.0, int max_substeps = 8, double frame_budget = 0.012);
+        int advance(Simulation& simulation, double wall_seconds);
+        double alpha() const;
+        BodyView view(const Simulation& simulation);
+        BodyView previous(const Simulation& simulation) const;
+
+    private:
+        // Positions before the last step, and the blended positions handed out by view
+        std::vector<double> previous_x, previous_y, previous_z;
+        std::vector<double> blended_x, blended_y, blended_z;
+};
+
+#endif
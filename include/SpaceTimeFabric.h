@@ -4,7 +4,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <vector>
-#include "../include/Models.h"
+#include "../include/BodySystem.h"
+#include "../include/FabricField.h"
+#include "../include/FabricLod.h"
+#include "../include/GpuResources.h"
 
 #include <glad/glad.h>
 #include <glm/gtc/type_ptr.hpp>
@@ -17,16 +20,26 @@ class Fabric {
     Class simulating the fabric of spacetime
 
     Args:
-    bodies -> array of model bodies stored in json file
+    bodies -> read-only view of the simulated bodies whose gravity deforms the fabric
     position -> position of center of spacetime fabric
     gridStep -> distance between each row or column of the grid
+    vertices -> one vertex per grid node, row by row, displaced by the gravity field at the node
+    indices -> pairs of neighbouring nodes joined by a line, fixed for the lifetime of the uniform grid
     color -> color of the grid mesh simulating the fabric
     y_value -> y value of the static level of the grid
     shader -> shader program used for all models in the simulation
+    field -> evaluator of the gravity field at every node, set its pool for threads and its mesh to the fabric field of a Particle-Mesh solver
+    heights -> field magnitude at every node, row by row
+    lod -> quadtree refined fabric rebuilt every frame in place of the uniform grid when its vertex budget is above 0
+    cameraPosition -> position of the camera the quadtree is refined for
+    deformShader -> program displacing the flat grid by the bodies in its vertex shader, 0 while the CPU deforms the vertices
+    bodyBuffer, bodyTexture -> x, y, z and mass of every body, read by deformShader as a buffer texture
+    bodyTexels -> staging copy of the bodies uploaded to bodyBuffer every frame
     */
     public:
-        GLuint VAO, VBO;
-        std::vector<Body> bodies;
+        GpuVertexArray VAO;
+        GpuBuffer VBO, EBO;
+        BodyView bodies;
         int E_val_km;
         int E_val_kg;
         float distance_cutoff;
@@ -34,17 +47,33 @@ class Fabric {
         float gridStep;
         int gridSquares;
         std::vector<float> vertices;
+        std::vector<unsigned int> indices;
         std::vector<float> color;
         float y_value;
         float G_const;
         float min_dist;
         float deformation_scale;
         GLuint shader;
+        FabricField field;
+        std::vector<float> heights;
+        FabricLod lod;
+        glm::vec3 cameraPosition;
+        GLuint deformShader;
+        GpuBuffer bodyBuffer;
+        GpuTexture bodyTexture;
+        std::vector<float> bodyTexels;
 
-        Fabric(std::vector<Body> bodies, float E_val_km, float E_val_kg, float distance_cutoff, float gridStep, int gridSquares, glm::vec3 position, std::vector<float> color, float y_value, float G_const, float min_dist, float deformation_scale, GLuint shader);
+        Fabric(const BodyView& bodies, float E_val_km, float E_val_kg, float distance_cutoff, float gridStep, int gridSquares, glm::vec3 position, std::vector<float> color, float y_value, float G_const, float min_dist, float deformation_scale, GLuint shader);
         void compute_vertices();
+        void compute_indices();
         void create_fabric();
-        void draw_fabric(std::vector<Body> bodies);
+        void update_fabric();
+        void draw_fabric(const BodyView& bodies);
+        void prepare_fabric(const BodyView& bodies);
+        void render_fabric();
+        void use_gpu_deformation(GLuint deformShader);
+        void update_body_buffer();
+        void compute_body_texels();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,82 @@
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+class TaskGraph {
+    /*
+    Tasks joined by dependencies, declared once and run as a whole any number of times, for instance once per frame
+
+    Every worker owns a deque of ready tasks. It runs its newest task first and, when its deque is
+    empty, steals the oldest task of another worker, so independent tasks spread over the threads
+    without any central queue. A finished task releases the tasks waiting on it into the deque of
+    the worker that finished it. A worker finding nothing to run or steal yields for a short while and
+    then sleeps until a task is released or the run ends, so idle workers leave the CPU to other
+    threads. The calling thread works as worker 0 and run returns once every task has finished. Tasks are kept as std::function, allocated when the graph is declared, while running
+    it never allocates
+
+    Args:
+    threads -> total number of threads including the caller, 0 or less uses every hardware thread
+    steals -> tasks taken from the deque of another worker, over every run
+    */
+    public:
+        std::atomic<long long> steals;
+
+        TaskGraph(int threads);
+        ~TaskGraph();
+        int size() const;
+        int add_task(std::function<void()> work);
+        void add_dependency(int task, int prerequisite);
+        void run();
+
+    private:
+        struct Task {
+            std::function<void()> work;
+            std::vector<int> successors;
+            int prerequisites;
+        };
+
+        // Ready tasks of one worker, pushed and popped at the tail by the owner and stolen from the head by
+        // the others. Every task enters one deque once per run, so the storage never wraps
+        struct WorkQueue {
+            std::mutex lock;
+            std::vector<int> tasks;
+            int head;
+            int tail;
+        };
+
+        std::vector<Task> tasks;
+        std::unique_ptr<std::atomic<int>[]> waiting;
+        int waiting_size;
+        std::vector<std::unique_ptr<WorkQueue>> queues;
+        std::atomic<int> remaining;
+
+        // Tasks in the deques, idle workers sleep on idle until there are some or the run has ended
+        std::atomic<int> ready;
+        std::mutex idle_mutex;
+        std::condition_variable idle;
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        int pending;
+        long generation;
+        bool stopping;
+
+        void worker_loop(int worker);
+        void work(int worker);
+        void push(int worker, int task);
+        bool pop(int worker, int& task);
+        bool steal(int worker, int& task);
+};
+
+#endif
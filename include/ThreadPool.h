@@ -0,0 +1,70 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class TaskRef {
+    /*
+    Non-owning reference to a loop body called as task(begin, end, worker)
+
+    Unlike std::function it never allocates, whatever the lambda captures, so parallel loops stay free of
+    heap traffic. The referenced callable must outlive the call it is passed to
+    */
+    public:
+        template <typename Task>
+        TaskRef(const Task& task) : object(&task), call(&TaskRef::invoke<Task>) {}
+
+        void operator()(int begin, int end, int worker) const {
+            this->call(this->object, begin, end, worker);
+        }
+
+    private:
+        const void* object;
+        void (*call)(const void* object, int begin, int end, int worker);
+
+        template <typename Task>
+        static void invoke(const void* object, int begin, int end, int worker) {
+            (*static_cast<const Task*>(object))(begin, end, worker);
+        }
+};
+
+class ThreadPool {
+    /*
+    Persistent pool of worker threads splitting loops into deterministic contiguous chunks
+
+    Worker k always receives the k-th of size() equal chunks, so per index results never depend on
+    scheduling. The calling thread runs chunk 0 itself, and parallel_for must not be nested.
+
+    Args:
+    threads -> total number of threads including the caller, 0 or less uses every hardware thread
+    */
+    public:
+        ThreadPool(int threads);
+        ~ThreadPool();
+        int size() const;
+        void parallel_for(int count, TaskRef task);
+
+    private:
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        const TaskRef* task;
+        int count;
+        int pending;
+        long generation;
+        bool stopping;
+
+        void worker_loop(int worker);
+        void run_chunk(int worker);
+};
+
+// Runs the task through the pool, or as a single chunk on the calling thread when there is no pool
+void parallel_for(ThreadPool* pool, int count, TaskRef task);
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "../include/BodySystem.h"
+
+// Layout version of trajectory files, bumped whenever a header field or the chunk encoding changes meaning
+const uint32_t trajectory_version = 1;
+
+enum TrajectoryCompression {
+    // Every value as a little-endian double
+    trajectory_raw = 0,
+    // Every value rounded to a multiple of the quantum, stored as a variable length integer
+    trajectory_quantized = 1,
+    // Quantized values stored as their change since the previous frame of the chunk
+    trajectory_delta = 2
+};
+
+// Compression named "raw", "quantized" or "delta", delta for any other name
+TrajectoryCompression trajectory_compression(const std::string name);
+
+struct TrajectoryHeader {
+    /*
+    Header at the start of both the trajectory file and its index, every field little-endian
+
+    Args:
+    magic -> "CHIROTRJ" for the trajectory and "CHIROTRI" for its index
+    version -> trajectory_version of the writer
+    columns -> 3 for x, y, z or 6 with vx, vy, vz after them
+    body_count -> bodies of every frame
+    quantum -> spacing of the quantized values, the error of a value is at most half of it
+    compression -> TrajectoryCompression of the chunks
+    chunk_frames -> most frames of a chunk
+    */
+    char magic[8];
+    uint32_t version;
+    uint32_t columns;
+    uint64_t body_count;
+    double quantum;
+    uint32_t compression;
+    uint32_t chunk_frames;
+};
+
+struct TrajectoryChunk {
+    /*
+    Index entry of one chunk of frames, appended to the index once the chunk is in the trajectory file
+
+    Args:
+    first_step, last_step -> steps of the first and last frame of the chunk
+    first_time, last_time -> simulated times of the first and last frame
+    first_frame -> number of frames stored before the chunk
+    offset, bytes -> position and length of the chunk in the trajectory file
+    frames -> frames of the chunk
+    compression -> TrajectoryCompression of the chunk
+    */
+    int64_t first_step;
+    int64_t last_step;
+    double first_time;
+    double last_time;
+    uint64_t first_frame;
+    uint64_t offset;
+    uint64_t bytes;
+    uint32_t frames;
+    uint32_t compression;
+};
+
+struct TrajectoryFrame {
+    // State of the bodies at one stored step, vx, vy and vz stay empty for trajectories of positions only
+    long step;
+    double sim_time;
+    std::vector<double> x, y, z;
+    std::vector<double> vx, vy, vz;
+};
+
+class TrajectoryWriter {
+    /*
+    Streams the bodies of every appended step into a chunked trajectory file on a background thread
+
+    append only copies the frame into the chunk being filled, and a full chunk is handed to the I/O
+    thread, which encodes it, writes it to the trajectory file and then appends its entry to the index
+    file filename + ".index", so a reader never sees an entry of a chunk not completely written. Every
+    chunk starts from absolute values, so it decodes on its own. Two chunk buffers are allocated up
+    front and recycled, so appending never allocates while the I/O thread keeps up, and append never
+    waits for the disk: a disk slower than the simulation lets the queued chunks grow instead
+
+    Args:
+    filename -> trajectory file, replaced if it exists
+    body_count -> bodies of every frame
+    compression -> encoding of the chunks
+    quantum -> spacing of quantized values in the units of the bodies
+    chunk_frames -> most frames of a chunk, fewer for large systems so a chunk stays below 32 MB
+    velocities -> whether velocities are stored besides positions
+    frames_written, bytes_written -> frames and bytes in the trajectory file so far
+    */
+    public:
+        std::atomic<long long> frames_written;
+        std::atomic<long long> bytes_written;
+
+        TrajectoryWriter(const std::string filename, int body_count, TrajectoryCompression compression = trajectory_delta,
+            double quantum = 1e-6, int chunk_frames = 64, bool velocities = true);
+        ~TrajectoryWriter();
+        TrajectoryWriter(const TrajectoryWriter&) = delete;
+        TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+        bool is_open() const;
+        void append(const BodyView& bodies, long step, double sim_time);
+        int pending_chunks();
+        void close();
+
+    private:
+        struct ChunkBuffer {
+            std::vector<int64_t> steps;
+            std::vector<double> times;
+            // Frame after frame, each the columns of every body one after another
+            std::vector<double> values;
+            int frames;
+        };
+
+        TrajectoryHeader header;
+        FILE* file;
+        FILE* index;
+        std::thread worker;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<ChunkBuffer*> queue;
+        std::vector<std::unique_ptr<ChunkBuffer>> buffers;
+        std::vector<ChunkBuffer*> free_buffers;
+        ChunkBuffer* current;
+        bool stopping;
+        bool failed;
+
+        // Owned by the I/O thread
+        std::vector<unsigned char> encoded;
+        std::vector<int64_t> previous;
+        uint64_t file_offset;
+        uint64_t frames_before;
+
+        ChunkBuffer* take_buffer();
+        void run();
+        void write_chunk(const ChunkBuffer& chunk);
+};
+
+class TrajectoryReader {
+    /*
+    Random access to the frames of a trajectory file through its index
+
+    Only the index is read on open. A frame is found by a binary search of the index, then its chunk
+    is read and decoded up to it. The last chunk read stays cached, so frames read in order decode
+    every chunk once
+
+    Args:
+    header -> header of the trajectory
+    chunks -> index entries of the complete chunks
+    */
+    public:
+        TrajectoryHeader header;
+        std::vector<TrajectoryChunk> chunks;
+
+        TrajectoryReader();
+        ~TrajectoryReader();
+        TrajectoryReader(const TrajectoryReader&) = delete;
+        TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+        bool open(const std::string filename);
+        void close();
+        long long frame_count() const;
+        bool read_frame(long long frame, TrajectoryFrame& result);
+        bool read_step(long step, TrajectoryFrame& result);
+
+    private:
+        FILE* file;
+        // Bytes of the cached chunk, the frame of it decoded last and where the next frame starts
+        std::vector<unsigned char> chunk_bytes;
+        int cached_chunk;
+        int decoded_frame;
+        size_t cursor;
+        std::vector<int64_t> previous;
+        std::vector<double> values;
+
+        bool load_chunk(int chunk);
+        bool decode_next();
+};
+
+#endif
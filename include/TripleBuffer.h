@@ -0,0 +1,56 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+
+template <typename T>
+class TripleBuffer {
+    /*
+    Lock-free handoff of the newest value from one writer thread to one reader thread
+
+    The writer fills write_buffer() and publishes it, the reader calls update() and then reads
+    read_buffer(). Each side owns one of the three slots outright and the third sits between them, so
+    neither ever waits for the other: the writer may publish any number of times between two updates
+    and the reader only ever sees the last one, and a slot being read is never written. Only the index
+    of the middle slot is shared, with a fresh bit marking a value the reader has not taken yet
+    */
+    public:
+        TripleBuffer() : back(0), middle(1), front(2) {}
+
+        T& write_buffer() {
+            return this->slots[this->back];
+        }
+
+        void publish() {
+            this->back = this->middle.exchange(this->back | fresh, std::memory_order_acq_rel) & index_mask;
+
+            return;
+        }
+
+        bool update() {
+            if (!(this->middle.load(std::memory_order_acquire) & fresh)) {
+                return false;
+            }
+
+            this->front = this->middle.exchange(this->front, std::memory_order_acq_rel) & index_mask;
+
+            return true;
+        }
+
+        const T& read_buffer() const {
+            return this->slots[this->front];
+        }
+
+    private:
+        static const int index_mask = 3;
+        static const int fresh = 4;
+
+        T slots[3];
+        int back;
+        std::atomic<int> middle;
+        int front;
+};
+
+#endif
@@ -1,17 +1,51 @@
 param (
-    [string]$build
+    [string]$build,
+    [Parameter(ValueFromRemainingArguments = $true)]
+    [string[]]$extraArgs
 )
 
 # $filename = "${filename}_gravity_test"
 $filename = "3D_gravity_sim"
 
+# Sources of the libchiro simulation core, built without any OpenGL dependency
+$coreFiles = @("BodySystem", "Simulation", "ThreadPool", "DirectSumKernel", "ForceSolver", "Octree", "BarnesHut", "FastMultipole", "ParticleMesh", "P3M", "Kepler", "Integrator", "FabricField", "FabricLod", "SimulationClock", "PhysicsThread", "TaskGraph", "Checkpoint", "Trajectory")
+
+function Build-Core {
+    if (-not (Test-Path "build/obj")) {
+        mkdir "build/obj" | Out-Null
+    }
+
+    $objects = @()
+    foreach ($coreFile in $coreFiles) {
+        g++ -O2 -c "src/$coreFile.cpp" -o "build/obj/$coreFile.o" -I "include"
+        if ($LASTEXITCODE -ne 0) {
+            return $false
+        }
+        $objects += "build/obj/$coreFile.o"
+    }
+
+    if (Test-Path "build/libchiro.a") {
+        Remove-Item "build/libchiro.a"
+    }
+    ar rcs "build/libchiro.a" $objects
+    g++ -O2 "src/headless_sim.cpp" -o "build/headless_sim.exe" -I "include" -L "build" -lchiro -pthread
+    if ($LASTEXITCODE -ne 0) {
+        return $false
+    }
+    g++ -O2 "src/benchmarks.cpp" -o "build/benchmarks.exe" -I "include" -L "build" -lchiro -pthread
+
+    return ($LASTEXITCODE -eq 0)
+}
+
 if (Test-Path "src/$filename.cpp") {
     switch ($build) {
         "build" {
-            if (-not (Test-Path "build")) {
-                mkdir "build"
+            if (Build-Core) {
+                g++ -O2 "src/$filename.cpp" "src/Models.cpp" "src/SpaceTimeFabric.cpp" "src/GpuResources.cpp" "src/glad.c" -o "build/$filename.exe" -I "include" -L "build" -L "lib" -lchiro -lglew32 -lglfw3 -lopengl32 -lgdi32
             }
-            g++ "src/$filename.cpp" "src/Models.cpp" "src/SpaceTimeFabric.cpp" "src/glad.c" -o "build/$filename.exe" -I "include" -L "lib" -lglew32 -lglfw3 -lopengl32 -lgdi32
+        }
+        "build-core" {
+            Build-Core | Out-Null
         }
         "run" {
             try {
@@ -21,8 +55,14 @@ if (Test-Path "src/$filename.cpp") {
                 Write-Output "Failed to run: Try building again before running"
             }
         }
+        "headless" {
+            & "build/headless_sim.exe" @extraArgs
+        }
+        "bench" {
+            & "build/benchmarks.exe" @extraArgs
+        }
         default {
-            Write-Output "ValueError: Second argument should only be 'build' or 'run'"
+            Write-Output "ValueError: Second argument should only be 'build', 'build-core', 'run', 'headless' or 'bench'"
         }
     }
 } else {
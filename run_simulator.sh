@@ -4,23 +4,54 @@
 filename=3D_gravity_sim
 build=$1
 
+# Sources of the libchiro simulation core, built without any OpenGL dependency
+core_files="BodySystem Simulation ThreadPool DirectSumKernel ForceSolver Octree BarnesHut FastMultipole ParticleMesh P3M Kepler Integrator FabricField FabricLod SimulationClock PhysicsThread TaskGraph Checkpoint Trajectory"
+
+build_core() {
+    if [ ! -e "build/obj" ]
+    then
+        mkdir -p "build/obj"
+    fi
+
+    objects=""
+    for core_file in $core_files
+    do
+        g++ -O2 -c src/$core_file.cpp -o build/obj/$core_file.o -I include || return 1
+        objects="$objects build/obj/$core_file.o"
+    done
+
+    rm -f build/libchiro.a
+    ar rcs build/libchiro.a $objects || return 1
+    g++ -O2 src/headless_sim.cpp -o build/headless_sim.exe -I include -L build -lchiro -pthread || return 1
+    g++ -O2 src/benchmarks.cpp -o build/benchmarks.exe -I include -L build -lchiro -pthread
+}
+
 if [ -e "src/$filename.cpp" ]
 then
     case $build in
     "build")
-        if [ ! -e "build" ]
-        then
-            mkdir "build"
-        fi
-        g++ src/$filename.cpp src/Models.cpp src/SpaceTimeFabric.cpp src/glad.c -o build/$filename.exe -I include -L lib -lglew32 -lglfw3 -lopengl32 -lgdi32
+        build_core || exit 1
+        g++ -O2 src/$filename.cpp src/Models.cpp src/SpaceTimeFabric.cpp src/GpuResources.cpp src/glad.c -o build/$filename.exe -I include -L build -L lib -lchiro -lglew32 -lglfw3 -lopengl32 -lgdi32
+        ;;
+
+    "build-core")
+        build_core
         ;;
 
     "run")
         ./build/$filename.exe
         ;;
 
+    "headless")
+        ./build/headless_sim.exe "${@:2}"
+        ;;
+
+    "bench")
+        ./build/benchmarks.exe "${@:2}"
+        ;;
+
     *)
-        echo "ValueError: Second argument should only be 'build' or 'run'"
+        echo "ValueError: Second argument should only be 'build', 'build-core', 'run', 'headless' or 'bench'"
         ;;
     esac
 else
@@ -12,8 +12,16 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "../include/BodySystem.h"
+#include "../include/Simulation.h"
+#include "../include/SimulationClock.h"
+#include "../include/PhysicsThread.h"
+#include "../include/ParticleMesh.h"
+#include "../include/ThreadPool.h"
+#include "../include/TaskGraph.h"
 #include "../include/Models.h"
 #include "../include/SpaceTimeFabric.h"
+#include "../include/GpuResources.h"
 
 
 // Configurations gathering from Configurations.json file
@@ -36,6 +44,17 @@ struct Config {
     float min_dist;
     float deformation_scale;
     float time_step;
+    float fabric_tolerance;
+    std::string fabric_mode;
+    int fabric_lod_vertices;
+    float fabric_lod_camera_weight;
+    float physics_rate;
+    float time_warp;
+    int max_substeps;
+    float physics_budget;
+    bool paused;
+    int fabric_threads;
+    int frame_threads;
 } configs;
 
 // Global variables at start of program
@@ -69,16 +88,64 @@ const char* fragmentShaderScript = R"glsl(
     }
 )glsl";
 
+// The flat fabric displaced by the field of the bodies, read as x, y, z, mass texels, the same sum as FabricField
+const char* fabricVertexShaderScript = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec3 Posn;
+    uniform mat4 Model;
+    uniform mat4 View;
+    uniform mat4 Perspective;
+    uniform samplerBuffer Bodies;
+    uniform int BodyCount;
+    uniform float G_const;
+    uniform float MinDist2;
+    uniform float Cutoff2;
+    uniform float DeformationScale;
+    void main() {
+        float field = 0.0;
+        for (int b = 0; b < BodyCount; b++) {
+            vec4 body = texelFetch(Bodies, b);
+            vec3 separation = body.xyz - vec3(Posn.x, 0.0, Posn.z);
+            float distance2 = max(dot(separation, separation), MinDist2);
+            if (distance2 <= Cutoff2) {
+                field += body.w / distance2;
+            }
+        }
+        gl_Position = Perspective * View * Model * vec4(Posn.x, Posn.y - G_const * field * DeformationScale, Posn.z, 1.0);
+    }
+)glsl";
+
+// Every body is an instance of the unit sphere, scaled by its radius and moved to its center
+const char* bodyVertexShaderScript = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec3 Posn;
+    layout (location = 1) in vec4 CenterRadius;
+    layout (location = 2) in vec4 BodyColor;
+    uniform mat4 View;
+    uniform mat4 Perspective;
+    out vec4 bodyColor;
+    void main() {
+        bodyColor = BodyColor;
+        gl_Position = Perspective * View * vec4(Posn * CenterRadius.w + CenterRadius.xyz, 1.0);
+    }
+)glsl";
+
+const char* bodyFragmentShaderScript = R"glsl(
+    #version 330 core
+    in vec4 bodyColor;
+    out vec4 FragColor;
+    void main() {
+        FragColor = bodyColor;
+    }
+)glsl";
+
 void processWindowCloseInput(GLFWwindow* window);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void keyCallBack(GLFWwindow* window, int key, int scancode, int action, int mods);
 
-void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
+void framebuffer_size_callback(GLFWwindow*, int width, int height) {
+    // The projection keeps the aspect ratio the window was opened with, only the viewport follows it
     glViewport(0, 0, width, height);
-    float aspectRatio = (float)width / (float)height;
-
-    // Update projection matrix
-    glm::mat4 Perspective = glm::perspective(glm::radians(configs.FoV), aspectRatio, configs.nearClippingVal, configs.farClippingVal);
 
     return;
 }
@@ -91,7 +158,7 @@ void processWindowCloseInput(GLFWwindow* window) {
     return;
 }
 
-void keyCallBack(GLFWwindow* window, int key, int scancode, int action, int mods) {
+void keyCallBack(GLFWwindow* window, int key, int, int action, int) {
 
     // Update cameraPosn View
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
@@ -113,10 +180,23 @@ void keyCallBack(GLFWwindow* window, int key, int scancode, int action, int mods
         configs.cameraPosn -= configs.cameraSpeed * glm::normalize(glm::cross(glm::cross(configs.cameraFront, configs.upVector), configs.cameraFront));
     }
 
+    // Time warp, ] doubles and [ halves the simulated speed and P pauses it
+    if (action == GLFW_PRESS && key == GLFW_KEY_RIGHT_BRACKET) {
+        configs.time_warp *= 2.0f;
+        printf("Time warp x%g\n", configs.time_warp);
+    }
+    if (action == GLFW_PRESS && key == GLFW_KEY_LEFT_BRACKET) {
+        configs.time_warp *= 0.5f;
+        printf("Time warp x%g\n", configs.time_warp);
+    }
+    if (action == GLFW_PRESS && key == GLFW_KEY_P) {
+        configs.paused = !configs.paused;
+    }
+
     return;
 }
 
-void mouseCallback(GLFWwindow* window, double mouse_x, double mouse_y) {
+void mouseCallback(GLFWwindow*, double mouse_x, double mouse_y) {
     // When program starts, capture x and y for the first time
     if (mouseInit) {
         last_x = mouse_x;
@@ -176,37 +256,92 @@ void loadConfigs(const std::string filename) {
     configs.min_dist = json_file["min_dist"];
     configs.deformation_scale = json_file["deformation_scale"];
     configs.time_step = json_file["time_step"];
+    configs.fabric_tolerance = json_file.value("fabric_tolerance", 0.05);
+    configs.fabric_mode = json_file.value("fabric_mode", std::string("incremental"));
+    configs.fabric_lod_vertices = json_file.value("fabric_lod_vertices", 10000);
+    configs.fabric_lod_camera_weight = json_file.value("fabric_lod_camera_weight", 0.001);
+    configs.physics_rate = json_file.value("physics_rate", 60.0);
+    configs.time_warp = json_file.value("time_warp", 1.0);
+    configs.max_substeps = json_file.value("max_substeps", 8);
+    configs.physics_budget = json_file.value("physics_budget", 0.012);
+    configs.paused = false;
+    configs.fabric_threads = json_file.value("fabric_threads", 2);
+    configs.frame_threads = json_file.value("frame_threads", 2);
 
     return;
 }
 
-std::vector<Body> InitializeModels(GLuint shader) {
+GLuint CreateShaderProgram(const char* vertexScript, const char* fragmentScript) {
+    // Loading and linking shaders
+    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &vertexScript, NULL);
+    glCompileShader(vertexShader);
+
+    int success;
+    char infoLog[512];
+    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
+        printf("Vertex Shader Compilation Failed: %s \n", infoLog);
+    }
+
+    GLuint fragShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragShader, 1, &fragmentScript, NULL);
+    glCompileShader(fragShader);
+
+    glGetShaderiv(fragShader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(fragShader, 512, NULL, infoLog);
+        printf("Fragment Shader Compilation Failed: %s \n", infoLog);
+    }
+
+    GLuint shader = glCreateProgram();
+    glAttachShader(shader, vertexShader);
+    glAttachShader(shader, fragShader);
+    glLinkProgram(shader);
+
+    // Deleting shaders after linking
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragShader);
+
+    return shader;
+}
+
+Simulation InitializeSimulation() {
+    SimulationConfig sim_configs = load_simulation_config("data/Configurations.json");
+    BodySystem system("data/BodiesData.json", sim_configs.E_val_km, sim_configs.E_val_kg);
+
+    Simulation simulation(system, sim_configs);
+
+    return simulation;
+}
+
+Bodies InitializeModels(const BodySystem& system, GLuint shader) {
     
-    Bodies bodies("data/BodiesData.json", configs.E_val_km, configs.E_val_kg, shader, configs.time_step);
+    Bodies bodies(system, shader);
 
-    return bodies.get_bodies();
+    return bodies;
 }
 
-Fabric InitializeGrid(std::vector<Body> bodies_list, GLuint shader) {
+Fabric InitializeGrid(const BodyView& bodies_list, GLuint shader) {
 
     Fabric grid(bodies_list, configs.E_val_km, configs.E_val_kg, configs.distance_cutoff, configs.gridStep, configs.gridSquares, glm::vec3(0.0f, configs.y_grid, 0.0f), {1.0f, 1.0f, 1.0f, 1.0f}, configs.y_grid, configs.G_const, configs.min_dist, configs.deformation_scale, shader);
 
     return grid;
 }
 
-void DrawModels(std::vector<Body>& bodies) {
-    int size = bodies.size();
-    
-    for (int idx = 0; idx < size; idx++) {
-        bodies[idx].update_body(bodies, size, configs.G_const);
-        bodies[idx].draw_body();
-    }
+void DrawModels(Bodies& bodies) {
+    // One instance buffer update and one draw call for every body, the instances were computed by the frame graph
+    bodies.upload_instances();
+    bodies.draw_bodies();
 
     return;
 }
 
-void DrawGrid(Fabric grid, std::vector<Body>& bodies) {
-    grid.draw_fabric(bodies);
+void DrawGrid(Fabric& grid) {
+    grid.render_fabric();
 
     return;
 }
@@ -246,83 +381,164 @@ int main() {
     // In case of window resizing, change Viewport size
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-    // Loading and linking shaders
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderScript, NULL);
-    glCompileShader(vertexShader);
-
-    int success;
-    char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        printf("Vertex Shader Compilation Failed: %s \n", infoLog);
-    }
-
-    GLuint fragShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragShader, 1, &fragmentShaderScript, NULL);
-    glCompileShader(fragShader);
+    // Loading and linking shaders, the bodies use their own instanced program and the fabric its deforming one
+    GLuint shader = CreateShaderProgram(vertexShaderScript, fragmentShaderScript);
+    GLuint bodyShader = CreateShaderProgram(bodyVertexShaderScript, bodyFragmentShaderScript);
+    GLuint fabricShader = CreateShaderProgram(fabricVertexShaderScript, fragmentShaderScript);
 
-    int success2;
-    glGetShaderiv(fragShader, GL_COMPILE_STATUS, &success2);
-    if (!success)
+    // GPU objects of the models are released when this scope closes, while the context still exists
     {
-        glGetShaderInfoLog(fragShader, 512, NULL, infoLog);
-        printf("Fragment Shader Compilation Failed: %s \n", infoLog);
-    }
-
-    GLuint shader = glCreateProgram();
-    glAttachShader(shader, vertexShader);
-    glAttachShader(shader, fragShader);
-    glLinkProgram(shader);
-
-    // Deleting shaders after linking
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragShader);
-
-    // Initializing Models and Space Time Fabric Grid
-    // std::vector<Body> bodies = InitializeModels(shader);
-    std::vector<Body> bodies = InitializeModels(shader);
-    Fabric grid = InitializeGrid(bodies, shader);
-
-    // Using shader program
-    glUseProgram(shader);
-    glEnable(GL_DEPTH_TEST);
-
-    // Transformation matrices involved in 3D
-    glm::mat4 View = glm::lookAt(configs.cameraPosn, configs.cameraPosn + configs.cameraFront, configs.upVector);
-    glm::mat4 Perspective = glm::perspective(glm::radians(configs.FoV), aspectRatio, configs.nearClippingVal, configs.farClippingVal);
-
-    glUniformMatrix4fv(glGetUniformLocation(shader, "View"), 1, GL_FALSE, glm::value_ptr(View));
-    glUniformMatrix4fv(glGetUniformLocation(shader, "Perspective"), 1, GL_FALSE, glm::value_ptr(Perspective));
-
-    glfwSetKeyCallback(window, keyCallBack);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    glfwSetCursorPosCallback(window, mouseCallback);
-
-    // Render Loop
-    while(!glfwWindowShouldClose(window)) {
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        glfwSetCursorPosCallback(window, mouseCallback);
-        glfwSetKeyCallback(window, keyCallBack);
-
-        processWindowCloseInput(window);
+        // Initializing Simulation, Models and Space Time Fabric Grid
+        Simulation simulation = InitializeSimulation();
+        Bodies bodies = InitializeModels(simulation.system, bodyShader);
+        Fabric grid = InitializeGrid(simulation.bodies(), shader);
+
+        // A Particle-Mesh solver also convolves its mesh with the fabric's kernel, so the fabric reads the
+        // same field from it where it covers the nodes
+        ParticleMeshSolver* mesh = dynamic_cast<ParticleMeshSolver*>(simulation.solver.get());
+        if (mesh != nullptr) {
+            mesh->fabric_min_dist = configs.min_dist;
+            mesh->fabric_cutoff = configs.distance_cutoff;
+        }
+
+        // The simulation moves onto its own thread, paced in fixed steps by wall-clock time. Its pool and
+        // solver go with it, so the fabric gets threads of its own and a copy of the mesh plane with every snapshot
+        PhysicsThread physics(std::move(simulation), SimulationClock(configs.physics_rate, configs.time_warp, configs.max_substeps, configs.physics_budget));
+        ThreadPool fabricPool(configs.fabric_threads);
+
+        grid.field.pool = &fabricPool;
+        grid.field.tolerance = configs.fabric_tolerance * configs.gridStep;
+        grid.lod.pool = &fabricPool;
+
+        // "incremental" redraws the uniform grid where bodies moved, "lod" rebuilds a quadtree every frame and
+        // "gpu" deforms the uniform grid in its vertex shader
+        if (configs.fabric_mode == "lod") {
+            grid.lod.max_vertices = configs.fabric_lod_vertices;
+            grid.lod.camera_weight = configs.fabric_lod_camera_weight;
+        }
+        else if (configs.fabric_mode == "gpu") {
+            grid.use_gpu_deformation(fabricShader);
+        }
+        else if (configs.fabric_mode != "incremental") {
+            printf("Unknown fabric_mode \"%s\", using the incremental uniform grid\n", configs.fabric_mode.c_str());
+        }
+
+        // Using shader program
         glUseProgram(shader);
+        glEnable(GL_DEPTH_TEST);
 
+        // Transformation matrices involved in 3D
         glm::mat4 View = glm::lookAt(configs.cameraPosn, configs.cameraPosn + configs.cameraFront, configs.upVector);
+        glm::mat4 Perspective = glm::perspective(glm::radians(configs.FoV), aspectRatio, configs.nearClippingVal, configs.farClippingVal);
+
         glUniformMatrix4fv(glGetUniformLocation(shader, "View"), 1, GL_FALSE, glm::value_ptr(View));
         glUniformMatrix4fv(glGetUniformLocation(shader, "Perspective"), 1, GL_FALSE, glm::value_ptr(Perspective));
 
-        // Drawing Models
-        DrawModels(bodies);
-        DrawGrid(grid, bodies);
+        glfwSetKeyCallback(window, keyCallBack);
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        glfwSetCursorPosCallback(window, mouseCallback);
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        report_gpu_resources("start");
+        bool reportPressed = false;
+
+        // The CPU side of a frame, taking the newest snapshot and then building the fabric, the body instances
+        // and the diagnostics from it side by side. OpenGL calls stay on this thread, after the graph has run
+        TaskGraph frameGraph(configs.frame_threads);
+        BodyView frameBodies;
+        double kineticEnergy = 0.0;
+        double momentum[3] = {0.0, 0.0, 0.0};
+        double simTime = 0.0;
+        double stepRate = 0.0;
+
+        int snapshotTask = frameGraph.add_task([&]() {
+            // The newest snapshot of the physics thread, blended between its last two steps, never waiting for a step to finish
+            physics.time_warp = configs.time_warp;
+            physics.paused = configs.paused;
+            frameBodies = physics.bodies();
+
+            const FabricMeshSlice& fabricMesh = physics.snapshot().fabric_mesh;
+            grid.field.mesh = fabricMesh.valid ? &fabricMesh : nullptr;
+        });
+        int fabricTask = frameGraph.add_task([&]() {
+            grid.cameraPosition = configs.cameraPosn;
+            grid.prepare_fabric(frameBodies);
+        });
+        int instancesTask = frameGraph.add_task([&]() {
+            bodies.compute_instances(frameBodies);
+        });
+        int diagnosticsTask = frameGraph.add_task([&]() {
+            const BodySnapshot& snapshot = physics.snapshot();
+            simTime = snapshot.sim_time;
+            stepRate = snapshot.step_rate;
+
+            kineticEnergy = 0.0;
+            momentum[0] = momentum[1] = momentum[2] = 0.0;
+            for (int i = 0; i < frameBodies.size(); i++) {
+                kineticEnergy += 0.5 * frameBodies.mass[i] * (frameBodies.vx[i] * frameBodies.vx[i] + frameBodies.vy[i] * frameBodies.vy[i] + frameBodies.vz[i] * frameBodies.vz[i]);
+                momentum[0] += frameBodies.mass[i] * frameBodies.vx[i];
+                momentum[1] += frameBodies.mass[i] * frameBodies.vy[i];
+                momentum[2] += frameBodies.mass[i] * frameBodies.vz[i];
+            }
+        });
+        frameGraph.add_dependency(fabricTask, snapshotTask);
+        frameGraph.add_dependency(instancesTask, snapshotTask);
+        frameGraph.add_dependency(diagnosticsTask, snapshotTask);
+
+        char windowTitle[256];
+        double titleUpdated = 0.0;
+
+        physics.start();
+
+        // Render Loop, press G to report the live GPU buffers
+        while(!glfwWindowShouldClose(window)) {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            glfwSetCursorPosCallback(window, mouseCallback);
+            glfwSetKeyCallback(window, keyCallBack);
+
+            processWindowCloseInput(window);
+            glUseProgram(shader);
+
+            glm::mat4 View = glm::lookAt(configs.cameraPosn, configs.cameraPosn + configs.cameraFront, configs.upVector);
+            glUniformMatrix4fv(glGetUniformLocation(shader, "View"), 1, GL_FALSE, glm::value_ptr(View));
+            glUniformMatrix4fv(glGetUniformLocation(shader, "Perspective"), 1, GL_FALSE, glm::value_ptr(Perspective));
+
+            glUseProgram(bodyShader);
+            glUniformMatrix4fv(glGetUniformLocation(bodyShader, "View"), 1, GL_FALSE, glm::value_ptr(View));
+            glUniformMatrix4fv(glGetUniformLocation(bodyShader, "Perspective"), 1, GL_FALSE, glm::value_ptr(Perspective));
+
+            glUseProgram(fabricShader);
+            glUniformMatrix4fv(glGetUniformLocation(fabricShader, "View"), 1, GL_FALSE, glm::value_ptr(View));
+            glUniformMatrix4fv(glGetUniformLocation(fabricShader, "Perspective"), 1, GL_FALSE, glm::value_ptr(Perspective));
+
+            frameGraph.run();
+
+            // The diagnostics reach the window title twice a second, often enough to follow and cheap to set
+            if (glfwGetTime() - titleUpdated >= 0.5) {
+                snprintf(windowTitle, sizeof(windowTitle), "3D Gravity Simulator - t = %.3g, %.0f steps/s, kinetic energy %.4g, momentum (%.3g, %.3g, %.3g)",
+                    simTime, stepRate, kineticEnergy, momentum[0], momentum[1], momentum[2]);
+                glfwSetWindowTitle(window, windowTitle);
+                titleUpdated = glfwGetTime();
+            }
+
+            // Drawing Models
+            DrawModels(bodies);
+            DrawGrid(grid);
+
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+
+            if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS && !reportPressed) {
+                report_gpu_resources("frame");
+            }
+            reportPressed = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+        }
+
+        physics.stop();
     }
 
+    report_gpu_resources("exit");
+
     glfwTerminate();
     return 0;
 }
\ No newline at end of file
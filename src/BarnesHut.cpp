@@ -0,0 +1,142 @@
+#include "../include/BarnesHut.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <cmath>
+
+#include "../include/BodySystem.h"
+#include "../include/ForceSolver.h"
+#include "../include/DirectSumKernel.h"
+#include "../include/Octree.h"
+#include "../include/ThreadPool.h"
+
+BarnesHutSolver::BarnesHutSolver(float opening_angle, int leaf_size) {
+    this->opening_angle = opening_angle;
+    this->tree = Octree(leaf_size);
+}
+
+const char* BarnesHutSolver::name() const {
+    return "barnes_hut";
+}
+
+void BarnesHutSolver::accelerate_body(const BodySystem& system, int idx, double G_const, double eps2, double gravity[3]) {
+    double position[3] = {system.x[idx], system.y[idx], system.z[idx]};
+    double theta = this->opening_angle;
+
+    // Explicit stack of cells still to visit, deep enough for 7 pending siblings on every level
+    int stack[8 * (max_tree_depth + 2)];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const OctreeNode& cell = this->tree.nodes[stack[--top]];
+
+        if (cell.mass <= 0.0) {
+            continue;
+        }
+
+        double R[3] = {cell.com[0] - position[0], cell.com[1] - position[1], cell.com[2] - position[2]};
+        double R2 = R[0] * R[0] + R[1] * R[1] + R[2] * R[2];
+
+        bool inside = std::fabs(position[0] - cell.center[0]) <= cell.half_size && std::fabs(position[1] - cell.center[1]) <= cell.half_size && std::fabs(position[2] - cell.center[2]) <= cell.half_size;
+        double open_radius = (theta > 0.0) ? 2.0 * cell.half_size / theta + cell.com_offset : -1.0;
+
+        if (!inside && theta > 0.0 && R2 > open_radius * open_radius) {
+            double R_inv = 1.0 / std::sqrt(R2 + eps2);
+            double gravity_total = G_const * cell.mass * R_inv * R_inv * R_inv;
+
+            gravity[0] += gravity_total * R[0];
+            gravity[1] += gravity_total * R[1];
+            gravity[2] += gravity_total * R[2];
+        }
+        else if (cell.first_child == -1) {
+            for (int k = cell.begin; k < cell.end; k++) {
+                int body = this->tree.order[k];
+
+                if (body == idx) {
+                    continue;
+                }
+
+                double R[3] = {system.x[body] - position[0], system.y[body] - position[1], system.z[body] - position[2]};
+                double R2 = R[0] * R[0] + R[1] * R[1] + R[2] * R[2] + eps2;
+
+                // Distinct bodies at the same position contribute no force, as in the direct kernel
+                if (R2 <= min_kernel_r2) {
+                    continue;
+                }
+
+                double R_inv = 1.0 / std::sqrt(R2);
+                double gravity_total = G_const * system.mass[body] * R_inv * R_inv * R_inv;
+
+                gravity[0] += gravity_total * R[0];
+                gravity[1] += gravity_total * R[1];
+                gravity[2] += gravity_total * R[2];
+            }
+        }
+        else {
+            for (int octant = 0; octant < 8; octant++) {
+                stack[top++] = cell.first_child + octant;
+            }
+        }
+    }
+
+    return;
+}
+
+void BarnesHutSolver::compute_accelerations(const BodySystem& system, double G_const, double softening, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az) {
+    int size = system.size();
+    double eps2 = softening * softening;
+
+    ax.assign(size, 0.0);
+    ay.assign(size, 0.0);
+    az.assign(size, 0.0);
+
+    if (size == 0) {
+        return;
+    }
+
+    this->tree.build(system);
+
+    parallel_for(this->pool, size, [&](int begin, int end, int) {
+        for (int i = begin; i < end; i++) {
+            double gravity[3] = {0.0, 0.0, 0.0};
+            this->accelerate_body(system, i, G_const, eps2, gravity);
+
+            ax[i] = gravity[0];
+            ay[i] = gravity[1];
+            az[i] = gravity[2];
+        }
+    });
+
+    return;
+}
+
+int BarnesHutSolver::compute_target_accelerations(const BodySystem& system, double G_const, double softening, const std::vector<int>& targets, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az) {
+    int size = system.size();
+    double eps2 = softening * softening;
+
+    ax.resize(size);
+    ay.resize(size);
+    az.resize(size);
+
+    if (targets.empty()) {
+        return 0;
+    }
+
+    // Every body is a source, so the whole tree is still rebuilt, but only the targets walk it
+    this->tree.build(system);
+
+    parallel_for(this->pool, targets.size(), [&](int begin, int end, int) {
+        for (int k = begin; k < end; k++) {
+            int i = targets[k];
+            double gravity[3] = {0.0, 0.0, 0.0};
+            this->accelerate_body(system, i, G_const, eps2, gravity);
+
+            ax[i] = gravity[0];
+            ay[i] = gravity[1];
+            az[i] = gravity[2];
+        }
+    });
+
+    return targets.size();
+}
@@ -0,0 +1,127 @@
+#include "../include/BodySystem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../include/json.hpp"
+#include <fstream>
+#include <string>
+
+BodySystem::BodySystem() {
+    this->E_val_km = 1.0f;
+    this->E_val_kg = 1.0f;
+}
+
+BodySystem::BodySystem(const std::string filename, float E_val_km, float E_val_kg) {
+    // Power of 10 value of measurement in km and kg
+    this->E_val_km = E_val_km;
+    this->E_val_kg = E_val_kg;
+
+    std::ifstream inFile(filename);
+    nlohmann::json json_file;
+    inFile >> json_file;
+
+    double diameter;
+
+    std::string name;
+    double mass;
+    std::vector<std::string> stars_name;
+    std::vector<int> stars_index;
+    double init_distance_x;
+    double init_distance_z;
+    double init_velocity[3];
+    std::vector<float> color;
+    std::string system;
+
+    // Every body starts in the y = 0 plane, so the 3D forces between them keep it there unless it is given a y velocity
+    for (auto& star : json_file["stars"]) {
+        name = star["name"];
+        mass = double(star["mass (kg)"]) / this->E_val_kg;
+        diameter = double(star["diameter (km)"]) / this->E_val_km;
+        color = {star["color"][0], star["color"][1], star["color"][2], star["color"][3]};
+        init_distance_x = double(star["center position (km)"][0]) / this->E_val_km;
+        init_distance_z = double(star["center position (km)"][1]) / this->E_val_km;
+
+        for (int axis = 0; axis < 3; axis++) {
+            init_velocity[axis] = double(star["init_velocity (km/s)"][axis]) / this->E_val_km;
+        }
+
+        stars_name.push_back(name);
+        stars_index.push_back(this->add_body(name, mass, diameter, init_distance_x, 0.0, init_distance_z, init_velocity[0], init_velocity[1], init_velocity[2], color, -1));
+    }
+
+    for (auto& planet : json_file["planets"]) {
+        name = planet["name"];
+        mass = double(planet["mass (kg)"]) / this->E_val_kg;
+        diameter = double(planet["diameter (km)"]) / this->E_val_km;
+        init_distance_x = double(planet["init_distance (km)"]) / this->E_val_km;
+        init_distance_z = 0;
+        color = {planet["color"][0], planet["color"][1], planet["color"][2], planet["color"][3]};
+        system = planet["system"];
+
+        for (int axis = 0; axis < 3; axis++) {
+            init_velocity[axis] = double(planet["init_velocity (km/s)"][axis]) / this->E_val_km;
+        }
+
+        int temp_i = this->find_body_index(stars_name, system);
+        int host = -1;
+
+        // Planet distances are given relative to the star of its system
+        if (temp_i != -1) {
+            host = stars_index[temp_i];
+            init_distance_x += this->x[host];
+            init_distance_z += this->z[host];
+        }
+
+        this->add_body(name, mass, diameter, init_distance_x, 0.0, init_distance_z, init_velocity[0], init_velocity[1], init_velocity[2], color, host);
+    }
+}
+
+int BodySystem::size() const {
+    return this->x.size();
+}
+
+BodyView BodySystem::view() const {
+    BodyView view;
+
+    view.x = this->x.data();
+    view.y = this->y.data();
+    view.z = this->z.data();
+    view.vx = this->vx.data();
+    view.vy = this->vy.data();
+    view.vz = this->vz.data();
+    view.mass = this->mass.data();
+    view.diameter = this->diameter.data();
+    view.host = this->host.data();
+    view.count = this->size();
+
+    return view;
+}
+
+int BodySystem::add_body(std::string name, double mass, double diameter, double x, double y, double z, double vx, double vy, double vz, std::vector<float> color, int host) {
+    this->names.push_back(name);
+    this->mass.push_back(mass);
+    this->diameter.push_back(diameter);
+    this->x.push_back(x);
+    this->y.push_back(y);
+    this->z.push_back(z);
+    this->vx.push_back(vx);
+    this->vy.push_back(vy);
+    this->vz.push_back(vz);
+    this->color.push_back(color);
+    this->host.push_back(host);
+
+    return this->size() - 1;
+}
+
+int BodySystem::find_body_index(std::vector<std::string> body_names, std::string name) {
+    int size = body_names.size();
+
+    for (int i = 0; i < size; i++) {
+
+        if (body_names[i] == name) {
+            return i;
+        }
+    }
+
+    return -1;
+}
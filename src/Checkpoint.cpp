@@ -0,0 +1,462 @@
+#include "../include/Checkpoint.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "../include/BodySystem.h"
+#include "../include/Simulation.h"
+#include "../include/Integrator.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(CheckpointHeader) == 128, "checkpoint header must have no padding");
+static_assert(sizeof(CheckpointSection) == 32, "checkpoint sections must have no padding");
+static_assert(sizeof(int) == 4, "host indices are stored as int32");
+
+// Columns start on cache line boundaries of the file, so mapped columns are aligned for any vector load
+const uint64_t checkpoint_alignment = 64;
+
+static const char* double_columns[11] = {"x", "y", "z", "vx", "vy", "vz", "mass", "diameter", "ax", "ay", "az"};
+
+static bool host_little_endian() {
+    uint16_t probe = 1;
+    return *(unsigned char*)&probe == 1;
+}
+
+static uint64_t align_offset(uint64_t offset) {
+    return (offset + checkpoint_alignment - 1) / checkpoint_alignment * checkpoint_alignment;
+}
+
+bool save_checkpoint(const Simulation& simulation, const std::string filename) {
+    if (!host_little_endian()) {
+        printf("Checkpoints are little-endian and can not be written on this host\n");
+        return false;
+    }
+
+    const BodySystem& system = simulation.system;
+    uint64_t size = system.size();
+
+    // Names and colors are the only columns not stored contiguously by the system
+    std::vector<uint64_t> name_offsets(size + 1, 0);
+    std::string names;
+    std::vector<float> colors(size * 4, 0.0f);
+
+    for (uint64_t idx = 0; idx < size; idx++) {
+        names += system.names[idx];
+        name_offsets[idx + 1] = names.size();
+
+        for (int channel = 0; channel < 4 && channel < (int)system.color[idx].size(); channel++) {
+            colors[idx * 4 + channel] = system.color[idx][channel];
+        }
+    }
+
+    int state_columns = simulation.integrator->state_columns();
+    std::vector<std::vector<double>> state(state_columns, std::vector<double>(size));
+    for (int column = 0; column < state_columns; column++) {
+        simulation.integrator->save_state(column, state[column].data());
+    }
+
+    const std::vector<double>* doubles[11] = {&system.x, &system.y, &system.z, &system.vx, &system.vy, &system.vz,
+        &system.mass, &system.diameter, &simulation.ax, &simulation.ay, &simulation.az};
+
+    std::vector<CheckpointSection> sections;
+    std::vector<const void*> contents;
+
+    auto add_section = [&](const std::string name, const void* content, uint64_t bytes) {
+        CheckpointSection section;
+        memset(&section, 0, sizeof(section));
+        strncpy(section.name, name.c_str(), sizeof(section.name) - 1);
+        section.bytes = bytes;
+
+        sections.push_back(section);
+        contents.push_back(content);
+    };
+
+    for (int column = 0; column < 11; column++) {
+        // Accelerations are only sized once the simulation evaluated them
+        const void* content = (doubles[column]->size() == size) ? doubles[column]->data() : nullptr;
+        add_section(double_columns[column], content, size * sizeof(double));
+    }
+    add_section("host", system.host.data(), size * sizeof(int));
+    add_section("color", colors.data(), colors.size() * sizeof(float));
+    add_section("name_offsets", name_offsets.data(), name_offsets.size() * sizeof(uint64_t));
+    add_section("names", names.data(), names.size());
+    for (int column = 0; column < state_columns; column++) {
+        add_section("state" + std::to_string(column), state[column].data(), size * sizeof(double));
+    }
+
+    uint64_t offset = sizeof(CheckpointHeader) + sections.size() * sizeof(CheckpointSection);
+    for (CheckpointSection& section : sections) {
+        section.offset = align_offset(offset);
+        offset = section.offset + section.bytes;
+    }
+
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "CHIROCKP", 8);
+    header.version = checkpoint_version;
+    header.section_count = sections.size();
+    header.body_count = size;
+    header.file_bytes = offset;
+    header.step_count = simulation.step_count;
+    header.force_evaluations = simulation.force_evaluations;
+    header.sim_time = simulation.sim_time;
+    header.time_step = simulation.time_step;
+    header.G_const = simulation.G_const;
+    header.softening = simulation.softening;
+    header.E_val_km = system.E_val_km;
+    header.E_val_kg = system.E_val_kg;
+    header.accelerations_current = simulation.accelerations_current && simulation.ax.size() == size;
+    header.state_columns = state_columns;
+    strncpy(header.integrator, simulation.integrator->name(), sizeof(header.integrator) - 1);
+
+    std::string temporary = filename + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        printf("Could not create checkpoint '%s'\n", temporary.c_str());
+        return false;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    written = written && fwrite(sections.data(), sizeof(CheckpointSection), sections.size(), file) == sections.size();
+
+    uint64_t position = sizeof(CheckpointHeader) + sections.size() * sizeof(CheckpointSection);
+    std::vector<char> zeros(1 << 16, 0);
+
+    for (size_t s = 0; s < sections.size() && written; s++) {
+        // Padding up to the aligned start of the column, and zeros for a column the simulation does not hold yet
+        uint64_t padding = sections[s].offset - position;
+        written = fwrite(zeros.data(), 1, padding, file) == padding;
+
+        if (contents[s] != nullptr) {
+            written = written && fwrite(contents[s], 1, sections[s].bytes, file) == sections[s].bytes;
+        }
+        else {
+            for (uint64_t done = 0; done < sections[s].bytes && written; done += zeros.size()) {
+                uint64_t chunk = std::min<uint64_t>(zeros.size(), sections[s].bytes - done);
+                written = fwrite(zeros.data(), 1, chunk, file) == chunk;
+            }
+        }
+
+        position = sections[s].offset + sections[s].bytes;
+    }
+
+    // The data must be on disk before the rename makes it the checkpoint
+    written = written && fflush(file) == 0;
+#ifdef _WIN32
+    written = written && _commit(_fileno(file)) == 0;
+#else
+    written = written && fsync(fileno(file)) == 0;
+#endif
+    written = (fclose(file) == 0) && written;
+
+#ifdef _WIN32
+    written = written && MoveFileExA(temporary.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    written = written && rename(temporary.c_str(), filename.c_str()) == 0;
+#endif
+
+    if (!written) {
+        printf("Could not write checkpoint '%s', the previous one is kept\n", filename.c_str());
+        remove(temporary.c_str());
+    }
+
+    return written;
+}
+
+CheckpointFile::CheckpointFile() {
+    this->header = nullptr;
+    this->data = nullptr;
+    this->bytes = 0;
+#ifdef _WIN32
+    this->file_handle = INVALID_HANDLE_VALUE;
+    this->mapping_handle = nullptr;
+#endif
+}
+
+CheckpointFile::~CheckpointFile() {
+    this->close();
+}
+
+bool CheckpointFile::open(const std::string filename) {
+    this->close();
+
+    if (!host_little_endian()) {
+        printf("Checkpoints are little-endian and can not be read on this host\n");
+        return false;
+    }
+
+#ifdef _WIN32
+    this->file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER file_size;
+
+    if (this->file_handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(this->file_handle, &file_size) || file_size.QuadPart < (LONGLONG)sizeof(CheckpointHeader)) {
+        printf("Could not open checkpoint '%s'\n", filename.c_str());
+        this->close();
+        return false;
+    }
+
+    this->mapping_handle = CreateFileMappingA(this->file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* mapped = (this->mapping_handle != nullptr) ? MapViewOfFile(this->mapping_handle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+    if (mapped == nullptr) {
+        printf("Could not map checkpoint '%s'\n", filename.c_str());
+        this->close();
+        return false;
+    }
+
+    this->bytes = file_size.QuadPart;
+#else
+    int descriptor = ::open(filename.c_str(), O_RDONLY);
+    struct stat info;
+
+    if (descriptor < 0 || fstat(descriptor, &info) != 0 || info.st_size < (off_t)sizeof(CheckpointHeader)) {
+        printf("Could not open checkpoint '%s'\n", filename.c_str());
+        if (descriptor >= 0) {
+            ::close(descriptor);
+        }
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    // The mapping keeps the file alive on its own
+    ::close(descriptor);
+
+    if (mapped == MAP_FAILED) {
+        printf("Could not map checkpoint '%s'\n", filename.c_str());
+        return false;
+    }
+
+    this->bytes = info.st_size;
+#endif
+
+    this->data = (const char*)mapped;
+    this->header = (const CheckpointHeader*)mapped;
+
+    if (!this->check_sections()) {
+        printf("'%s' is not a complete version %u checkpoint\n", filename.c_str(), checkpoint_version);
+        this->close();
+        return false;
+    }
+
+    return true;
+}
+
+void CheckpointFile::close() {
+#ifdef _WIN32
+    if (this->data != nullptr) {
+        UnmapViewOfFile(this->data);
+    }
+    if (this->mapping_handle != nullptr) {
+        CloseHandle(this->mapping_handle);
+    }
+    if (this->file_handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(this->file_handle);
+    }
+    this->mapping_handle = nullptr;
+    this->file_handle = INVALID_HANDLE_VALUE;
+#else
+    if (this->data != nullptr) {
+        munmap((void*)this->data, this->bytes);
+    }
+#endif
+
+    this->header = nullptr;
+    this->data = nullptr;
+    this->bytes = 0;
+
+    return;
+}
+
+bool CheckpointFile::check_sections() {
+    const CheckpointHeader* header = this->header;
+
+    if (memcmp(header->magic, "CHIROCKP", 8) != 0 || header->version != checkpoint_version || header->file_bytes != this->bytes) {
+        return false;
+    }
+    if (header->body_count > 0x7fffffff || sizeof(CheckpointHeader) + header->section_count * sizeof(CheckpointSection) > this->bytes) {
+        return false;
+    }
+
+    const CheckpointSection* sections = (const CheckpointSection*)(this->data + sizeof(CheckpointHeader));
+    for (uint32_t s = 0; s < header->section_count; s++) {
+        if (sections[s].offset % 8 != 0 || sections[s].offset > this->bytes || sections[s].bytes > this->bytes - sections[s].offset) {
+            return false;
+        }
+    }
+
+    // Every per body column must be present and hold one entry per body
+    uint64_t size = header->body_count;
+    uint64_t section_bytes;
+
+    for (int column = 0; column < 11; column++) {
+        if (this->section(double_columns[column], section_bytes) == nullptr || section_bytes != size * sizeof(double)) {
+            return false;
+        }
+    }
+    for (uint32_t column = 0; column < header->state_columns; column++) {
+        if (this->section("state" + std::to_string(column), section_bytes) == nullptr || section_bytes != size * sizeof(double)) {
+            return false;
+        }
+    }
+    if (this->section("host", section_bytes) == nullptr || section_bytes != size * sizeof(int)) {
+        return false;
+    }
+    if (this->section("color", section_bytes) == nullptr || section_bytes != size * 4 * sizeof(float)) {
+        return false;
+    }
+
+    const uint64_t* name_offsets = (const uint64_t*)this->section("name_offsets", section_bytes);
+    if (name_offsets == nullptr || section_bytes != (size + 1) * sizeof(uint64_t)) {
+        return false;
+    }
+
+    uint64_t name_bytes;
+    if (this->section("names", name_bytes) == nullptr || name_offsets[0] != 0 || name_offsets[size] != name_bytes) {
+        return false;
+    }
+
+    // Names are read straight from the mapping, so every one of them must lie inside the names section
+    for (uint64_t idx = 0; idx < size; idx++) {
+        if (name_offsets[idx] > name_offsets[idx + 1]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+const void* CheckpointFile::section(const std::string name, uint64_t& bytes) const {
+    bytes = 0;
+    if (this->header == nullptr) {
+        return nullptr;
+    }
+
+    const CheckpointSection* sections = (const CheckpointSection*)(this->data + sizeof(CheckpointHeader));
+
+    for (uint32_t s = 0; s < this->header->section_count; s++) {
+        if (strncmp(sections[s].name, name.c_str(), sizeof(sections[s].name)) == 0) {
+            bytes = sections[s].bytes;
+            return this->data + sections[s].offset;
+        }
+    }
+
+    return nullptr;
+}
+
+const double* CheckpointFile::column(const char* name) const {
+    uint64_t bytes;
+    return (const double*)this->section(name, bytes);
+}
+
+int CheckpointFile::size() const {
+    return (this->header != nullptr) ? (int)this->header->body_count : 0;
+}
+
+BodyView CheckpointFile::bodies() const {
+    BodyView view;
+    uint64_t bytes;
+
+    view.x = this->column("x");
+    view.y = this->column("y");
+    view.z = this->column("z");
+    view.vx = this->column("vx");
+    view.vy = this->column("vy");
+    view.vz = this->column("vz");
+    view.mass = this->column("mass");
+    view.diameter = this->column("diameter");
+    view.host = (const int*)this->section("host", bytes);
+    view.count = this->size();
+
+    return view;
+}
+
+std::string CheckpointFile::name(int idx) const {
+    uint64_t bytes;
+    const uint64_t* name_offsets = (const uint64_t*)this->section("name_offsets", bytes);
+    const char* names = (const char*)this->section("names", bytes);
+
+    return std::string(names + name_offsets[idx], name_offsets[idx + 1] - name_offsets[idx]);
+}
+
+BodySystem CheckpointFile::load_system() const {
+    BodySystem system;
+    BodyView view = this->bodies();
+    int size = view.size();
+
+    system.E_val_km = this->header->E_val_km;
+    system.E_val_kg = this->header->E_val_kg;
+
+    system.x.assign(view.x, view.x + size);
+    system.y.assign(view.y, view.y + size);
+    system.z.assign(view.z, view.z + size);
+    system.vx.assign(view.vx, view.vx + size);
+    system.vy.assign(view.vy, view.vy + size);
+    system.vz.assign(view.vz, view.vz + size);
+    system.mass.assign(view.mass, view.mass + size);
+    system.diameter.assign(view.diameter, view.diameter + size);
+    system.host.assign(view.host, view.host + size);
+
+    uint64_t bytes;
+    const uint64_t* name_offsets = (const uint64_t*)this->section("name_offsets", bytes);
+    const char* names = (const char*)this->section("names", bytes);
+    const float* colors = (const float*)this->section("color", bytes);
+
+    system.names.resize(size);
+    system.color.resize(size);
+    for (int idx = 0; idx < size; idx++) {
+        system.names[idx].assign(names + name_offsets[idx], name_offsets[idx + 1] - name_offsets[idx]);
+        system.color[idx].assign(colors + idx * 4, colors + idx * 4 + 4);
+    }
+
+    return system;
+}
+
+bool CheckpointFile::restore(Simulation& simulation) const {
+    if (this->header == nullptr) {
+        return false;
+    }
+
+    int size = this->size();
+
+    simulation.system = this->load_system();
+    simulation.ax.assign(this->column("ax"), this->column("ax") + size);
+    simulation.ay.assign(this->column("ay"), this->column("ay") + size);
+    simulation.az.assign(this->column("az"), this->column("az") + size);
+
+    // The run continues with the physics it was saved with, whatever the configurations say now
+    simulation.sim_time = this->header->sim_time;
+    simulation.step_count = this->header->step_count;
+    simulation.force_evaluations = this->header->force_evaluations;
+    simulation.time_step = this->header->time_step;
+    simulation.G_const = this->header->G_const;
+    simulation.softening = this->header->softening;
+    simulation.accelerations_current = false;
+
+    // Integrator state only carries over to the same scheme, any other starts from fresh accelerations
+    if (strncmp(this->header->integrator, simulation.integrator->name(), sizeof(this->header->integrator)) != 0) {
+        printf("Checkpoint of a %.32s run restored with the %s integrator, its integrator state is dropped\n", this->header->integrator, simulation.integrator->name());
+        return true;
+    }
+
+    for (uint32_t column = 0; column < this->header->state_columns; column++) {
+        simulation.integrator->load_state(column, this->column(("state" + std::to_string(column)).c_str()), size);
+    }
+    simulation.accelerations_current = this->header->accelerations_current && simulation.integrator->state_columns() == (int)this->header->state_columns;
+
+    return true;
+}
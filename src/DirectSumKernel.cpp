@@ -0,0 +1,273 @@
+#include "../include/DirectSumKernel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHIRO_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+static SimdLevel probe_simd_level() {
+    SimdLevel level = simd_scalar;
+
+#ifdef CHIRO_X86_SIMD
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f")) {
+        level = simd_avx512;
+    }
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        level = simd_avx2;
+    }
+#endif
+
+    return level;
+}
+
+SimdLevel detect_simd_level() {
+    // Initialized once even when solvers on several threads ask at the same time
+    static const SimdLevel detected = probe_simd_level();
+
+    return detected;
+}
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+        case simd_avx512:
+            return "avx512";
+        case simd_avx2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+static void direct_sum_scalar(const double* x, const double* y, const double* z, const double* mass, int count,
+    int first_target, int last_target, double G_const, double eps2, double* ax, double* ay, double* az) {
+
+    for (int i = first_target; i < last_target; i++) {
+        double gravity[3] = {0.0, 0.0, 0.0};
+
+        for (int j = 0; j < count; j++) {
+            double R[3] = {x[j] - x[i], y[j] - y[i], z[j] - z[i]};
+            double R2 = R[0] * R[0] + R[1] * R[1] + R[2] * R[2] + eps2;
+
+            if (R2 > min_kernel_r2) {
+                double R_inv = 1.0 / std::sqrt(R2);
+                double gravity_total = mass[j] * R_inv * R_inv * R_inv;
+
+                gravity[0] += gravity_total * R[0];
+                gravity[1] += gravity_total * R[1];
+                gravity[2] += gravity_total * R[2];
+            }
+        }
+
+        ax[i] = G_const * gravity[0];
+        ay[i] = G_const * gravity[1];
+        az[i] = G_const * gravity[2];
+    }
+
+    return;
+}
+
+#ifdef CHIRO_X86_SIMD
+
+__attribute__((target("avx2,fma")))
+static void direct_sum_avx2(const double* x, const double* y, const double* z, const double* mass, int count,
+    int first_target, int last_target, double G_const, double eps2, double* ax, double* ay, double* az) {
+
+    const __m256d eps = _mm256_set1_pd(eps2);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d three_halves = _mm256_set1_pd(1.5);
+    const __m256d min_r2 = _mm256_set1_pd(min_kernel_r2);
+    const __m256i scale_bias = _mm256_set1_epi64x(2047);
+    const __m256i unscale_bias = _mm256_set1_epi64x(1535);
+
+    for (int i = first_target; i < last_target; i++) {
+        const __m256d xi = _mm256_set1_pd(x[i]);
+        const __m256d yi = _mm256_set1_pd(y[i]);
+        const __m256d zi = _mm256_set1_pd(z[i]);
+
+        __m256d gravity_x = _mm256_setzero_pd();
+        __m256d gravity_y = _mm256_setzero_pd();
+        __m256d gravity_z = _mm256_setzero_pd();
+
+        int j = 0;
+        for (; j + 4 <= count; j += 4) {
+            __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + j), xi);
+            __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + j), yi);
+            __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(z + j), zi);
+            __m256d r2 = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_fmadd_pd(dz, dz, eps)));
+
+            // 12 bit single precision estimate, two Newton steps bring it to about 46 bits. r2 is first scaled by
+            // 2^-2k into [2, 8), where it always fits a float, and the estimate scaled back by 2^-k, with k taken
+            // from the exponent bits so the far pairs beyond FLT_MAX and the tiny separations keep their force
+            __m256i half_exponent = _mm256_srli_epi64(_mm256_castpd_si256(r2), 53);
+            __m256d scale = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_sub_epi64(scale_bias, _mm256_add_epi64(half_exponent, half_exponent)), 52));
+            __m256d unscale = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_sub_epi64(unscale_bias, half_exponent), 52));
+            __m256d r_inv = _mm256_mul_pd(_mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(_mm256_mul_pd(r2, scale)))), unscale);
+            __m256d half_r2 = _mm256_mul_pd(half, r2);
+            r_inv = _mm256_mul_pd(r_inv, _mm256_fnmadd_pd(half_r2, _mm256_mul_pd(r_inv, r_inv), three_halves));
+            r_inv = _mm256_mul_pd(r_inv, _mm256_fnmadd_pd(half_r2, _mm256_mul_pd(r_inv, r_inv), three_halves));
+
+            __m256d r_inv3 = _mm256_mul_pd(_mm256_mul_pd(r_inv, r_inv), _mm256_mul_pd(r_inv, _mm256_loadu_pd(mass + j)));
+            r_inv3 = _mm256_and_pd(r_inv3, _mm256_cmp_pd(r2, min_r2, _CMP_GT_OQ));
+
+            gravity_x = _mm256_fmadd_pd(r_inv3, dx, gravity_x);
+            gravity_y = _mm256_fmadd_pd(r_inv3, dy, gravity_y);
+            gravity_z = _mm256_fmadd_pd(r_inv3, dz, gravity_z);
+        }
+
+        double lanes[3][4];
+        _mm256_storeu_pd(lanes[0], gravity_x);
+        _mm256_storeu_pd(lanes[1], gravity_y);
+        _mm256_storeu_pd(lanes[2], gravity_z);
+
+        double gravity[3];
+        for (int axis = 0; axis < 3; axis++) {
+            gravity[axis] = (lanes[axis][0] + lanes[axis][1]) + (lanes[axis][2] + lanes[axis][3]);
+        }
+
+        for (; j < count; j++) {
+            double R[3] = {x[j] - x[i], y[j] - y[i], z[j] - z[i]};
+            double R2 = R[0] * R[0] + R[1] * R[1] + R[2] * R[2] + eps2;
+
+            if (R2 > min_kernel_r2) {
+                double R_inv = 1.0 / std::sqrt(R2);
+                double gravity_total = mass[j] * R_inv * R_inv * R_inv;
+
+                gravity[0] += gravity_total * R[0];
+                gravity[1] += gravity_total * R[1];
+                gravity[2] += gravity_total * R[2];
+            }
+        }
+
+        ax[i] = G_const * gravity[0];
+        ay[i] = G_const * gravity[1];
+        az[i] = G_const * gravity[2];
+    }
+
+    return;
+}
+
+// GCC 12 reports the deliberately undefined registers inside its own AVX-512 intrinsics as uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f")))
+static void direct_sum_avx512(const double* x, const double* y, const double* z, const double* mass, int count,
+    int first_target, int last_target, double G_const, double eps2, double* ax, double* ay, double* az) {
+
+    const __m512d eps = _mm512_set1_pd(eps2);
+    const __m512d half = _mm512_set1_pd(0.5);
+    const __m512d three_halves = _mm512_set1_pd(1.5);
+    const __m512d min_r2 = _mm512_set1_pd(min_kernel_r2);
+
+    for (int i = first_target; i < last_target; i++) {
+        const __m512d xi = _mm512_set1_pd(x[i]);
+        const __m512d yi = _mm512_set1_pd(y[i]);
+        const __m512d zi = _mm512_set1_pd(z[i]);
+
+        __m512d gravity_x = _mm512_setzero_pd();
+        __m512d gravity_y = _mm512_setzero_pd();
+        __m512d gravity_z = _mm512_setzero_pd();
+
+        for (int j = 0; j < count; j += 8) {
+            // The last partial block is loaded under a mask, its missing lanes carry no mass
+            __mmask8 lanes = (count - j >= 8) ? (__mmask8)0xFF : (__mmask8)((1u << (count - j)) - 1);
+
+            __m512d dx = _mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, x + j), xi);
+            __m512d dy = _mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, y + j), yi);
+            __m512d dz = _mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, z + j), zi);
+            __m512d r2 = _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(dy, dy, _mm512_fmadd_pd(dz, dz, eps)));
+
+            // 14 bit estimate, two Newton steps bring it to full double precision
+            __m512d r_inv = _mm512_rsqrt14_pd(r2);
+            __m512d half_r2 = _mm512_mul_pd(half, r2);
+            r_inv = _mm512_mul_pd(r_inv, _mm512_fnmadd_pd(half_r2, _mm512_mul_pd(r_inv, r_inv), three_halves));
+            r_inv = _mm512_mul_pd(r_inv, _mm512_fnmadd_pd(half_r2, _mm512_mul_pd(r_inv, r_inv), three_halves));
+
+            __mmask8 valid = _mm512_mask_cmp_pd_mask(lanes, r2, min_r2, _CMP_GT_OQ);
+            __m512d r_inv3 = _mm512_maskz_mul_pd(valid, _mm512_mul_pd(r_inv, r_inv), _mm512_mul_pd(r_inv, _mm512_maskz_loadu_pd(lanes, mass + j)));
+
+            gravity_x = _mm512_fmadd_pd(r_inv3, dx, gravity_x);
+            gravity_y = _mm512_fmadd_pd(r_inv3, dy, gravity_y);
+            gravity_z = _mm512_fmadd_pd(r_inv3, dz, gravity_z);
+        }
+
+        ax[i] = G_const * _mm512_reduce_add_pd(gravity_x);
+        ay[i] = G_const * _mm512_reduce_add_pd(gravity_y);
+        az[i] = G_const * _mm512_reduce_add_pd(gravity_z);
+    }
+
+    return;
+}
+#pragma GCC diagnostic pop
+
+#endif
+
+void direct_sum_accelerations(const double* x, const double* y, const double* z, const double* mass, int count,
+    int first_target, int last_target, double G_const, double eps2, double* ax, double* ay, double* az, SimdLevel level) {
+
+    // Never run a path the processor does not support
+    if (level > detect_simd_level()) {
+        level = detect_simd_level();
+    }
+
+#ifdef CHIRO_X86_SIMD
+    if (level == simd_avx512) {
+        direct_sum_avx512(x, y, z, mass, count, first_target, last_target, G_const, eps2, ax, ay, az);
+        return;
+    }
+    if (level == simd_avx2) {
+        direct_sum_avx2(x, y, z, mass, count, first_target, last_target, G_const, eps2, ax, ay, az);
+        return;
+    }
+#endif
+
+    direct_sum_scalar(x, y, z, mass, count, first_target, last_target, G_const, eps2, ax, ay, az);
+
+    return;
+}
+
+void direct_sum_accelerations_jerks(const double* x, const double* y, const double* z, const double* vx, const double* vy, const double* vz,
+    const double* mass, int count, int first_target, int last_target, double G_const, double eps2,
+    double* ax, double* ay, double* az, double* jx, double* jy, double* jz) {
+
+    for (int i = first_target; i < last_target; i++) {
+        double gravity[3] = {0.0, 0.0, 0.0};
+        double jerk[3] = {0.0, 0.0, 0.0};
+
+        for (int j = 0; j < count; j++) {
+            double R[3] = {x[j] - x[i], y[j] - y[i], z[j] - z[i]};
+            double V[3] = {vx[j] - vx[i], vy[j] - vy[i], vz[j] - vz[i]};
+            double R2 = R[0] * R[0] + R[1] * R[1] + R[2] * R[2] + eps2;
+
+            if (R2 > min_kernel_r2) {
+                double R_inv2 = 1.0 / R2;
+                double gravity_total = mass[j] * R_inv2 * std::sqrt(R_inv2);
+                double RV = 3.0 * (R[0] * V[0] + R[1] * V[1] + R[2] * V[2]) * R_inv2;
+
+                // d/dt (m R / r^3) = m V / r^3 - 3 m (R.V) R / r^5
+                gravity[0] += gravity_total * R[0];
+                gravity[1] += gravity_total * R[1];
+                gravity[2] += gravity_total * R[2];
+
+                jerk[0] += gravity_total * (V[0] - RV * R[0]);
+                jerk[1] += gravity_total * (V[1] - RV * R[1]);
+                jerk[2] += gravity_total * (V[2] - RV * R[2]);
+            }
+        }
+
+        ax[i] = G_const * gravity[0];
+        ay[i] = G_const * gravity[1];
+        az[i] = G_const * gravity[2];
+
+        jx[i] = G_const * jerk[0];
+        jy[i] = G_const * jerk[1];
+        jz[i] = G_const * jerk[2];
+    }
+
+    return;
+}
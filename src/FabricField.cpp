@@ -0,0 +1,431 @@
+#include "../include/FabricField.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "../include/BodySystem.h"
+#include "../include/DirectSumKernel.h"
+#include "../include/ParticleMesh.h"
+#include "../include/ThreadPool.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHIRO_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+static float fabric_field_scalar(const float* x, const float* y, const float* z, const float* mass, int count,
+    float node_x, float node_z, float min_dist2, float cutoff2) {
+
+    float field = 0.0f;
+
+    for (int j = 0; j < count; j++) {
+        float dx = x[j] - node_x;
+        float dz = z[j] - node_z;
+        float distance2 = std::max(dx * dx + y[j] * y[j] + dz * dz, min_dist2);
+
+        if (distance2 <= cutoff2) {
+            field += mass[j] / distance2;
+        }
+    }
+
+    return field;
+}
+
+#ifdef CHIRO_X86_SIMD
+
+__attribute__((target("avx2,fma")))
+static float fabric_field_avx2(const float* x, const float* y, const float* z, const float* mass, int count,
+    float node_x, float node_z, float min_dist2, float cutoff2) {
+
+    const __m256 nx = _mm256_set1_ps(node_x);
+    const __m256 nz = _mm256_set1_ps(node_z);
+    const __m256 min_r2 = _mm256_set1_ps(min_dist2);
+    const __m256 cutoff_r2 = _mm256_set1_ps(cutoff2);
+    __m256 field = _mm256_setzero_ps();
+
+    int j = 0;
+    for (; j + 8 <= count; j += 8) {
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), nx);
+        __m256 dy = _mm256_loadu_ps(y + j);
+        __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + j), nz);
+        __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+        r2 = _mm256_max_ps(r2, min_r2);
+
+        __m256 term = _mm256_div_ps(_mm256_loadu_ps(mass + j), r2);
+        field = _mm256_add_ps(field, _mm256_and_ps(term, _mm256_cmp_ps(r2, cutoff_r2, _CMP_LE_OQ)));
+    }
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, field);
+
+    float total = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+
+    // Remainder kept inside the AVX function, calling SSE code with dirty upper registers stalls some processors
+    for (; j < count; j++) {
+        float dx = x[j] - node_x;
+        float dz = z[j] - node_z;
+        float distance2 = std::max(dx * dx + y[j] * y[j] + dz * dz, min_dist2);
+
+        if (distance2 <= cutoff2) {
+            total += mass[j] / distance2;
+        }
+    }
+
+    return total;
+}
+
+// GCC 12 reports the deliberately undefined registers inside its own AVX-512 intrinsics as uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f")))
+static float fabric_field_avx512(const float* x, const float* y, const float* z, const float* mass, int count,
+    float node_x, float node_z, float min_dist2, float cutoff2) {
+
+    const __m512 nx = _mm512_set1_ps(node_x);
+    const __m512 nz = _mm512_set1_ps(node_z);
+    const __m512 min_r2 = _mm512_set1_ps(min_dist2);
+    const __m512 cutoff_r2 = _mm512_set1_ps(cutoff2);
+    __m512 field = _mm512_setzero_ps();
+
+    int j = 0;
+    for (; j + 16 <= count; j += 16) {
+        __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(x + j), nx);
+        __m512 dy = _mm512_loadu_ps(y + j);
+        __m512 dz = _mm512_sub_ps(_mm512_loadu_ps(z + j), nz);
+        __m512 r2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz)));
+        r2 = _mm512_max_ps(r2, min_r2);
+
+        __mmask16 inside = _mm512_cmp_ps_mask(r2, cutoff_r2, _CMP_LE_OQ);
+        field = _mm512_mask_add_ps(field, inside, field, _mm512_div_ps(_mm512_loadu_ps(mass + j), r2));
+    }
+
+    float total = _mm512_reduce_add_ps(field);
+
+    // Remainder kept inside the AVX function, calling SSE code with dirty upper registers stalls some processors
+    for (; j < count; j++) {
+        float dx = x[j] - node_x;
+        float dz = z[j] - node_z;
+        float distance2 = std::max(dx * dx + y[j] * y[j] + dz * dz, min_dist2);
+
+        if (distance2 <= cutoff2) {
+            total += mass[j] / distance2;
+        }
+    }
+
+    return total;
+}
+#pragma GCC diagnostic pop
+
+#endif
+
+float fabric_node_field(const float* x, const float* y, const float* z, const float* mass, int count,
+    float node_x, float node_z, float min_dist2, float cutoff2, SimdLevel level) {
+
+    // Never run a path the processor does not support
+    if (level > detect_simd_level()) {
+        level = detect_simd_level();
+    }
+
+#ifdef CHIRO_X86_SIMD
+    if (level == simd_avx512) {
+        return fabric_field_avx512(x, y, z, mass, count, node_x, node_z, min_dist2, cutoff2);
+    }
+    if (level == simd_avx2) {
+        return fabric_field_avx2(x, y, z, mass, count, node_x, node_z, min_dist2, cutoff2);
+    }
+#endif
+
+    return fabric_field_scalar(x, y, z, mass, count, node_x, node_z, min_dist2, cutoff2);
+}
+
+FabricField::FabricField(float G_const, float distance_cutoff, float min_dist) {
+    this->G_const = G_const;
+    this->distance_cutoff = distance_cutoff;
+    this->min_dist = min_dist;
+    this->simd_level = detect_simd_level();
+    this->pool = nullptr;
+    this->mesh = nullptr;
+    this->spatial_index = true;
+    this->tolerance = 0.0f;
+    this->refresh_interval = 256;
+    this->dirty_first_row = 0;
+    this->dirty_last_row = -1;
+    this->drawn_nodes_per_side = 0;
+    this->drawn_step = 0.0f;
+    this->updates_since_refresh = 0;
+    this->cells_per_side = 1;
+    this->cell_size = 0.0f;
+    this->cell_origin[0] = this->cell_origin[1] = 0.0f;
+}
+
+void FabricField::load_bodies(const BodyView& bodies) {
+    int size = bodies.size();
+
+    this->body_x.resize(size);
+    this->body_y.resize(size);
+    this->body_z.resize(size);
+    this->body_mass.resize(size);
+    this->body_cell.resize(size);
+
+    // Square bounding box of the bodies in the fabric plane, split into cells no smaller than the cutoff
+    float lower[2] = {0.0f, 0.0f};
+    float extent = 0.0f;
+
+    if (size > 0) {
+        float upper[2] = {(float)bodies.x[0], (float)bodies.z[0]};
+        lower[0] = upper[0];
+        lower[1] = upper[1];
+
+        for (int i = 1; i < size; i++) {
+            lower[0] = std::min(lower[0], (float)bodies.x[i]);
+            lower[1] = std::min(lower[1], (float)bodies.z[i]);
+            upper[0] = std::max(upper[0], (float)bodies.x[i]);
+            upper[1] = std::max(upper[1], (float)bodies.z[i]);
+        }
+
+        extent = std::max(upper[0] - lower[0], upper[1] - lower[1]);
+    }
+
+    int per_side = 1;
+    if (this->spatial_index && this->distance_cutoff > 0.0f && extent > 0.0f) {
+        per_side = (int)std::min(1024.0f, std::max(1.0f, std::floor(extent / this->distance_cutoff)));
+    }
+
+    this->cells_per_side = per_side;
+    this->cell_size = std::max(extent / per_side, this->distance_cutoff) * (1.0f + 1e-6f);
+    if (!(this->cell_size > 0.0f)) {
+        this->cell_size = 1.0f;
+    }
+    this->cell_origin[0] = lower[0];
+    this->cell_origin[1] = lower[1];
+
+    // Counting sort of the bodies by cell, cells stored row by row so neighbouring cells of a row are contiguous
+    this->cell_start.assign(per_side * per_side + 1, 0);
+
+    for (int i = 0; i < size; i++) {
+        int column = std::min(per_side - 1, std::max(0, (int)((bodies.x[i] - lower[0]) / this->cell_size)));
+        int row = std::min(per_side - 1, std::max(0, (int)((bodies.z[i] - lower[1]) / this->cell_size)));
+
+        this->body_cell[i] = row * per_side + column;
+        this->cell_start[this->body_cell[i] + 1]++;
+    }
+
+    for (int c = 0; c < per_side * per_side; c++) {
+        this->cell_start[c + 1] += this->cell_start[c];
+    }
+
+    this->cell_fill.assign(this->cell_start.begin(), this->cell_start.end() - 1);
+    for (int i = 0; i < size; i++) {
+        int k = this->cell_fill[this->body_cell[i]]++;
+
+        this->body_x[k] = bodies.x[i];
+        this->body_y[k] = bodies.y[i];
+        this->body_z[k] = bodies.z[i];
+        this->body_mass[k] = bodies.mass[i];
+    }
+
+    return;
+}
+
+float FabricField::field_at(float x, float z) const {
+    float sum;
+
+    // The solver's mesh already holds the same sum over every body, away from it the bodies are summed directly
+    if (this->mesh != nullptr && this->mesh->sample(x, z, sum)) {
+        return this->G_const * sum;
+    }
+
+    int per_side = this->cells_per_side;
+    // Clamped before the conversion, nodes far outside the cells only need to stay out of range
+    int column = (int)std::max(-2.0f, std::min(per_side + 1.0f, std::floor((x - this->cell_origin[0]) / this->cell_size)));
+    int row = (int)std::max(-2.0f, std::min(per_side + 1.0f, std::floor((z - this->cell_origin[1]) / this->cell_size)));
+    float min_dist2 = this->min_dist * this->min_dist;
+    float cutoff2 = this->distance_cutoff * this->distance_cutoff;
+    float field = 0.0f;
+
+    // Cells are at least the cutoff wide, so every body within it sits in the 3 x 3 cells around the node
+    int first_column = std::max(0, column - 1);
+    int last_column = std::min(per_side - 1, column + 1);
+
+    for (int r = std::max(0, row - 1); r <= std::min(per_side - 1, row + 1); r++) {
+        if (first_column > last_column) {
+            break;
+        }
+
+        int begin = this->cell_start[r * per_side + first_column];
+        int end = this->cell_start[r * per_side + last_column + 1];
+
+        field += fabric_node_field(this->body_x.data() + begin, this->body_y.data() + begin, this->body_z.data() + begin, this->body_mass.data() + begin, end - begin,
+            x, z, min_dist2, cutoff2, this->simd_level);
+    }
+
+    return this->G_const * field;
+}
+
+void FabricField::evaluate(const BodyView& bodies, int nodes_per_side, float step, std::vector<float>& field) {
+    float origin = -0.5f * (nodes_per_side - 1) * step;
+
+    this->load_bodies(bodies);
+    field.resize((long long)nodes_per_side * nodes_per_side);
+
+    parallel_for(this->pool, nodes_per_side, [&](int begin, int end, int) {
+        for (int row = begin; row < end; row++) {
+            float z = origin + row * step;
+
+            for (int column = 0; column < nodes_per_side; column++) {
+                field[(long long)row * nodes_per_side + column] = this->field_at(origin + column * step, z);
+            }
+        }
+    });
+
+    this->dirty_rows.assign(nodes_per_side, 1);
+    this->dirty_first_row = 0;
+    this->dirty_last_row = nodes_per_side - 1;
+
+    return;
+}
+
+void FabricField::node_range(double coordinate, int nodes_per_side, float step, int& first, int& last) const {
+    double origin = -0.5 * (nodes_per_side - 1) * step;
+
+    // Rows or columns within the cutoff of the coordinate, clamped in floating point so an unbounded cutoff covers the whole grid
+    double lower = std::ceil((coordinate - this->distance_cutoff - origin) / step);
+    double upper = std::floor((coordinate + this->distance_cutoff - origin) / step);
+
+    first = (int)std::max(0.0, std::min((double)nodes_per_side, lower));
+    last = (int)std::max(-1.0, std::min(nodes_per_side - 1.0, upper));
+
+    return;
+}
+
+void FabricField::add_body(double x, double y, double z, double mass, double sign, int row, int nodes_per_side, float step, std::vector<float>& field) const {
+    float origin = -0.5f * (nodes_per_side - 1) * step;
+    float node_z = origin + row * step;
+    float min_dist2 = this->min_dist * this->min_dist;
+    float cutoff2 = this->distance_cutoff * this->distance_cutoff;
+    float body_x = x;
+    float body_y = y;
+    float body_z = z;
+    float body_mass = mass;
+
+    int first;
+    int last;
+    this->node_range(x, nodes_per_side, step, first, last);
+
+    // Same single precision distance terms as the kernel
+    for (int column = first; column <= last; column++) {
+        float dx = body_x - (origin + column * step);
+        float dz = body_z - node_z;
+        float distance2 = std::max(dx * dx + body_y * body_y + dz * dz, min_dist2);
+
+        if (distance2 <= cutoff2) {
+            field[(long long)row * nodes_per_side + column] += sign * this->G_const * (body_mass / distance2);
+        }
+    }
+
+    return;
+}
+
+void FabricField::update(const BodyView& bodies, int nodes_per_side, float step, std::vector<float>& field) {
+    int size = bodies.size();
+    long long nodes = (long long)nodes_per_side * nodes_per_side;
+    double tolerance2 = (double)this->tolerance * this->tolerance;
+
+    // The mesh field has no per body contributions to move, and a new grid or new bodies start over
+    bool full = this->mesh != nullptr || (long long)field.size() != nodes || (int)this->drawn_x.size() != size
+        || this->drawn_nodes_per_side != nodes_per_side || this->drawn_step != step || this->updates_since_refresh >= this->refresh_interval;
+
+    this->moved.clear();
+    if (!full) {
+        for (int i = 0; i < size; i++) {
+            double dx = bodies.x[i] - this->drawn_x[i];
+            double dy = bodies.y[i] - this->drawn_y[i];
+            double dz = bodies.z[i] - this->drawn_z[i];
+
+            if (dx * dx + dy * dy + dz * dz > tolerance2 || bodies.mass[i] != this->drawn_mass[i]) {
+                this->moved.push_back(i);
+            }
+        }
+
+        // Redrawing a body costs two passes over its neighbourhood, once most bodies move a full evaluation is cheaper
+        full = 2 * (int)this->moved.size() > size;
+    }
+
+    if (full) {
+        this->evaluate(bodies, nodes_per_side, step, field);
+
+        this->drawn_x.assign(bodies.x, bodies.x + size);
+        this->drawn_y.assign(bodies.y, bodies.y + size);
+        this->drawn_z.assign(bodies.z, bodies.z + size);
+        this->drawn_mass.assign(bodies.mass, bodies.mass + size);
+        this->drawn_nodes_per_side = nodes_per_side;
+        this->drawn_step = step;
+        this->updates_since_refresh = 0;
+
+        return;
+    }
+
+    this->updates_since_refresh++;
+    this->dirty_rows.assign(nodes_per_side, 0);
+    this->dirty_first_row = nodes_per_side;
+    this->dirty_last_row = -1;
+
+    // Rows reached by a moved body at the position it was drawn at or at its new one
+    for (int i : this->moved) {
+        double z[2] = {this->drawn_z[i], bodies.z[i]};
+
+        for (int side = 0; side < 2; side++) {
+            int first;
+            int last;
+            this->node_range(z[side], nodes_per_side, step, first, last);
+
+            for (int row = first; row <= last; row++) {
+                this->dirty_rows[row] = 1;
+            }
+            this->dirty_first_row = std::min(this->dirty_first_row, first);
+            this->dirty_last_row = std::max(this->dirty_last_row, last);
+        }
+    }
+
+    if (this->dirty_first_row > this->dirty_last_row) {
+        return;
+    }
+
+    // Rows are independent, every row applies the moved bodies in the same order whatever the thread count
+    int first_row = this->dirty_first_row;
+
+    parallel_for(this->pool, this->dirty_last_row - first_row + 1, [&](int begin, int end, int) {
+        for (int row = first_row + begin; row < first_row + end; row++) {
+            if (!this->dirty_rows[row]) {
+                continue;
+            }
+
+            for (int i : this->moved) {
+                int first;
+                int last;
+
+                this->node_range(this->drawn_z[i], nodes_per_side, step, first, last);
+                if (row >= first && row <= last) {
+                    this->add_body(this->drawn_x[i], this->drawn_y[i], this->drawn_z[i], this->drawn_mass[i], -1.0, row, nodes_per_side, step, field);
+                }
+
+                this->node_range(bodies.z[i], nodes_per_side, step, first, last);
+                if (row >= first && row <= last) {
+                    this->add_body(bodies.x[i], bodies.y[i], bodies.z[i], bodies.mass[i], 1.0, row, nodes_per_side, step, field);
+                }
+            }
+        }
+    });
+
+    for (int i : this->moved) {
+        this->drawn_x[i] = bodies.x[i];
+        this->drawn_y[i] = bodies.y[i];
+        this->drawn_z[i] = bodies.z[i];
+        this->drawn_mass[i] = bodies.mass[i];
+    }
+
+    return;
+}
@@ -0,0 +1,359 @@
+#include "../include/FabricLod.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "../include/BodySystem.h"
+#include "../include/FabricField.h"
+#include "../include/ThreadPool.h"
+
+// Cells split between two rounds of scoring
+static const int split_batch = 64;
+
+FabricLod::FabricLod(int max_vertices, int max_depth) {
+    this->max_vertices = max_vertices;
+    this->max_depth = max_depth;
+    this->camera_weight = 0.001f;
+    this->pool = nullptr;
+    this->lattice = 1 << max_depth;
+    this->half_size = 0.0f;
+    this->lattice_step = 0.0f;
+}
+
+long long FabricLod::key(int i, int j) const {
+    return (long long)j * (this->lattice + 1) + i;
+}
+
+float FabricLod::sample(const FabricField& field, int i, int j) const {
+    return field.field_at(-this->half_size + i * this->lattice_step, -this->half_size + j * this->lattice_step);
+}
+
+int FabricLod::find_node(long long key) const {
+    size_t mask = this->table_keys.size() - 1;
+    size_t slot = (size_t)(((unsigned long long)key * 0x9E3779B97F4A7C15ULL) >> 20) & mask;
+
+    // Linear probing, the table is at most half full so an empty slot always ends the search
+    while (this->table_keys[slot] != -1) {
+        if (this->table_keys[slot] == key) {
+            return this->table_nodes[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return -1;
+}
+
+void FabricLod::add_node(int i, int j, float value) {
+    long long key = this->key(i, j);
+    size_t mask = this->table_keys.size() - 1;
+    size_t slot = (size_t)(((unsigned long long)key * 0x9E3779B97F4A7C15ULL) >> 20) & mask;
+
+    // Nodes on the edge between two cells are added by both, the first one creates it
+    while (this->table_keys[slot] != -1) {
+        if (this->table_keys[slot] == key) {
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    this->table_keys[slot] = key;
+    this->table_nodes[slot] = this->node_keys.size();
+    this->node_keys.push_back(key);
+
+    this->vertices.push_back(-this->half_size + i * this->lattice_step);
+    this->vertices.push_back(value);
+    this->vertices.push_back(-this->half_size + j * this->lattice_step);
+
+    return;
+}
+
+void FabricLod::sample_inner(const FabricField& field, FabricCell* cells, int count) const {
+    for (int c = 0; c < count; c++) {
+        FabricCell& cell = cells[c];
+        int h = cell.size / 2;
+
+        // Siblings share an edge with the sibling before them in x and in z, whose midpoint is already sampled
+        cell.inner[0] = this->sample(field, cell.i + h, cell.j + h);
+        cell.inner[1] = (c >= 2) ? cells[c - 2].inner[2] : this->sample(field, cell.i + h, cell.j);
+        cell.inner[2] = this->sample(field, cell.i + h, cell.j + cell.size);
+        cell.inner[3] = (c % 2 == 1) ? cells[c - 1].inner[4] : this->sample(field, cell.i, cell.j + h);
+        cell.inner[4] = this->sample(field, cell.i + cell.size, cell.j + h);
+    }
+
+    return;
+}
+
+void FabricLod::score_cell(const FabricField& field, FabricCell& cell, float deformation_scale, const float camera[3]) const {
+    int h = cell.size / 2;
+    const float* f = cell.corner;
+
+    // Distance of the field at the points a split would add from the bilinear surface of the corners
+    float error = fabsf(cell.inner[0] - 0.25f * (f[0] + f[1] + f[2] + f[3]));
+    error = std::max(error, fabsf(cell.inner[1] - 0.5f * (f[0] + f[1])));
+    error = std::max(error, fabsf(cell.inner[2] - 0.5f * (f[2] + f[3])));
+    error = std::max(error, fabsf(cell.inner[3] - 0.5f * (f[0] + f[2])));
+    error = std::max(error, fabsf(cell.inner[4] - 0.5f * (f[1] + f[3])));
+
+    float size = cell.size * this->lattice_step;
+
+    if (size > 2.0f * field.min_dist) {
+        for (int b = cell.body_begin; b < cell.body_end; b++) {
+            error = std::max(error, this->well_depth[this->body_order[b]]);
+        }
+    }
+
+    // Both the deformation error and the cell itself are weighed by the angle they span from the camera
+    float dx = -this->half_size + (cell.i + h) * this->lattice_step - camera[0];
+    float dz = -this->half_size + (cell.j + h) * this->lattice_step - camera[2];
+    float distance = sqrtf(dx * dx + camera[1] * camera[1] + dz * dz);
+
+    cell.score = (error * deformation_scale + this->camera_weight * size) / (distance + size);
+
+    return;
+}
+
+void FabricLod::split_bodies(const BodyView& bodies, const FabricCell& cell, FabricCell children[4]) {
+    float middle_x = -this->half_size + (cell.i + cell.size / 2) * this->lattice_step;
+    float middle_z = -this->half_size + (cell.j + cell.size / 2) * this->lattice_step;
+    int* begin = this->body_order.data() + cell.body_begin;
+    int* end = this->body_order.data() + cell.body_end;
+
+    // Low z before high z, then low x before high x within each, the order of the children
+    int* high_z = std::partition(begin, end, [&](int body) { return bodies.z[body] < middle_z; });
+    int* low_high_x = std::partition(begin, high_z, [&](int body) { return bodies.x[body] < middle_x; });
+    int* high_high_x = std::partition(high_z, end, [&](int body) { return bodies.x[body] < middle_x; });
+
+    int bounds[5] = {cell.body_begin, (int)(low_high_x - this->body_order.data()), (int)(high_z - this->body_order.data()), (int)(high_high_x - this->body_order.data()), cell.body_end};
+    for (int child = 0; child < 4; child++) {
+        children[child].body_begin = bounds[child];
+        children[child].body_end = bounds[child + 1];
+    }
+
+    return;
+}
+
+void FabricLod::build(FabricField& field, const BodyView& bodies, float half_size, float deformation_scale, const float camera[3]) {
+    this->lattice = 1 << this->max_depth;
+    this->half_size = half_size;
+    this->lattice_step = 2.0f * half_size / this->lattice;
+
+    // The four corners of the root are always added, and splits stop at the budget
+    size_t table_size = 16;
+    while (table_size < 2 * (size_t)std::max(this->max_vertices, 4)) {
+        table_size *= 2;
+    }
+
+    this->cells.clear();
+    this->table_keys.resize(table_size);
+    this->table_nodes.resize(table_size);
+    std::fill(this->table_keys.begin(), this->table_keys.end(), -1LL);
+    this->node_keys.clear();
+    this->vertices.clear();
+    this->body_order.clear();
+    this->well_depth.resize(bodies.size());
+
+    field.load_bodies(bodies);
+
+    // The deepest a body can press the fabric is its field at the minimum separation
+    for (int b = 0; b < bodies.size(); b++) {
+        this->well_depth[b] = field.G_const * bodies.mass[b] / (field.min_dist * field.min_dist);
+
+        if (fabs(bodies.x[b]) <= half_size && fabs(bodies.z[b]) <= half_size) {
+            this->body_order.push_back(b);
+        }
+    }
+
+    FabricCell root = {0, 0, this->lattice, -1, 0, (int)this->body_order.size(), {0.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, 0.0f};
+    root.corner[0] = this->sample(field, 0, 0);
+    root.corner[1] = this->sample(field, this->lattice, 0);
+    root.corner[2] = this->sample(field, 0, this->lattice);
+    root.corner[3] = this->sample(field, this->lattice, this->lattice);
+
+    this->add_node(0, 0, root.corner[0]);
+    this->add_node(this->lattice, 0, root.corner[1]);
+    this->add_node(0, this->lattice, root.corner[2]);
+    this->add_node(this->lattice, this->lattice, root.corner[3]);
+    this->sample_inner(field, &root, 1);
+    this->score_cell(field, root, deformation_scale, camera);
+    this->cells.push_back(root);
+
+    std::vector<std::pair<float, int>>& queue = this->queue;
+    queue.clear();
+    queue.push_back({root.score, 0});
+
+    std::vector<int>& pending = this->pending;
+    bool over_budget = false;
+
+    while (!queue.empty() && !over_budget) {
+        // Up to split_batch cells of the highest priority are split before their children are sampled and
+        // scored together on the pool, a fixed batch so the tree is the same for any thread count
+        pending.clear();
+
+        for (int split = 0; split < split_batch && !queue.empty(); split++) {
+            int parent = queue.front().second;
+            FabricCell cell = this->cells[parent];
+
+            int h = cell.size / 2;
+            int points[5][2] = {{cell.i + h, cell.j + h}, {cell.i + h, cell.j}, {cell.i + h, cell.j + cell.size}, {cell.i, cell.j + h}, {cell.i + cell.size, cell.j + h}};
+
+            int new_nodes = 0;
+            for (int p = 0; p < 5; p++) {
+                new_nodes += this->find_node(this->key(points[p][0], points[p][1])) == -1;
+            }
+
+            // Splits are taken in order of priority, so the first one over budget ends the refinement
+            if ((int)(this->vertices.size() / 3) + new_nodes > this->max_vertices) {
+                over_budget = true;
+                break;
+            }
+
+            std::pop_heap(queue.begin(), queue.end());
+            queue.pop_back();
+
+            for (int p = 0; p < 5; p++) {
+                this->add_node(points[p][0], points[p][1], cell.inner[p]);
+            }
+
+            // Children in the order (low x, low z), (high x, low z), (low x, high z), (high x, high z), their
+            // corners are the corners, center and edge midpoints of the parent
+            const float* f = cell.corner;
+            const float* m = cell.inner;
+            float corners[4][4] = {{f[0], m[1], m[3], m[0]}, {m[1], f[1], m[0], m[4]}, {m[3], m[0], f[2], m[2]}, {m[0], m[4], m[2], f[3]}};
+
+            FabricCell children[4];
+            this->split_bodies(bodies, cell, children);
+
+            int first_child = this->cells.size();
+            this->cells[parent].first_child = first_child;
+
+            for (int child = 0; child < 4; child++) {
+                FabricCell& quarter = children[child];
+                quarter.i = cell.i + (child % 2) * h;
+                quarter.j = cell.j + (child / 2) * h;
+                quarter.size = h;
+                quarter.first_child = -1;
+                quarter.score = 0.0f;
+                std::copy(corners[child], corners[child] + 4, quarter.corner);
+
+                this->cells.push_back(quarter);
+            }
+
+            // Cells one lattice step wide cannot be split
+            if (h > 1) {
+                pending.push_back(first_child);
+            }
+        }
+
+        parallel_for(this->pool, pending.size(), [&](int begin, int end, int) {
+            for (int k = begin; k < end; k++) {
+                FabricCell* children = &this->cells[pending[k]];
+                this->sample_inner(field, children, 4);
+
+                for (int child = 0; child < 4; child++) {
+                    this->score_cell(field, children[child], deformation_scale, camera);
+                }
+            }
+        });
+
+        for (int first_child : pending) {
+            for (int child = 0; child < 4; child++) {
+                queue.push_back({this->cells[first_child + child].score, first_child + child});
+                std::push_heap(queue.begin(), queue.end());
+            }
+        }
+    }
+
+    this->build_indices();
+
+    return;
+}
+
+void FabricLod::build_indices() {
+    // Nodes sorted by row then column, and by column then row, so the nodes along any lattice line are
+    // one contiguous run of keys
+    this->row_keys.clear();
+    this->column_keys.clear();
+
+    for (int node = 0; node < (int)this->node_keys.size(); node++) {
+        long long key = this->node_keys[node];
+        int i = key % (this->lattice + 1);
+        int j = key / (this->lattice + 1);
+
+        this->row_keys.push_back({key, node});
+        this->column_keys.push_back({(long long)i * (this->lattice + 1) + j, node});
+    }
+    std::sort(this->row_keys.begin(), this->row_keys.end());
+    std::sort(this->column_keys.begin(), this->column_keys.end());
+
+    this->indices.clear();
+
+    // Every stretch of line lies on the lower or left edge of exactly one leaf, the domain border aside, so
+    // each leaf draws those two edges and the border draws the rest. An edge is split at every node on
+    // it, which joins coarse cells to the corners of their finer neighbours
+    auto emit = [this](const std::vector<std::pair<long long, int>>& keys, long long first, long long last) {
+        auto node = std::lower_bound(keys.begin(), keys.end(), std::make_pair(first, -1));
+
+        while (node + 1 != keys.end() && (node + 1)->first <= last) {
+            this->indices.push_back(node->second);
+            this->indices.push_back((node + 1)->second);
+            node++;
+        }
+
+        return;
+    };
+
+    for (const auto& cell : this->cells) {
+        if (cell.first_child != -1) {
+            continue;
+        }
+
+        long long row = (long long)cell.j * (this->lattice + 1);
+        long long column = (long long)cell.i * (this->lattice + 1);
+        long long border = (long long)this->lattice * (this->lattice + 1);
+
+        emit(this->row_keys, row + cell.i, row + cell.i + cell.size);
+        emit(this->column_keys, column + cell.j, column + cell.j + cell.size);
+
+        if (cell.j + cell.size == this->lattice) {
+            emit(this->row_keys, border + cell.i, border + cell.i + cell.size);
+        }
+        if (cell.i + cell.size == this->lattice) {
+            emit(this->column_keys, border + cell.j, border + cell.j + cell.size);
+        }
+    }
+
+    return;
+}
+
+float FabricLod::interpolate(float x, float z) const {
+    float u = std::min(std::max((x + this->half_size) / this->lattice_step, 0.0f), (float)this->lattice);
+    float v = std::min(std::max((z + this->half_size) / this->lattice_step, 0.0f), (float)this->lattice);
+
+    int index = 0;
+    while (this->cells[index].first_child != -1) {
+        const FabricCell& cell = this->cells[index];
+        int h = cell.size / 2;
+
+        index = cell.first_child + (u >= cell.i + h) + 2 * (v >= cell.j + h);
+    }
+
+    // Bilinear interpolation of the leaf's corners, the surface the lines of the leaf are drawn on
+    const FabricCell& leaf = this->cells[index];
+    const float* f = leaf.corner;
+    float s = (u - leaf.i) / leaf.size;
+    float t = (v - leaf.j) / leaf.size;
+
+    return (1.0f - t) * ((1.0f - s) * f[0] + s * f[1]) + t * ((1.0f - s) * f[2] + s * f[3]);
+}
+
+int FabricLod::leaf_count() const {
+    int leaves = 0;
+
+    for (const auto& cell : this->cells) {
+        leaves += cell.first_child == -1;
+    }
+
+    return leaves;
+}
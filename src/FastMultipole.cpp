@@ -0,0 +1,574 @@
+#include "../include/FastMultipole.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "../include/BodySystem.h"
+#include "../include/ForceSolver.h"
+#include "../include/DirectSumKernel.h"
+#include "../include/Octree.h"
+#include "../include/ThreadPool.h"
+
+FastMultipoleSolver::FastMultipoleSolver(int order, float opening_angle, int leaf_size) {
+    // Order 1 is the lowest giving a force, the local gradient needs first derivatives of 1/r
+    if (order < 1) {
+        order = 1;
+    }
+    if (order > max_fmm_order) {
+        order = max_fmm_order;
+    }
+
+    this->order = order;
+    this->opening_angle = opening_angle;
+    this->walk_softening = 0.0;
+    this->tree = Octree(leaf_size);
+
+    int p = this->order;
+    this->index_of.assign((p + 1) * (p + 1) * (p + 1), -1);
+
+    // Multi-indices sorted by total order, so lower orders are always computed first
+    for (int n = 0; n <= p; n++) {
+        for (int t = n; t >= 0; t--) {
+            for (int u = n - t; u >= 0; u--) {
+                int v = n - t - u;
+
+                this->index_of[(t * (p + 1) + u) * (p + 1) + v] = this->index_t.size();
+                this->index_t.push_back(t);
+                this->index_u.push_back(u);
+                this->index_v.push_back(v);
+            }
+        }
+    }
+
+    this->coefficients = this->index_t.size();
+
+    this->inverse_factorial.assign(p + 1, 1.0);
+    for (int n = 1; n <= p; n++) {
+        this->inverse_factorial[n] = this->inverse_factorial[n - 1] / n;
+    }
+
+    // Every (target, source) term of the multipole to local translation with |alpha| + |beta| <= p
+    for (int target = 0; target < this->coefficients; target++) {
+        for (int source = 0; source < this->coefficients; source++) {
+            int t = this->index_t[target] + this->index_t[source];
+            int u = this->index_u[target] + this->index_u[source];
+            int v = this->index_v[target] + this->index_v[source];
+
+            if (t + u + v <= p) {
+                int source_order = this->index_t[source] + this->index_u[source] + this->index_v[source];
+
+                this->m2l_target.push_back(target);
+                this->m2l_source.push_back(source);
+                this->m2l_sum.push_back(this->multi_index(t, u, v));
+                this->m2l_sign.push_back((source_order % 2 == 0) ? 1.0 : -1.0);
+            }
+        }
+    }
+}
+
+const char* FastMultipoleSolver::name() const {
+    return "fmm";
+}
+
+int FastMultipoleSolver::multi_index(int t, int u, int v) const {
+    int p = this->order;
+
+    return this->index_of[(t * (p + 1) + u) * (p + 1) + v];
+}
+
+void FastMultipoleSolver::powers(double X, double Y, double Z, double* P) const {
+    // P[k] = X^t Y^u Z^v / (t! u! v!)
+    double scaled_x[max_fmm_order + 1];
+    double scaled_y[max_fmm_order + 1];
+    double scaled_z[max_fmm_order + 1];
+
+    scaled_x[0] = 1.0;
+    scaled_y[0] = 1.0;
+    scaled_z[0] = 1.0;
+
+    for (int n = 1; n <= this->order; n++) {
+        scaled_x[n] = scaled_x[n - 1] * X / n;
+        scaled_y[n] = scaled_y[n - 1] * Y / n;
+        scaled_z[n] = scaled_z[n - 1] * Z / n;
+    }
+
+    for (int k = 0; k < this->coefficients; k++) {
+        P[k] = scaled_x[this->index_t[k]] * scaled_y[this->index_u[k]] * scaled_z[this->index_v[k]];
+    }
+
+    return;
+}
+
+void FastMultipoleSolver::derivatives(double X, double Y, double Z, double* D) const {
+    // Cartesian derivatives of 1/r through the McMurchie-Davidson recurrence on auxiliary R^n_tuv
+    int p = this->order;
+    int stride = this->coefficients;
+    double R[(max_fmm_order + 1) * (max_fmm_order + 1) * (max_fmm_order + 2) * (max_fmm_order + 3) / 6];
+
+    double r_inv = 1.0 / std::sqrt(X * X + Y * Y + Z * Z);
+    double r_inv2 = r_inv * r_inv;
+    double base = r_inv;
+
+    // R^n_000 = (-1)^n (2n - 1)!! / r^(2n + 1)
+    for (int n = 0; n <= p; n++) {
+        R[n * stride] = base;
+        base *= -(2 * n + 1) * r_inv2;
+    }
+
+    for (int n = p - 1; n >= 0; n--) {
+        double* current = R + n * stride;
+        const double* next = R + (n + 1) * stride;
+
+        for (int k = 1; k < stride; k++) {
+            int t = this->index_t[k];
+            int u = this->index_u[k];
+            int v = this->index_v[k];
+
+            if (t + u + v > p - n) {
+                break;
+            }
+
+            if (t > 0) {
+                current[k] = X * next[this->multi_index(t - 1, u, v)] + ((t > 1) ? (t - 1) * next[this->multi_index(t - 2, u, v)] : 0.0);
+            }
+            else if (u > 0) {
+                current[k] = Y * next[this->multi_index(t, u - 1, v)] + ((u > 1) ? (u - 1) * next[this->multi_index(t, u - 2, v)] : 0.0);
+            }
+            else {
+                current[k] = Z * next[this->multi_index(t, u, v - 1)] + ((v > 1) ? (v - 1) * next[this->multi_index(t, u, v - 2)] : 0.0);
+            }
+        }
+    }
+
+    for (int k = 0; k < stride; k++) {
+        D[k] = R[k];
+    }
+
+    return;
+}
+
+void FastMultipoleSolver::particles_to_multipole(const BodySystem& system, int leaf) {
+    const OctreeNode& cell = this->tree.nodes[leaf];
+    double* M = &this->multipoles[leaf * this->coefficients];
+    double P[(max_fmm_order + 1) * (max_fmm_order + 2) * (max_fmm_order + 3) / 6];
+    double max_distance = 0.0;
+
+    // Particle to multipole about the cell's center of mass
+    for (int k = cell.begin; k < cell.end; k++) {
+        int body = this->tree.order[k];
+        double d[3] = {system.x[body] - cell.com[0], system.y[body] - cell.com[1], system.z[body] - cell.com[2]};
+
+        this->powers(d[0], d[1], d[2], P);
+
+        for (int c = 0; c < this->coefficients; c++) {
+            M[c] += system.mass[body] * P[c];
+        }
+
+        max_distance = std::fmax(max_distance, std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+    }
+
+    this->radius[leaf] = max_distance;
+
+    return;
+}
+
+void FastMultipoleSolver::children_to_multipole(int node) {
+    const OctreeNode& cell = this->tree.nodes[node];
+    double* M = &this->multipoles[node * this->coefficients];
+    double P[(max_fmm_order + 1) * (max_fmm_order + 2) * (max_fmm_order + 3) / 6];
+    double max_distance = 0.0;
+
+    for (int octant = 0; octant < 8; octant++) {
+        int child = cell.first_child + octant;
+        const OctreeNode& child_cell = this->tree.nodes[child];
+
+        if (child_cell.end == child_cell.begin) {
+            continue;
+        }
+
+        // Multipole to multipole shift from the child's center of mass to the parent's
+        double d[3] = {child_cell.com[0] - cell.com[0], child_cell.com[1] - cell.com[1], child_cell.com[2] - cell.com[2]};
+        const double* child_M = &this->multipoles[child * this->coefficients];
+
+        this->powers(d[0], d[1], d[2], P);
+
+        for (int a = 0; a < this->coefficients; a++) {
+            for (int b = 0; b <= a; b++) {
+                int t = this->index_t[a] - this->index_t[b];
+                int u = this->index_u[a] - this->index_u[b];
+                int v = this->index_v[a] - this->index_v[b];
+
+                if (t >= 0 && u >= 0 && v >= 0) {
+                    M[a] += child_M[b] * P[this->multi_index(t, u, v)];
+                }
+            }
+        }
+
+        double shift = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        max_distance = std::fmax(max_distance, shift + this->radius[child]);
+    }
+
+    // Never looser than the farthest corner of the cell seen from its center of mass
+    double corner_distance = cell.com_offset + std::sqrt(3.0) * cell.half_size;
+    this->radius[node] = std::fmin(max_distance, corner_distance);
+
+    return;
+}
+
+void FastMultipoleSolver::upward_pass(const BodySystem& system, int node, int max_count, bool above_subtrees) {
+    const OctreeNode& cell = this->tree.nodes[node];
+
+    if (above_subtrees && this->is_subtree_root(node, max_count)) {
+        return;
+    }
+
+    if (cell.first_child == -1) {
+        this->particles_to_multipole(system, node);
+        return;
+    }
+
+    for (int octant = 0; octant < 8; octant++) {
+        int child = cell.first_child + octant;
+
+        if (this->tree.nodes[child].end > this->tree.nodes[child].begin) {
+            this->upward_pass(system, child, max_count, above_subtrees);
+        }
+    }
+
+    this->children_to_multipole(node);
+
+    return;
+}
+
+void FastMultipoleSolver::interact(int target, int source) {
+    const OctreeNode& target_cell = this->tree.nodes[target];
+    const OctreeNode& source_cell = this->tree.nodes[source];
+
+    int target_count = target_cell.end - target_cell.begin;
+    int source_count = source_cell.end - source_cell.begin;
+
+    if (target_count == 0 || source_count == 0 || source_cell.mass <= 0.0) {
+        return;
+    }
+
+    double d[3] = {target_cell.com[0] - source_cell.com[0], target_cell.com[1] - source_cell.com[1], target_cell.com[2] - source_cell.com[2]};
+    double distance = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    bool both_leaves = target_cell.first_child == -1 && source_cell.first_child == -1;
+
+    // Cells whose bodies could come within the softening are opened, expansions ignore it
+    bool separated = target != source && this->radius[target] + this->radius[source] < this->opening_angle * distance
+        && distance - this->radius[target] - this->radius[source] >= softening_cells * this->walk_softening;
+
+    // Small leaf pairs are cheaper to sum directly than to translate
+    if (separated && !(both_leaves && target_count * source_count <= (int)this->m2l_target.size())) {
+        this->m2l_pairs.push_back(target);
+        this->m2l_pairs.push_back(source);
+        return;
+    }
+
+    if (both_leaves) {
+        this->p2p_pairs.push_back(target);
+        this->p2p_pairs.push_back(source);
+        return;
+    }
+
+    if (target == source) {
+        for (int a = 0; a < 8; a++) {
+            for (int b = 0; b < 8; b++) {
+                this->interact(target_cell.first_child + a, source_cell.first_child + b);
+            }
+        }
+
+        return;
+    }
+
+    // Split whichever cell is larger, unless it is a leaf
+    if (source_cell.first_child == -1 || (target_cell.first_child != -1 && this->radius[target] >= this->radius[source])) {
+        for (int a = 0; a < 8; a++) {
+            this->interact(target_cell.first_child + a, source);
+        }
+    }
+    else {
+        for (int b = 0; b < 8; b++) {
+            this->interact(target, source_cell.first_child + b);
+        }
+    }
+
+    return;
+}
+
+void FastMultipoleSolver::multipole_to_local(int target, int source, double G_const) {
+    const OctreeNode& target_cell = this->tree.nodes[target];
+    const OctreeNode& source_cell = this->tree.nodes[source];
+
+    double d[3] = {target_cell.com[0] - source_cell.com[0], target_cell.com[1] - source_cell.com[1], target_cell.com[2] - source_cell.com[2]};
+    double D[(max_fmm_order + 1) * (max_fmm_order + 2) * (max_fmm_order + 3) / 6];
+    double* L = &this->locals[target * this->coefficients];
+    const double* M = &this->multipoles[source * this->coefficients];
+
+    this->derivatives(d[0], d[1], d[2], D);
+
+    int terms = this->m2l_target.size();
+    for (int k = 0; k < terms; k++) {
+        L[this->m2l_target[k]] -= G_const * this->m2l_sign[k] * M[this->m2l_source[k]] * D[this->m2l_sum[k]];
+    }
+
+    return;
+}
+
+void FastMultipoleSolver::particles_to_particles(const BodySystem& system, int target, int source, double G_const, double eps2, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az) {
+    const OctreeNode& target_cell = this->tree.nodes[target];
+    const OctreeNode& source_cell = this->tree.nodes[source];
+
+    for (int i = target_cell.begin; i < target_cell.end; i++) {
+        int body = this->tree.order[i];
+        double gravity[3] = {0.0, 0.0, 0.0};
+
+        for (int j = source_cell.begin; j < source_cell.end; j++) {
+            int other = this->tree.order[j];
+
+            if (other == body) {
+                continue;
+            }
+
+            double R[3] = {system.x[other] - system.x[body], system.y[other] - system.y[body], system.z[other] - system.z[body]};
+            double R2 = R[0] * R[0] + R[1] * R[1] + R[2] * R[2] + eps2;
+
+            // Distinct bodies at the same position contribute no force, as in the direct kernel
+            if (R2 <= min_kernel_r2) {
+                continue;
+            }
+
+            double R_inv = 1.0 / std::sqrt(R2);
+            double gravity_total = G_const * system.mass[other] * R_inv * R_inv * R_inv;
+
+            gravity[0] += gravity_total * R[0];
+            gravity[1] += gravity_total * R[1];
+            gravity[2] += gravity_total * R[2];
+        }
+
+        ax[body] += gravity[0];
+        ay[body] += gravity[1];
+        az[body] += gravity[2];
+    }
+
+    return;
+}
+
+void FastMultipoleSolver::local_to_children(int node) {
+    const OctreeNode& cell = this->tree.nodes[node];
+    const double* L = &this->locals[node * this->coefficients];
+    double P[(max_fmm_order + 1) * (max_fmm_order + 2) * (max_fmm_order + 3) / 6];
+
+    for (int octant = 0; octant < 8; octant++) {
+        int child = cell.first_child + octant;
+        const OctreeNode& child_cell = this->tree.nodes[child];
+
+        if (child_cell.end == child_cell.begin) {
+            continue;
+        }
+
+        // Local to local shift from the parent's center of mass to the child's
+        double d[3] = {child_cell.com[0] - cell.com[0], child_cell.com[1] - cell.com[1], child_cell.com[2] - cell.com[2]};
+        double* child_L = &this->locals[child * this->coefficients];
+
+        this->powers(d[0], d[1], d[2], P);
+
+        for (int b = 0; b < this->coefficients; b++) {
+            for (int g = 0; g < this->coefficients; g++) {
+                int t = this->index_t[b] + this->index_t[g];
+                int u = this->index_u[b] + this->index_u[g];
+                int v = this->index_v[b] + this->index_v[g];
+
+                if (t + u + v > this->order) {
+                    break;
+                }
+
+                child_L[b] += L[this->multi_index(t, u, v)] * P[g];
+            }
+        }
+    }
+
+    return;
+}
+
+void FastMultipoleSolver::local_to_particles(const BodySystem& system, int leaf, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az) {
+    const OctreeNode& cell = this->tree.nodes[leaf];
+    const double* L = &this->locals[leaf * this->coefficients];
+    double P[(max_fmm_order + 1) * (max_fmm_order + 2) * (max_fmm_order + 3) / 6];
+
+    // Local expansion to particle, the acceleration is minus the gradient of the potential
+    for (int k = cell.begin; k < cell.end; k++) {
+        int body = this->tree.order[k];
+        double d[3] = {system.x[body] - cell.com[0], system.y[body] - cell.com[1], system.z[body] - cell.com[2]};
+        double gradient[3] = {0.0, 0.0, 0.0};
+
+        this->powers(d[0], d[1], d[2], P);
+
+        for (int c = 0; c < this->coefficients; c++) {
+            int t = this->index_t[c];
+            int u = this->index_u[c];
+            int v = this->index_v[c];
+
+            if (t + u + v >= this->order) {
+                break;
+            }
+
+            gradient[0] += L[this->multi_index(t + 1, u, v)] * P[c];
+            gradient[1] += L[this->multi_index(t, u + 1, v)] * P[c];
+            gradient[2] += L[this->multi_index(t, u, v + 1)] * P[c];
+        }
+
+        ax[body] -= gradient[0];
+        ay[body] -= gradient[1];
+        az[body] -= gradient[2];
+    }
+
+    return;
+}
+
+void FastMultipoleSolver::downward_pass(const BodySystem& system, int node, int max_count, bool above_subtrees, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az) {
+    const OctreeNode& cell = this->tree.nodes[node];
+
+    if (above_subtrees && this->is_subtree_root(node, max_count)) {
+        return;
+    }
+
+    if (cell.first_child == -1) {
+        this->local_to_particles(system, node, ax, ay, az);
+        return;
+    }
+
+    this->local_to_children(node);
+
+    for (int octant = 0; octant < 8; octant++) {
+        int child = cell.first_child + octant;
+
+        if (this->tree.nodes[child].end > this->tree.nodes[child].begin) {
+            this->downward_pass(system, child, max_count, above_subtrees, ax, ay, az);
+        }
+    }
+
+    return;
+}
+
+bool FastMultipoleSolver::is_subtree_root(int node, int max_count) const {
+    const OctreeNode& cell = this->tree.nodes[node];
+
+    return cell.first_child == -1 || cell.end - cell.begin <= max_count;
+}
+
+void FastMultipoleSolver::collect_subtrees(int node, int max_count, std::vector<int>& subtrees) const {
+    if (this->is_subtree_root(node, max_count)) {
+        subtrees.push_back(node);
+        return;
+    }
+
+    const OctreeNode& cell = this->tree.nodes[node];
+
+    for (int octant = 0; octant < 8; octant++) {
+        int child = cell.first_child + octant;
+
+        if (this->tree.nodes[child].end > this->tree.nodes[child].begin) {
+            this->collect_subtrees(child, max_count, subtrees);
+        }
+    }
+
+    return;
+}
+
+// Groups (target, source) pairs by target cell, keeping the walk order inside every group
+static void group_by_target(const std::vector<int>& pairs, int node_count, std::vector<int>& offsets, std::vector<int>& sources) {
+    int pair_count = pairs.size() / 2;
+
+    keep_headroom(offsets, node_count + 1);
+    keep_headroom(sources, pair_count);
+    offsets.assign(node_count + 1, 0);
+    sources.resize(pair_count);
+
+    for (int k = 0; k < pair_count; k++) {
+        offsets[pairs[2 * k] + 1]++;
+    }
+    for (int node = 0; node < node_count; node++) {
+        offsets[node + 1] += offsets[node];
+    }
+
+    // Every offset is advanced to the end of its group while filling and shifted back after, which needs no cursor array
+    for (int k = 0; k < pair_count; k++) {
+        sources[offsets[pairs[2 * k]]++] = pairs[2 * k + 1];
+    }
+    for (int node = node_count; node > 0; node--) {
+        offsets[node] = offsets[node - 1];
+    }
+    offsets[0] = 0;
+
+    return;
+}
+
+void FastMultipoleSolver::compute_accelerations(const BodySystem& system, double G_const, double softening, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az) {
+    int size = system.size();
+    double eps2 = softening * softening;
+
+    ax.assign(size, 0.0);
+    ay.assign(size, 0.0);
+    az.assign(size, 0.0);
+
+    if (size == 0) {
+        return;
+    }
+
+    this->tree.build(system);
+
+    int node_count = this->tree.nodes.size();
+    keep_headroom(this->multipoles, (size_t)node_count * this->coefficients);
+    keep_headroom(this->locals, (size_t)node_count * this->coefficients);
+    keep_headroom(this->radius, node_count);
+    this->multipoles.assign(node_count * this->coefficients, 0.0);
+    this->locals.assign(node_count * this->coefficients, 0.0);
+    this->radius.assign(node_count, 0.0);
+
+    // Subtrees below a fixed size are handed to the threads whole, chosen from the tree alone so results do not depend on the thread count
+    int max_count = std::max(this->tree.leaf_size, size / 256);
+    this->subtrees.clear();
+    this->collect_subtrees(0, max_count, this->subtrees);
+
+    parallel_for(this->pool, this->subtrees.size(), [&](int begin, int end, int) {
+        for (int k = begin; k < end; k++) {
+            this->upward_pass(system, this->subtrees[k], max_count, false);
+        }
+    });
+    this->upward_pass(system, 0, max_count, true);
+
+    // The dual tree walk only records interactions, they are then applied per target cell in parallel
+    this->walk_softening = softening;
+    keep_headroom(this->m2l_pairs, this->m2l_pairs.size());
+    keep_headroom(this->p2p_pairs, this->p2p_pairs.size());
+    this->m2l_pairs.clear();
+    this->p2p_pairs.clear();
+    this->interact(0, 0);
+
+    group_by_target(this->m2l_pairs, node_count, this->m2l_offsets, this->m2l_sources);
+    group_by_target(this->p2p_pairs, node_count, this->p2p_offsets, this->p2p_sources);
+
+    parallel_for(this->pool, node_count, [&](int begin, int end, int) {
+        for (int node = begin; node < end; node++) {
+            for (int k = this->m2l_offsets[node]; k < this->m2l_offsets[node + 1]; k++) {
+                this->multipole_to_local(node, this->m2l_sources[k], G_const);
+            }
+            for (int k = this->p2p_offsets[node]; k < this->p2p_offsets[node + 1]; k++) {
+                this->particles_to_particles(system, node, this->p2p_sources[k], G_const, eps2, ax, ay, az);
+            }
+        }
+    });
+
+    this->downward_pass(system, 0, max_count, true, ax, ay, az);
+    parallel_for(this->pool, this->subtrees.size(), [&](int begin, int end, int) {
+        for (int k = begin; k < end; k++) {
+            this->downward_pass(system, this->subtrees[k], max_count, false, ax, ay, az);
+        }
+    });
+
+    return;
+}
@@ -0,0 +1,75 @@
+#include "../include/ForceSolver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "../include/BodySystem.h"
+#include "../include/DirectSumKernel.h"
+#include "../include/ThreadPool.h"
+
+ForceSolver::ForceSolver() {
+    this->pool = nullptr;
+    this->warned_targets = false;
+}
+
+int ForceSolver::compute_target_accelerations(const BodySystem& system, double G_const, double softening, const std::vector<int>& targets, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az) {
+    if (!this->warned_targets && (int)targets.size() < system.size()) {
+        printf("Warning: the %s solver evaluates every body even when only some need new accelerations, block timesteps save no force evaluations with it\n", this->name());
+        this->warned_targets = true;
+    }
+
+    this->compute_accelerations(system, G_const, softening, this->scratch[0], this->scratch[1], this->scratch[2]);
+
+    for (int idx : targets) {
+        ax[idx] = this->scratch[0][idx];
+        ay[idx] = this->scratch[1][idx];
+        az[idx] = this->scratch[2][idx];
+    }
+
+    return system.size();
+}
+
+DirectSumSolver::DirectSumSolver() {
+    this->simd_level = detect_simd_level();
+}
+
+DirectSumSolver::DirectSumSolver(SimdLevel simd_level) {
+    this->simd_level = simd_level;
+}
+
+const char* DirectSumSolver::name() const {
+    return "direct";
+}
+
+void DirectSumSolver::compute_accelerations(const BodySystem& system, double G_const, double softening, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az) {
+    int size = system.size();
+
+    ax.resize(size);
+    ay.resize(size);
+    az.resize(size);
+
+    // Every target sums its sources in the same order whatever chunk it lands in, so results do not depend on the thread count
+    parallel_for(this->pool, size, [&](int begin, int end, int) {
+        direct_sum_accelerations(system.x.data(), system.y.data(), system.z.data(), system.mass.data(), size,
+            begin, end, G_const, softening * softening, ax.data(), ay.data(), az.data(), this->simd_level);
+    });
+
+    return;
+}
+
+int DirectSumSolver::compute_target_accelerations(const BodySystem& system, double G_const, double softening, const std::vector<int>& targets, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az) {
+    int size = system.size();
+
+    ax.resize(size);
+    ay.resize(size);
+    az.resize(size);
+
+    parallel_for(this->pool, targets.size(), [&](int begin, int end, int) {
+        for (int k = begin; k < end; k++) {
+            direct_sum_accelerations(system.x.data(), system.y.data(), system.z.data(), system.mass.data(), size,
+                targets[k], targets[k] + 1, G_const, softening * softening, ax.data(), ay.data(), az.data(), this->simd_level);
+        }
+    });
+
+    return targets.size();
+}
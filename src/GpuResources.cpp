@@ -0,0 +1,216 @@
+#include "../include/GpuResources.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glad/glad.h>
+
+// OpenGL objects are only touched from the thread owning the context, so plain counters suffice
+static GpuResourceCounts live_resources = {0, 0, 0, 0};
+
+GpuResourceCounts gpu_resource_counts() {
+    return live_resources;
+}
+
+void report_gpu_resources(const char* label) {
+    printf("GPU resources (%s): %d buffers, %d vertex arrays, %d textures, %.2f MB\n", label, live_resources.buffers, live_resources.vertex_arrays, live_resources.textures, live_resources.bytes / (1024.0 * 1024.0));
+
+    return;
+}
+
+GpuBuffer::GpuBuffer(GLenum target, GLenum usage) {
+    this->handle = 0;
+    this->target = target;
+    this->usage = usage;
+    this->bytes = 0;
+}
+
+GpuBuffer::~GpuBuffer() {
+    this->release();
+}
+
+GpuBuffer::GpuBuffer(GpuBuffer&& other) {
+    this->handle = other.handle;
+    this->target = other.target;
+    this->usage = other.usage;
+    this->bytes = other.bytes;
+
+    other.handle = 0;
+    other.bytes = 0;
+}
+
+GpuBuffer& GpuBuffer::operator=(GpuBuffer&& other) {
+    if (this != &other) {
+        this->release();
+
+        this->handle = other.handle;
+        this->target = other.target;
+        this->usage = other.usage;
+        this->bytes = other.bytes;
+
+        other.handle = 0;
+        other.bytes = 0;
+    }
+
+    return *this;
+}
+
+GLuint GpuBuffer::id() {
+    if (this->handle == 0) {
+        glGenBuffers(1, &this->handle);
+        live_resources.buffers++;
+    }
+
+    return this->handle;
+}
+
+long long GpuBuffer::size() const {
+    return this->bytes;
+}
+
+void GpuBuffer::bind() {
+    glBindBuffer(this->target, this->id());
+
+    return;
+}
+
+void GpuBuffer::upload(const void* data, long long bytes) {
+    this->bind();
+
+    if (bytes == this->bytes) {
+        // Orphaning hands the old storage back to the driver, the copy then goes into fresh storage of the same size
+        glBufferData(this->target, bytes, nullptr, this->usage);
+        glBufferSubData(this->target, 0, bytes, data);
+    }
+    else {
+        glBufferData(this->target, bytes, data, this->usage);
+
+        live_resources.bytes += bytes - this->bytes;
+        this->bytes = bytes;
+    }
+
+    return;
+}
+
+void GpuBuffer::update(long long offset, const void* data, long long bytes) {
+    this->bind();
+    glBufferSubData(this->target, offset, bytes, data);
+
+    return;
+}
+
+void GpuBuffer::release() {
+    if (this->handle != 0) {
+        glDeleteBuffers(1, &this->handle);
+
+        live_resources.buffers--;
+        live_resources.bytes -= this->bytes;
+    }
+
+    this->handle = 0;
+    this->bytes = 0;
+
+    return;
+}
+
+GpuVertexArray::GpuVertexArray() {
+    this->handle = 0;
+}
+
+GpuVertexArray::~GpuVertexArray() {
+    this->release();
+}
+
+GpuVertexArray::GpuVertexArray(GpuVertexArray&& other) {
+    this->handle = other.handle;
+    other.handle = 0;
+}
+
+GpuVertexArray& GpuVertexArray::operator=(GpuVertexArray&& other) {
+    if (this != &other) {
+        this->release();
+
+        this->handle = other.handle;
+        other.handle = 0;
+    }
+
+    return *this;
+}
+
+GLuint GpuVertexArray::id() {
+    if (this->handle == 0) {
+        glGenVertexArrays(1, &this->handle);
+        live_resources.vertex_arrays++;
+    }
+
+    return this->handle;
+}
+
+void GpuVertexArray::bind() {
+    glBindVertexArray(this->id());
+
+    return;
+}
+
+void GpuVertexArray::release() {
+    if (this->handle != 0) {
+        glDeleteVertexArrays(1, &this->handle);
+        live_resources.vertex_arrays--;
+    }
+
+    this->handle = 0;
+
+    return;
+}
+
+GpuTexture::GpuTexture(GLenum target) {
+    this->handle = 0;
+    this->target = target;
+}
+
+GpuTexture::~GpuTexture() {
+    this->release();
+}
+
+GpuTexture::GpuTexture(GpuTexture&& other) {
+    this->handle = other.handle;
+    this->target = other.target;
+    other.handle = 0;
+}
+
+GpuTexture& GpuTexture::operator=(GpuTexture&& other) {
+    if (this != &other) {
+        this->release();
+
+        this->handle = other.handle;
+        this->target = other.target;
+        other.handle = 0;
+    }
+
+    return *this;
+}
+
+GLuint GpuTexture::id() {
+    if (this->handle == 0) {
+        glGenTextures(1, &this->handle);
+        live_resources.textures++;
+    }
+
+    return this->handle;
+}
+
+void GpuTexture::bind() {
+    glBindTexture(this->target, this->id());
+
+    return;
+}
+
+void GpuTexture::release() {
+    if (this->handle != 0) {
+        glDeleteTextures(1, &this->handle);
+        live_resources.textures--;
+    }
+
+    this->handle = 0;
+
+    return;
+}
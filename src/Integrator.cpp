@@ -0,0 +1,627 @@
+#include "../include/Integrator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "../include/Simulation.h"
+#include "../include/DirectSumKernel.h"
+#include "../include/Kepler.h"
+#include "../include/ThreadPool.h"
+
+const char* EulerIntegrator::name() const {
+    return "euler";
+}
+
+void EulerIntegrator::step(Simulation& simulation) {
+    BodySystem& system = simulation.system;
+    int size = system.size();
+    double dt = simulation.time_step;
+
+    simulation.compute_accelerations();
+
+    for (int idx = 0; idx < size; idx++) {
+        system.x[idx] += (system.vx[idx] + 0.5 * simulation.ax[idx] * dt) * dt;
+        system.y[idx] += (system.vy[idx] + 0.5 * simulation.ay[idx] * dt) * dt;
+        system.z[idx] += (system.vz[idx] + 0.5 * simulation.az[idx] * dt) * dt;
+
+        system.vx[idx] += simulation.ax[idx] * dt;
+        system.vy[idx] += simulation.ay[idx] * dt;
+        system.vz[idx] += simulation.az[idx] * dt;
+    }
+
+    // Bodies moved after the evaluation, so the stored accelerations are stale
+    simulation.accelerations_current = false;
+
+    return;
+}
+
+const char* LeapfrogIntegrator::name() const {
+    return "leapfrog";
+}
+
+void LeapfrogIntegrator::step(Simulation& simulation) {
+    BodySystem& system = simulation.system;
+    int size = system.size();
+    double half_dt = 0.5 * simulation.time_step;
+    double dt = simulation.time_step;
+
+    if (!simulation.accelerations_current) {
+        simulation.compute_accelerations();
+    }
+
+    // Kick and drift
+    for (int idx = 0; idx < size; idx++) {
+        system.vx[idx] += simulation.ax[idx] * half_dt;
+        system.vy[idx] += simulation.ay[idx] * half_dt;
+        system.vz[idx] += simulation.az[idx] * half_dt;
+
+        system.x[idx] += system.vx[idx] * dt;
+        system.y[idx] += system.vy[idx] * dt;
+        system.z[idx] += system.vz[idx] * dt;
+    }
+
+    simulation.compute_accelerations();
+
+    // Kick
+    for (int idx = 0; idx < size; idx++) {
+        system.vx[idx] += simulation.ax[idx] * half_dt;
+        system.vy[idx] += simulation.ay[idx] * half_dt;
+        system.vz[idx] += simulation.az[idx] * half_dt;
+    }
+
+    return;
+}
+
+const char* HermiteIntegrator::name() const {
+    return "hermite";
+}
+
+void HermiteIntegrator::evaluate(Simulation& simulation) {
+    const BodySystem& system = simulation.system;
+    int size = system.size();
+    double eps2 = simulation.softening * simulation.softening;
+
+    simulation.ax.resize(size);
+    simulation.ay.resize(size);
+    simulation.az.resize(size);
+    this->jx.resize(size);
+    this->jy.resize(size);
+    this->jz.resize(size);
+
+    parallel_for(simulation.pool.get(), size, [&](int begin, int end, int) {
+        direct_sum_accelerations_jerks(system.x.data(), system.y.data(), system.z.data(), system.vx.data(), system.vy.data(), system.vz.data(),
+            system.mass.data(), size, begin, end, simulation.G_const, eps2,
+            simulation.ax.data(), simulation.ay.data(), simulation.az.data(), this->jx.data(), this->jy.data(), this->jz.data());
+    });
+
+    simulation.accelerations_current = true;
+    simulation.force_evaluations += size;
+
+    return;
+}
+
+int HermiteIntegrator::state_columns() const {
+    // Jerks exist once the first step evaluated them
+    return this->jx.empty() ? 0 : 3;
+}
+
+void HermiteIntegrator::save_state(int column, double* values) const {
+    const std::vector<double>* jerk[3] = {&this->jx, &this->jy, &this->jz};
+    std::copy(jerk[column]->begin(), jerk[column]->end(), values);
+
+    return;
+}
+
+void HermiteIntegrator::load_state(int column, const double* values, int size) {
+    std::vector<double>* jerk[3] = {&this->jx, &this->jy, &this->jz};
+    jerk[column]->assign(values, values + size);
+
+    return;
+}
+
+void HermiteIntegrator::step(Simulation& simulation) {
+    BodySystem& system = simulation.system;
+    int size = system.size();
+    double dt = simulation.time_step;
+    double dt2 = dt * dt;
+
+    // Jerks are only kept by this integrator, so they are stale whenever the accelerations are
+    if (!simulation.accelerations_current || (int)this->jx.size() != size) {
+        this->evaluate(simulation);
+    }
+
+    std::vector<double>* position[3] = {&system.x, &system.y, &system.z};
+    std::vector<double>* velocity[3] = {&system.vx, &system.vy, &system.vz};
+    std::vector<double>* acceleration[3] = {&simulation.ax, &simulation.ay, &simulation.az};
+    std::vector<double>* jerk[3] = {&this->jx, &this->jy, &this->jz};
+
+    // Predict
+    for (int axis = 0; axis < 3; axis++) {
+        this->old_x[axis] = *position[axis];
+        this->old_v[axis] = *velocity[axis];
+        this->old_a[axis] = *acceleration[axis];
+        this->old_j[axis] = *jerk[axis];
+
+        std::vector<double>& x = *position[axis];
+        std::vector<double>& v = *velocity[axis];
+        const std::vector<double>& a = *acceleration[axis];
+        const std::vector<double>& j = *jerk[axis];
+
+        for (int idx = 0; idx < size; idx++) {
+            x[idx] += v[idx] * dt + a[idx] * dt2 / 2.0 + j[idx] * dt2 * dt / 6.0;
+            v[idx] += a[idx] * dt + j[idx] * dt2 / 2.0;
+        }
+    }
+
+    this->evaluate(simulation);
+
+    // Correct, velocities first as the position corrector uses the new ones
+    for (int axis = 0; axis < 3; axis++) {
+        std::vector<double>& x = *position[axis];
+        std::vector<double>& v = *velocity[axis];
+        const std::vector<double>& a = *acceleration[axis];
+        const std::vector<double>& j = *jerk[axis];
+
+        for (int idx = 0; idx < size; idx++) {
+            v[idx] = this->old_v[axis][idx] + (this->old_a[axis][idx] + a[idx]) * dt / 2.0 + (this->old_j[axis][idx] - j[idx]) * dt2 / 12.0;
+            x[idx] = this->old_x[axis][idx] + (this->old_v[axis][idx] + v[idx]) * dt / 2.0 + (this->old_a[axis][idx] - a[idx]) * dt2 / 12.0;
+        }
+    }
+
+    // As in the usual PEC Hermite scheme the accelerations and jerks of the predicted state seed the next step
+    return;
+}
+
+const char* WisdomHolmanIntegrator::name() const {
+    return "wisdom_holman";
+}
+
+int WisdomHolmanIntegrator::host_of(const BodySystem& system, int idx) const {
+    int host = system.host[idx];
+
+    // Only planets of a star that is itself free are split off, anything else moves as its own system
+    if (host < 0 || host == idx || system.host[host] != -1) {
+        return -1;
+    }
+
+    return host;
+}
+
+void WisdomHolmanIntegrator::interaction_accelerations(Simulation& simulation) {
+    const BodySystem& system = simulation.system;
+    int size = system.size();
+    double eps2 = simulation.softening * simulation.softening;
+
+    simulation.ax.resize(size);
+    simulation.ay.resize(size);
+    simulation.az.resize(size);
+    for (int axis = 0; axis < 3; axis++) {
+        this->kick_a[axis].resize(size);
+    }
+
+    // Summed pair by pair instead of subtracting the host-planet terms from a solver's totals, so no
+    // error of an approximate solver ends up in the small interaction kicks. Every target sums its
+    // sources in the same order, so results do not depend on the thread count
+    parallel_for(simulation.pool.get(), size, [&](int begin, int end, int) {
+        for (int i = begin; i < end; i++) {
+            int host = this->host_of(system, i);
+            double total[3] = {0.0, 0.0, 0.0};
+            double interaction[3] = {0.0, 0.0, 0.0};
+
+            for (int j = 0; j < size; j++) {
+                if (j == i) {
+                    continue;
+                }
+
+                bool kepler = (j == host) || (this->host_of(system, j) == i);
+                double R[3] = {system.x[j] - system.x[i], system.y[j] - system.y[i], system.z[j] - system.z[i]};
+                double R2 = R[0] * R[0] + R[1] * R[1] + R[2] * R[2] + (kepler ? 0.0 : eps2);
+
+                if (R2 <= min_kernel_r2) {
+                    continue;
+                }
+
+                double factor = simulation.G_const * system.mass[j] / (R2 * std::sqrt(R2));
+
+                for (int axis = 0; axis < 3; axis++) {
+                    total[axis] += factor * R[axis];
+                    if (!kepler) {
+                        interaction[axis] += factor * R[axis];
+                    }
+                }
+            }
+
+            simulation.ax[i] = total[0];
+            simulation.ay[i] = total[1];
+            simulation.az[i] = total[2];
+            for (int axis = 0; axis < 3; axis++) {
+                this->kick_a[axis][i] = interaction[axis];
+            }
+        }
+    });
+
+    simulation.accelerations_current = true;
+    simulation.force_evaluations += size;
+
+    return;
+}
+
+void WisdomHolmanIntegrator::kick(BodySystem& system, double dt) {
+    int size = system.size();
+
+    // Interactions depend on positions only, so in these coordinates they kick the inertial velocities directly
+    for (int idx = 0; idx < size; idx++) {
+        system.vx[idx] += this->kick_a[0][idx] * dt;
+        system.vy[idx] += this->kick_a[1][idx] * dt;
+        system.vz[idx] += this->kick_a[2][idx] * dt;
+    }
+
+    return;
+}
+
+void WisdomHolmanIntegrator::to_heliocentric(const BodySystem& system) {
+    int size = system.size();
+    const std::vector<double>* position[3] = {&system.x, &system.y, &system.z};
+    const std::vector<double>* velocity[3] = {&system.vx, &system.vy, &system.vz};
+
+    this->total_mass.assign(size, 0.0);
+    for (int axis = 0; axis < 3; axis++) {
+        this->center[axis].assign(size, 0.0);
+        this->center_velocity[axis].assign(size, 0.0);
+        this->relative[axis].assign(size, 0.0);
+        this->relative_velocity[axis].assign(size, 0.0);
+    }
+
+    for (int idx = 0; idx < size; idx++) {
+        int host = this->host_of(system, idx);
+        int root = (host == -1) ? idx : host;
+
+        this->total_mass[root] += system.mass[idx];
+        for (int axis = 0; axis < 3; axis++) {
+            this->center[axis][root] += system.mass[idx] * (*position[axis])[idx];
+            this->center_velocity[axis][root] += system.mass[idx] * (*velocity[axis])[idx];
+        }
+    }
+
+    for (int idx = 0; idx < size; idx++) {
+        if (this->total_mass[idx] > 0.0) {
+            for (int axis = 0; axis < 3; axis++) {
+                this->center[axis][idx] /= this->total_mass[idx];
+                this->center_velocity[axis][idx] /= this->total_mass[idx];
+            }
+        }
+        else if (this->host_of(system, idx) == -1) {
+            // Massless free bodies still need a center to drift
+            for (int axis = 0; axis < 3; axis++) {
+                this->center[axis][idx] = (*position[axis])[idx];
+                this->center_velocity[axis][idx] = (*velocity[axis])[idx];
+            }
+        }
+    }
+
+    for (int idx = 0; idx < size; idx++) {
+        int host = this->host_of(system, idx);
+
+        if (host == -1) {
+            continue;
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            this->relative[axis][idx] = (*position[axis])[idx] - (*position[axis])[host];
+            this->relative_velocity[axis][idx] = (*velocity[axis])[idx] - this->center_velocity[axis][host];
+        }
+    }
+
+    return;
+}
+
+void WisdomHolmanIntegrator::jump(const BodySystem& system, double dt) {
+    int size = system.size();
+    std::vector<double>* momentum = this->planet_momentum;
+
+    for (int axis = 0; axis < 3; axis++) {
+        momentum[axis].assign(size, 0.0);
+    }
+
+    for (int idx = 0; idx < size; idx++) {
+        int host = this->host_of(system, idx);
+
+        if (host != -1) {
+            for (int axis = 0; axis < 3; axis++) {
+                momentum[axis][host] += system.mass[idx] * this->relative_velocity[axis][idx];
+            }
+        }
+    }
+
+    // The host carries the recoil of all its planets, which shifts every heliocentric position alike
+    for (int idx = 0; idx < size; idx++) {
+        int host = this->host_of(system, idx);
+
+        if (host != -1 && system.mass[host] > 0.0) {
+            for (int axis = 0; axis < 3; axis++) {
+                this->relative[axis][idx] += momentum[axis][host] / system.mass[host] * dt;
+            }
+        }
+    }
+
+    return;
+}
+
+void WisdomHolmanIntegrator::from_heliocentric(BodySystem& system) {
+    int size = system.size();
+    std::vector<double>* position[3] = {&system.x, &system.y, &system.z};
+    std::vector<double>* velocity[3] = {&system.vx, &system.vy, &system.vz};
+    std::vector<double>* offset = this->planet_offset;
+    std::vector<double>* recoil = this->planet_momentum;
+
+    for (int axis = 0; axis < 3; axis++) {
+        offset[axis].assign(size, 0.0);
+        recoil[axis].assign(size, 0.0);
+    }
+
+    for (int idx = 0; idx < size; idx++) {
+        int host = this->host_of(system, idx);
+
+        if (host != -1) {
+            for (int axis = 0; axis < 3; axis++) {
+                offset[axis][host] += system.mass[idx] * this->relative[axis][idx];
+                recoil[axis][host] += system.mass[idx] * this->relative_velocity[axis][idx];
+            }
+        }
+    }
+
+    // Roots first, so the planets can be placed relative to their host
+    for (int idx = 0; idx < size; idx++) {
+        if (this->host_of(system, idx) != -1) {
+            continue;
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            double host_offset = (this->total_mass[idx] > 0.0) ? offset[axis][idx] / this->total_mass[idx] : 0.0;
+            double host_recoil = (system.mass[idx] > 0.0) ? recoil[axis][idx] / system.mass[idx] : 0.0;
+
+            (*position[axis])[idx] = this->center[axis][idx] - host_offset;
+            (*velocity[axis])[idx] = this->center_velocity[axis][idx] - host_recoil;
+        }
+    }
+
+    for (int idx = 0; idx < size; idx++) {
+        int host = this->host_of(system, idx);
+
+        if (host == -1) {
+            continue;
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            (*position[axis])[idx] = (*position[axis])[host] + this->relative[axis][idx];
+            (*velocity[axis])[idx] = this->center_velocity[axis][host] + this->relative_velocity[axis][idx];
+        }
+    }
+
+    return;
+}
+
+void WisdomHolmanIntegrator::step(Simulation& simulation) {
+    BodySystem& system = simulation.system;
+    int size = system.size();
+    double dt = simulation.time_step;
+
+    if (!simulation.accelerations_current || (int)this->kick_a[0].size() != size) {
+        this->interaction_accelerations(simulation);
+    }
+
+    this->kick(system, 0.5 * dt);
+
+    this->to_heliocentric(system);
+    this->jump(system, 0.5 * dt);
+
+    for (int idx = 0; idx < size; idx++) {
+        int host = this->host_of(system, idx);
+
+        if (host == -1) {
+            for (int axis = 0; axis < 3; axis++) {
+                this->center[axis][idx] += this->center_velocity[axis][idx] * dt;
+            }
+            continue;
+        }
+
+        double position[3] = {this->relative[0][idx], this->relative[1][idx], this->relative[2][idx]};
+        double velocity[3] = {this->relative_velocity[0][idx], this->relative_velocity[1][idx], this->relative_velocity[2][idx]};
+
+        kepler_drift(simulation.G_const * system.mass[host], position, velocity, dt);
+
+        for (int axis = 0; axis < 3; axis++) {
+            this->relative[axis][idx] = position[axis];
+            this->relative_velocity[axis][idx] = velocity[axis];
+        }
+    }
+
+    this->jump(system, 0.5 * dt);
+    this->from_heliocentric(system);
+
+    this->interaction_accelerations(simulation);
+    this->kick(system, 0.5 * dt);
+
+    return;
+}
+
+BlockTimestepIntegrator::BlockTimestepIntegrator(double accuracy, int max_level) {
+    this->accuracy = accuracy;
+    this->max_level = std::max(0, std::min(max_level, 30));
+}
+
+const char* BlockTimestepIntegrator::name() const {
+    return "block_timestep";
+}
+
+int BlockTimestepIntegrator::state_columns() const {
+    return this->levels.empty() ? 0 : 1;
+}
+
+void BlockTimestepIntegrator::save_state(int, double* values) const {
+    // Levels, the only column, are small integers, exact as doubles
+    std::copy(this->levels.begin(), this->levels.end(), values);
+
+    return;
+}
+
+void BlockTimestepIntegrator::load_state(int, const double* values, int size) {
+    this->levels.resize(size);
+    for (int idx = 0; idx < size; idx++) {
+        this->levels[idx] = (int)values[idx];
+    }
+
+    return;
+}
+
+int BlockTimestepIntegrator::choose_level(double dt_max, double timestep) const {
+    if (!(timestep > 0.0)) {
+        return this->max_level;
+    }
+
+    int level = 0;
+    while (level < this->max_level && dt_max / (double)(1LL << level) > timestep) {
+        level++;
+    }
+
+    return level;
+}
+
+void BlockTimestepIntegrator::initialize_levels(Simulation& simulation) {
+    const BodySystem& system = simulation.system;
+    int size = system.size();
+
+    this->levels.assign(size, 0);
+
+    // Center of mass, the scale a body starting at rest falls through
+    double center[3] = {0.0, 0.0, 0.0};
+    double total_mass = 0.0;
+    for (int idx = 0; idx < size; idx++) {
+        center[0] += system.mass[idx] * system.x[idx];
+        center[1] += system.mass[idx] * system.y[idx];
+        center[2] += system.mass[idx] * system.z[idx];
+        total_mass += system.mass[idx];
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        center[axis] = (total_mass > 0.0) ? center[axis] / total_mass : 0.0;
+    }
+
+    // Without a history da/dt is unknown, |v| / |a| is the same orbital timescale for bound bodies. A body
+    // at rest would get no timestep at all from it, so it takes the time sqrt(r / |a|) to fall through its
+    // distance from the center of mass instead, and the global timestep if it sits at the center
+    for (int idx = 0; idx < size; idx++) {
+        double a = std::sqrt(simulation.ax[idx] * simulation.ax[idx] + simulation.ay[idx] * simulation.ay[idx] + simulation.az[idx] * simulation.az[idx]);
+        double v = std::sqrt(system.vx[idx] * system.vx[idx] + system.vy[idx] * system.vy[idx] + system.vz[idx] * system.vz[idx]);
+        double dx = system.x[idx] - center[0];
+        double dy = system.y[idx] - center[1];
+        double dz = system.z[idx] - center[2];
+        double r = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+        if (!(a > 0.0)) {
+            continue;
+        }
+
+        if (v > 0.0) {
+            this->levels[idx] = this->choose_level(simulation.time_step, this->accuracy * v / a);
+        }
+        else if (r > 0.0) {
+            this->levels[idx] = this->choose_level(simulation.time_step, this->accuracy * std::sqrt(r / a));
+        }
+    }
+
+    return;
+}
+
+void BlockTimestepIntegrator::step(Simulation& simulation) {
+    BodySystem& system = simulation.system;
+    int size = system.size();
+    double dt_max = simulation.time_step;
+
+    if (!simulation.accelerations_current || (int)this->levels.size() != size) {
+        if (!simulation.accelerations_current) {
+            simulation.compute_accelerations();
+        }
+        this->initialize_levels(simulation);
+    }
+
+    this->start_ax.resize(size);
+    this->start_ay.resize(size);
+    this->start_az.resize(size);
+
+    // Time is counted in ticks of the deepest level, a body on level k spans 2^(max_level - k) ticks
+    long long ticks = 1LL << this->max_level;
+    double tick_dt = dt_max / (double)ticks;
+    long long tick = 0;
+
+    while (tick < ticks) {
+        long long next = ticks;
+
+        // Opening kick of the bodies starting a timestep
+        for (int idx = 0; idx < size; idx++) {
+            long long stride = 1LL << (this->max_level - this->levels[idx]);
+
+            if (tick % stride == 0) {
+                double half_dt = 0.5 * stride * tick_dt;
+
+                system.vx[idx] += simulation.ax[idx] * half_dt;
+                system.vy[idx] += simulation.ay[idx] * half_dt;
+                system.vz[idx] += simulation.az[idx] * half_dt;
+
+                this->start_ax[idx] = simulation.ax[idx];
+                this->start_ay[idx] = simulation.ay[idx];
+                this->start_az[idx] = simulation.az[idx];
+            }
+
+            next = std::min(next, tick - tick % stride + stride);
+        }
+
+        // Every body drifts to the next time some of them end their timestep
+        double drift_dt = (double)(next - tick) * tick_dt;
+        for (int idx = 0; idx < size; idx++) {
+            system.x[idx] += system.vx[idx] * drift_dt;
+            system.y[idx] += system.vy[idx] * drift_dt;
+            system.z[idx] += system.vz[idx] * drift_dt;
+        }
+        tick = next;
+
+        this->active.clear();
+        for (int idx = 0; idx < size; idx++) {
+            if (tick % (1LL << (this->max_level - this->levels[idx])) == 0) {
+                this->active.push_back(idx);
+            }
+        }
+
+        simulation.compute_accelerations(this->active);
+
+        // Closing kick, then the next level from the change of acceleration over the finished timestep
+        for (int idx : this->active) {
+            long long stride = 1LL << (this->max_level - this->levels[idx]);
+            double dt = stride * tick_dt;
+
+            system.vx[idx] += simulation.ax[idx] * 0.5 * dt;
+            system.vy[idx] += simulation.ay[idx] * 0.5 * dt;
+            system.vz[idx] += simulation.az[idx] * 0.5 * dt;
+
+            double J[3] = {simulation.ax[idx] - this->start_ax[idx], simulation.ay[idx] - this->start_ay[idx], simulation.az[idx] - this->start_az[idx]};
+            double jerk = std::sqrt(J[0] * J[0] + J[1] * J[1] + J[2] * J[2]) / dt;
+            double a = std::sqrt(simulation.ax[idx] * simulation.ax[idx] + simulation.ay[idx] * simulation.ay[idx] + simulation.az[idx] * simulation.az[idx]);
+            int level = (jerk > 0.0) ? this->choose_level(dt_max, this->accuracy * a / jerk) : 0;
+
+            // Shorter timesteps start right away, longer ones only where their block boundaries line up
+            while (level < this->levels[idx] && tick % (2 * stride) == 0) {
+                this->levels[idx]--;
+                stride *= 2;
+            }
+            if (level > this->levels[idx]) {
+                this->levels[idx] = level;
+            }
+        }
+    }
+
+    // The last tick ends every level, so all accelerations belong to the synchronized positions
+    simulation.accelerations_current = true;
+
+    return;
+}
@@ -0,0 +1,95 @@
+#include "../include/Kepler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+
+// Stumpff functions C(z) and S(z), by their series near z = 0 where the closed forms cancel badly
+static void stumpff(double z, double& C, double& S) {
+    if (std::fabs(z) < 0.1) {
+        C = 1.0 / 2.0 - z * (1.0 / 24.0 - z * (1.0 / 720.0 - z * (1.0 / 40320.0 - z / 3628800.0)));
+        S = 1.0 / 6.0 - z * (1.0 / 120.0 - z * (1.0 / 5040.0 - z * (1.0 / 362880.0 - z / 39916800.0)));
+    }
+    else if (z > 0.0) {
+        double root = std::sqrt(z);
+        C = (1.0 - std::cos(root)) / z;
+        S = (root - std::sin(root)) / (root * z);
+    }
+    else {
+        double root = std::sqrt(-z);
+        C = (std::cosh(root) - 1.0) / (-z);
+        S = (std::sinh(root) - root) / (root * -z);
+    }
+
+    return;
+}
+
+void kepler_drift(double mu, double position[3], double velocity[3], double dt) {
+    double r0 = std::sqrt(position[0] * position[0] + position[1] * position[1] + position[2] * position[2]);
+    double v2 = velocity[0] * velocity[0] + velocity[1] * velocity[1] + velocity[2] * velocity[2];
+
+    if (mu <= 0.0 || r0 <= 0.0 || dt == 0.0) {
+        for (int axis = 0; axis < 3; axis++) {
+            position[axis] += velocity[axis] * dt;
+        }
+        return;
+    }
+
+    double sqrt_mu = std::sqrt(mu);
+    double sigma = (position[0] * velocity[0] + position[1] * velocity[1] + position[2] * velocity[2]) / sqrt_mu;
+    double alpha = 2.0 / r0 - v2 / mu;
+
+    // Whole periods of bound orbits are dropped so chi stays small and well conditioned
+    if (alpha > 0.0) {
+        double period = 2.0 * 3.14159265358979323846 / (sqrt_mu * alpha * std::sqrt(alpha));
+        dt = std::fmod(dt, period);
+    }
+
+    // Universal anomaly chi solves F(chi) = sigma chi^2 C + (1 - alpha r0) chi^3 S + r0 chi - sqrt(mu) dt = 0
+    double chi = (alpha > 0.0) ? sqrt_mu * alpha * dt : sqrt_mu * dt / r0;
+    double C = 0.5;
+    double S = 1.0 / 6.0;
+
+    // Laguerre-Conway iterations converge from poor starting guesses where Newton can cycle
+    for (int iteration = 0; iteration < 50; iteration++) {
+        double z = alpha * chi * chi;
+        stumpff(z, C, S);
+
+        double F = sigma * chi * chi * C + (1.0 - alpha * r0) * chi * chi * chi * S + r0 * chi - sqrt_mu * dt;
+        double dF = sigma * chi * (1.0 - z * S) + (1.0 - alpha * r0) * chi * chi * C + r0;
+        double ddF = sigma * (1.0 - z * C) + (1.0 - alpha * r0) * chi * (1.0 - z * S);
+
+        double n = 5.0;
+        double root = std::sqrt(std::fabs((n - 1.0) * (n - 1.0) * dF * dF - n * (n - 1.0) * F * ddF));
+        double delta = n * F / (dF + ((dF >= 0.0) ? root : -root));
+
+        chi -= delta;
+
+        if (std::fabs(delta) <= 1e-15 * std::fabs(chi) + 1e-300) {
+            break;
+        }
+    }
+
+    double z = alpha * chi * chi;
+    stumpff(z, C, S);
+
+    // Lagrange coefficients map the initial state to the state after dt
+    double f = 1.0 - chi * chi * C / r0;
+    double g = dt - chi * chi * chi * S / sqrt_mu;
+
+    double new_position[3];
+    for (int axis = 0; axis < 3; axis++) {
+        new_position[axis] = f * position[axis] + g * velocity[axis];
+    }
+    double r = std::sqrt(new_position[0] * new_position[0] + new_position[1] * new_position[1] + new_position[2] * new_position[2]);
+
+    double df = sqrt_mu / (r * r0) * chi * (z * S - 1.0);
+    double dg = 1.0 - chi * chi * C / r;
+
+    for (int axis = 0; axis < 3; axis++) {
+        double new_velocity = df * position[axis] + dg * velocity[axis];
+        position[axis] = new_position[axis];
+        velocity[axis] = new_velocity;
+    }
+
+    return;
+}
@@ -2,9 +2,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <vector>
-#include "../include/json.hpp"
-#include <fstream>
 #include <string>
+#include "../include/BodySystem.h"
+#include "../include/GpuResources.h"
 
 #include <glad/glad.h>
 #include <glm/gtc/type_ptr.hpp>
@@ -16,27 +16,19 @@ int rowsCount = 20;
 int columnsCount = 30;
 float precision = 1000.0;
 
-Body::Body(std::string name, float mass, float diameter, glm::vec3 position, glm::vec3 init_velocity, std::vector<float> color, GLuint shader, float time_step) {
+Body::Body(std::string name, float mass, float diameter, glm::vec3 position, std::vector<float> color) {
     this->name = name;
     this->mass = mass;
 
     this->position = position;
     this->diameter = diameter;
-    this->velocity = init_velocity;
     this->color = color;
 
-    this->shader = shader;
-
-    this->time_step = time_step;
-
-    this->compute_vertices();
-    this->create_body();
-
 }
 
-void Body::compute_vertices() {
-    // Emptying vertices data
-    std::vector<float>().swap(this->vertices);
+void Bodies::compute_vertices() {
+    // Unit sphere around the origin, every body scales and moves it in the vertex shader
+    this->vertices.clear();
 
     float rowStep = 2 * pi / rowsCount;
     float columnStep = pi / columnsCount;
@@ -49,46 +41,34 @@ void Body::compute_vertices() {
             // Vertex 1: (i, j)
             float columnAngle1 = (pi / 2) - (i * columnStep);
             float rowAngle1 = j * rowStep;
-            float r_cosphi1 = this->diameter * cosf(columnAngle1);
-            float x1 = r_cosphi1 * cosf(rowAngle1) + this->position.x;
-            float y1 = r_cosphi1 * sinf(rowAngle1) + this->position.y;
-            float z1 = this->diameter * sinf(columnAngle1) + this->position.z;
-            x1 = (x1 * precision) / precision;
-            y1 = (y1 * precision) / precision;
-            z1 = (z1 * precision) / precision;
+            float r_cosphi1 = cosf(columnAngle1);
+            float x1 = r_cosphi1 * cosf(rowAngle1);
+            float y1 = r_cosphi1 * sinf(rowAngle1);
+            float z1 = sinf(columnAngle1);
             
             // Vertex 2: (i+1, j)
             float columnAngle2 = (pi / 2) - ((i+1) * columnStep);
             float rowAngle2 = j * rowStep;
-            float r_cosphi2 = this->diameter * cosf(columnAngle2);
-            float x2 = r_cosphi2 * cosf(rowAngle2) + this->position.x;
-            float y2 = r_cosphi2 * sinf(rowAngle2) + this->position.y;
-            float z2 = this->diameter * sinf(columnAngle2) + this->position.z;
-            x2 = (x2 * precision) / precision;
-            y2 = (y2 * precision) / precision;
-            z2 = (z2 * precision) / precision;
+            float r_cosphi2 = cosf(columnAngle2);
+            float x2 = r_cosphi2 * cosf(rowAngle2);
+            float y2 = r_cosphi2 * sinf(rowAngle2);
+            float z2 = sinf(columnAngle2);
             
             // Vertex 3: (i, j+1)
             float columnAngle3 = (pi / 2) - (i * columnStep);
             float rowAngle3 = (j+1) * rowStep;
-            float r_cosphi3 = this->diameter * cosf(columnAngle3);
-            float x3 = r_cosphi3 * cosf(rowAngle3) + this->position.x;
-            float y3 = r_cosphi3 * sinf(rowAngle3) + this->position.y;
-            float z3 = this->diameter * sinf(columnAngle3) + this->position.z;
-            x3 = (x3 * precision) / precision;
-            y3 = (y3 * precision) / precision;
-            z3 = (z3 * precision) / precision;
+            float r_cosphi3 = cosf(columnAngle3);
+            float x3 = r_cosphi3 * cosf(rowAngle3);
+            float y3 = r_cosphi3 * sinf(rowAngle3);
+            float z3 = sinf(columnAngle3);
             
             // Vertex 4: (i+1, j+1)
             float columnAngle4 = (pi / 2) - ((i+1) * columnStep);
             float rowAngle4 = (j+1) * rowStep;
-            float r_cosphi4 = this->diameter * cosf(columnAngle4);
-            float x4 = r_cosphi4 * cosf(rowAngle4) + this->position.x;
-            float y4 = r_cosphi4 * sinf(rowAngle4) + this->position.y;
-            float z4 = this->diameter * sinf(columnAngle4) + this->position.z;
-            x4 = (x4 * precision) / precision;
-            y4 = (y4 * precision) / precision;
-            z4 = (z4 * precision) / precision;
+            float r_cosphi4 = cosf(columnAngle4);
+            float x4 = r_cosphi4 * cosf(rowAngle4);
+            float y4 = r_cosphi4 * sinf(rowAngle4);
+            float z4 = sinf(columnAngle4);
             
             // First triangle
             vertices.push_back(x1);
@@ -121,131 +101,104 @@ void Body::compute_vertices() {
     return;
 }
 
-void Body::draw_body() {
-
-    glUniform4f(glGetUniformLocation(this->shader, "currentColor"), this->color[0], this->color[1], this->color[2], this->color[3]);
-    glBindVertexArray(this->VAO);
-    glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 3);
+void Body::update_body(glm::vec3 position) {
+    // Physics is stepped by the Simulation core, the body only follows its new position
+    this->position = position;
 
     return;
 }
 
-void Body::create_body() {
-    glGenVertexArrays(1, &this->VAO);
-    glGenBuffers(1, &this->VBO);
 
-    glBindVertexArray(this->VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-    glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(float), this->vertices.data(), GL_STATIC_DRAW);
+Bodies::Bodies(const BodySystem& system, GLuint shader) : meshVBO(GL_ARRAY_BUFFER, GL_STATIC_DRAW), instanceVBO(GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW) {
+    int size = system.size();
+
+    for (int idx = 0; idx < size; idx++) {
+        // Centers start in the y = 0 plane, drawn half a diameter up so every body still rests on the fabric
+        glm::vec3 position = glm::vec3(system.x[idx], system.y[idx] + system.diameter[idx] / 2, system.z[idx]);
+
+        Body body(system.names[idx], system.mass[idx], system.diameter[idx], position, system.color[idx]);
+        this->bodies.push_back(body);
+    }
+
+    this->shader = shader;
+    this->instances.assign(size * instanceFloats, 0.0f);
+
+    this->compute_vertices();
+    this->create_bodies();
+    this->update_bodies(system.view());
+}
+
+const std::vector<Body>& Bodies::get_bodies() const {
+    return this->bodies;
+}
+
+void Bodies::create_bodies() {
+    this->VAO.bind();
+
+    // Shared sphere mesh, uploaded once
+    this->meshVBO.upload(this->vertices.data(), this->vertices.size() * sizeof(float));
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
+    // Center and radius, then color, advancing once per body instead of once per vertex
+    this->instanceVBO.upload(this->instances.data(), this->instances.size() * sizeof(float));
+
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, instanceFloats * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, instanceFloats * sizeof(float), (void*)(4 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
     glBindVertexArray(0);
 
     return;
 }
 
-void Body::update_body(std::vector<Body> bodies, int bodies_num, float G_const) {
-    glm::vec3 gravity = glm::vec3(0.0, 0.0, 0.0);
-    float gravity_total;
-    glm::vec3 R;
-    float R_total;
-    glm::vec3 previous_velocity = this->velocity;
-
-    for (int idx = 0; idx < bodies_num; idx++) {
-        if (bodies[idx].name != this->name) {
-            R = glm::vec3(this->position[0] - bodies[idx].position[0], this->position[1], this->position[2] - bodies[idx].position[2]);
-            R_total = glm::sqrt(glm::pow(R[0], 2) + glm::pow(R[1], 2) + glm::pow(R[2], 2));
-
-            gravity_total = -(G_const * bodies[idx].mass) / (glm::pow(R_total, 3));
-            gravity += glm::vec3(gravity_total * R[0], 0, gravity_total * R[2]);
-            gravity = (gravity * precision) / precision;
-        }
-    }
-
-    this->velocity += gravity * this->time_step;
-    this->velocity = (this->velocity * precision) / precision;
-    this->position += (previous_velocity * this->time_step) + glm::vec3(gravity[0] * 0.5, 0, gravity[2] * 0.5) * (this->time_step * this->time_step);
-
-    this->compute_vertices();
-    this->create_body();
+void Bodies::update_bodies(const BodyView& state) {
+    this->compute_instances(state);
+    this->upload_instances();
 
     return;
 }
 
+void Bodies::compute_instances(const BodyView& state) {
+    // Only CPU memory is touched, so this can run off the thread owning the OpenGL context
+    int size = this->bodies.size();
 
-Bodies::Bodies(const std::string filename, float E_val_km, float E_val_kg, GLuint shader, float time_step) {
-    // Power of 10 value of measurement in km and kg
-    this->E_val_km = E_val_km;
-    this->E_val_kg = E_val_kg;
-
-    std::ifstream inFile(filename);
-    nlohmann::json json_file;
-    inFile >> json_file;
-
-    float diameter;
-
-    std::string name;
-    float mass;
-    std::vector<std::string> stars_name;
-    std::vector<std::vector<float>> stars_posn;
-    float init_distance_x;
-    float init_distance_z;
-    glm::vec3 init_velocity;
-    std::vector<float> color;
-    std::string system;
-
-    for (auto& star : json_file["stars"]) {
-        name = star["name"];
-        mass = float(star["mass (kg)"]) / this->E_val_kg;
-        diameter = float(star["diameter (km)"]) / this->E_val_km;
-        color = {star["color"][0], star["color"][1], star["color"][2], star["color"][3]};
-        init_distance_x = float(star["center position (km)"][0]) / this->E_val_km;
-        init_distance_z = float(star["center position (km)"][1]) / this->E_val_km;
-        init_velocity = glm::vec3(float(star["init_velocity (km/s)"][0]) / this->E_val_km, float(star["init_velocity (km/s)"][1]) / this->E_val_km, float(star["init_velocity (km/s)"][2]) / this->E_val_km);
-
-        stars_posn.push_back({init_distance_x, diameter / 2, init_distance_z});
-        stars_name.push_back(name);
-
-        Body body(name, mass, diameter, glm::vec3(init_distance_x, diameter / 2, init_distance_z), init_velocity, color, shader, time_step);
-        this->bodies.push_back(body);
-    }
+    for (int idx = 0; idx < size; idx++) {
+        Body& body = this->bodies[idx];
+        body.update_body(glm::vec3(state.x[idx], state.y[idx] + body.diameter / 2, state.z[idx]));
 
-    for (auto& planet : json_file["planets"]) {
-        name = planet["name"];
-        mass = float(planet["mass (kg)"]) / this->E_val_kg;
-        diameter = float(planet["diameter (km)"]) / this->E_val_km;
-        init_distance_x = float(planet["init_distance (km)"]) / this->E_val_km;
-        init_distance_z = 0;
-        init_velocity = glm::vec3(float(planet["init_velocity (km/s)"][0]) / this->E_val_km, float(planet["init_velocity (km/s)"][1]) / this->E_val_km, float(planet["init_velocity (km/s)"][2]) / this->E_val_km);
-        color = {planet["color"][0], planet["color"][1], planet["color"][2], planet["color"][3]};
-        system = planet["system"];
-        int temp_i = this->find_body_index(stars_name, system);
-
-        if (temp_i != -1) {
-            init_distance_x += stars_posn[temp_i][0];
-            init_distance_z += stars_posn[temp_i][2];
+        float* instance = &this->instances[idx * instanceFloats];
+        instance[0] = body.position.x;
+        instance[1] = body.position.y;
+        instance[2] = body.position.z;
+        // The sphere used to be built with the diameter as its radius, kept so bodies look the same
+        instance[3] = body.diameter;
+
+        for (int channel = 0; channel < 4; channel++) {
+            instance[4 + channel] = body.color[channel];
         }
-        
-        Body body(name, mass, diameter, glm::vec3(init_distance_x, diameter / 2, init_distance_z), init_velocity, color, shader, time_step);
-        this->bodies.push_back(body);
     }
+
+    return;
 }
 
-int Bodies::find_body_index(std::vector<std::string> body_names, std::string name) {
-    int size = body_names.size();
+void Bodies::upload_instances() {
+    // Same sized upload into the existing buffer every frame, no buffer objects are created
+    this->instanceVBO.upload(this->instances.data(), this->instances.size() * sizeof(float));
 
-    for (int i = 0; i < size; i++) {
+    return;
+}
 
-        if (body_names[i] == name) {
-            return i;
-        }
-    }
+void Bodies::draw_bodies() {
+    glUseProgram(this->shader);
+    this->VAO.bind();
+    glDrawArraysInstanced(GL_TRIANGLES, 0, this->vertices.size() / 3, this->bodies.size());
+    glBindVertexArray(0);
 
-    return -1;
+    return;
 }
-
-std::vector<Body> Bodies::get_bodies() {
-    return this->bodies;
-}
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include "../include/Octree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <cmath>
+
+#include "../include/BodySystem.h"
+
+Octree::Octree(int leaf_size) {
+    this->leaf_size = leaf_size;
+}
+
+void Octree::build(const BodySystem& system) {
+    int size = system.size();
+
+    // Bodies move little between builds, so the next tree stays within the headroom kept above the previous one
+    keep_headroom(this->nodes, this->nodes.size());
+    this->nodes.clear();
+    this->order.resize(size);
+    this->octants.resize(size);
+    this->sorted.resize(size);
+
+    double min_corner[3] = {0.0, 0.0, 0.0};
+    double max_corner[3] = {0.0, 0.0, 0.0};
+
+    for (int i = 0; i < size; i++) {
+        this->order[i] = i;
+        double position[3] = {system.x[i], system.y[i], system.z[i]};
+
+        for (int axis = 0; axis < 3; axis++) {
+            if (i == 0 || position[axis] < min_corner[axis]) {
+                min_corner[axis] = position[axis];
+            }
+            if (i == 0 || position[axis] > max_corner[axis]) {
+                max_corner[axis] = position[axis];
+            }
+        }
+    }
+
+    // Root cell is the smallest cube enclosing every body
+    OctreeNode root;
+    root.half_size = 0.0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        root.center[axis] = 0.5 * (min_corner[axis] + max_corner[axis]);
+        root.half_size = std::fmax(root.half_size, 0.5 * (max_corner[axis] - min_corner[axis]));
+    }
+
+    root.half_size = root.half_size * 1.0001 + 1e-12;
+    root.begin = 0;
+    root.end = size;
+    root.first_child = -1;
+
+    this->nodes.push_back(root);
+    this->build_node(system, 0, 0);
+
+    return;
+}
+
+void Octree::build_node(const BodySystem& system, int node, int depth) {
+    int begin = this->nodes[node].begin;
+    int end = this->nodes[node].end;
+
+    double mass = 0.0;
+    double com[3] = {0.0, 0.0, 0.0};
+
+    if (end - begin <= this->leaf_size || depth >= max_tree_depth) {
+        for (int k = begin; k < end; k++) {
+            int idx = this->order[k];
+            mass += system.mass[idx];
+            com[0] += system.mass[idx] * system.x[idx];
+            com[1] += system.mass[idx] * system.y[idx];
+            com[2] += system.mass[idx] * system.z[idx];
+        }
+    }
+    else {
+        double center[3] = {this->nodes[node].center[0], this->nodes[node].center[1], this->nodes[node].center[2]};
+        double half_size = this->nodes[node].half_size;
+
+        // Counting sort of the cell's bodies into its 8 octants
+        int counts[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+        for (int k = begin; k < end; k++) {
+            int idx = this->order[k];
+            int octant = (system.x[idx] > center[0] ? 1 : 0) | (system.y[idx] > center[1] ? 2 : 0) | (system.z[idx] > center[2] ? 4 : 0);
+            this->octants[k] = octant;
+            counts[octant]++;
+        }
+
+        int offsets[8];
+        int running = begin;
+
+        for (int octant = 0; octant < 8; octant++) {
+            offsets[octant] = running;
+            running += counts[octant];
+        }
+
+        int cursor[8];
+
+        for (int octant = 0; octant < 8; octant++) {
+            cursor[octant] = offsets[octant];
+        }
+        for (int k = begin; k < end; k++) {
+            this->sorted[cursor[this->octants[k]]++] = this->order[k];
+        }
+        for (int k = begin; k < end; k++) {
+            this->order[k] = this->sorted[k];
+        }
+
+        int first_child = this->nodes.size();
+        this->nodes[node].first_child = first_child;
+
+        for (int octant = 0; octant < 8; octant++) {
+            OctreeNode child;
+            child.half_size = 0.5 * half_size;
+            child.center[0] = center[0] + ((octant & 1) ? child.half_size : -child.half_size);
+            child.center[1] = center[1] + ((octant & 2) ? child.half_size : -child.half_size);
+            child.center[2] = center[2] + ((octant & 4) ? child.half_size : -child.half_size);
+            child.begin = offsets[octant];
+            child.end = offsets[octant] + counts[octant];
+            child.first_child = -1;
+
+            this->nodes.push_back(child);
+        }
+
+        for (int octant = 0; octant < 8; octant++) {
+            int child = first_child + octant;
+
+            if (this->nodes[child].end > this->nodes[child].begin) {
+                this->build_node(system, child, depth + 1);
+            }
+            else {
+                this->nodes[child].mass = 0.0;
+                this->nodes[child].com_offset = 0.0;
+
+                for (int axis = 0; axis < 3; axis++) {
+                    this->nodes[child].com[axis] = this->nodes[child].center[axis];
+                }
+            }
+
+            mass += this->nodes[child].mass;
+            com[0] += this->nodes[child].mass * this->nodes[child].com[0];
+            com[1] += this->nodes[child].mass * this->nodes[child].com[1];
+            com[2] += this->nodes[child].mass * this->nodes[child].com[2];
+        }
+    }
+
+    OctreeNode& current = this->nodes[node];
+    current.mass = mass;
+
+    for (int axis = 0; axis < 3; axis++) {
+        current.com[axis] = (mass > 0.0) ? com[axis] / mass : current.center[axis];
+    }
+
+    double offset[3] = {current.com[0] - current.center[0], current.com[1] - current.center[1], current.com[2] - current.center[2]};
+    current.com_offset = std::sqrt(offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2]);
+
+    return;
+}
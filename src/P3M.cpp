@@ -0,0 +1,187 @@
+#include "../include/P3M.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "../include/BodySystem.h"
+#include "../include/ForceSolver.h"
+#include "../include/ParticleMesh.h"
+#include "../include/DirectSumKernel.h"
+#include "../include/ThreadPool.h"
+
+// Cutoff in units of the split scale r_s, the short range force has fallen below 0.6% of Newtonian there
+const double cutoff_splits = 5.0;
+const int share_table_size = 4096;
+
+P3MSolver::P3MSolver(int grid_size, double distance_cutoff, double min_dist) : ParticleMeshSolver(grid_size) {
+    this->distance_cutoff = distance_cutoff;
+    this->min_dist = min_dist;
+    this->cells_per_side = 0;
+    this->cell_size = 1.0;
+    this->cell_origin[0] = this->cell_origin[1] = this->cell_origin[2] = 0.0;
+    this->warned_clamp = false;
+
+    // Newtonian force times the share erfc(u) + 2 u / sqrt(pi) exp(-u^2) the long range mesh force leaves out, u = r / 2 r_s
+    this->share_table.resize(share_table_size + 2);
+    for (int i = 0; i < share_table_size + 2; i++) {
+        double u = (double)i / share_table_size * cutoff_splits / 2.0;
+        this->share_table[i] = std::erfc(u) + 2.0 * u / std::sqrt(3.14159265358979323846) * std::exp(-u * u);
+    }
+}
+
+const char* P3MSolver::name() const {
+    return "p3m";
+}
+
+void P3MSolver::build_cells(const BodySystem& system, double cutoff) {
+    int size = system.size();
+    double lower[3] = {system.x[0], system.y[0], system.z[0]};
+    double upper[3] = {system.x[0], system.y[0], system.z[0]};
+
+    for (int i = 1; i < size; i++) {
+        double position[3] = {system.x[i], system.y[i], system.z[i]};
+        for (int axis = 0; axis < 3; axis++) {
+            lower[axis] = std::min(lower[axis], position[axis]);
+            upper[axis] = std::max(upper[axis], position[axis]);
+        }
+    }
+
+    double extent = std::max(upper[0] - lower[0], std::max(upper[1] - lower[1], upper[2] - lower[2]));
+
+    // Cells at least as wide as the cutoff so the 27 around a body hold all its neighbors, and never many more cells than bodies
+    int per_side = (extent > cutoff) ? (int)(extent / cutoff) : 1;
+    per_side = std::max(1, std::min(per_side, (int)std::cbrt(2.0 * size) + 1));
+
+    this->cells_per_side = per_side;
+    this->cell_size = std::max(extent / per_side, cutoff) * (1.0 + 1e-9);
+    for (int axis = 0; axis < 3; axis++) {
+        this->cell_origin[axis] = lower[axis];
+    }
+
+    long long cells = (long long)per_side * per_side * per_side;
+    this->cell_start.assign(cells + 1, 0);
+    this->cell_bodies.resize(size);
+    this->body_cell.resize(size);
+
+    // Counting sort of the bodies by cell
+    for (int i = 0; i < size; i++) {
+        double position[3] = {system.x[i], system.y[i], system.z[i]};
+        int c[3];
+
+        for (int axis = 0; axis < 3; axis++) {
+            c[axis] = std::min(per_side - 1, std::max(0, (int)((position[axis] - this->cell_origin[axis]) / this->cell_size)));
+        }
+
+        this->body_cell[i] = (c[0] * per_side + c[1]) * per_side + c[2];
+        this->cell_start[this->body_cell[i] + 1]++;
+    }
+
+    for (long long c = 0; c < cells; c++) {
+        this->cell_start[c + 1] += this->cell_start[c];
+    }
+
+    this->cell_fill.assign(this->cell_start.begin(), this->cell_start.end() - 1);
+    for (int i = 0; i < size; i++) {
+        this->cell_bodies[this->cell_fill[this->body_cell[i]]++] = i;
+    }
+
+    return;
+}
+
+void P3MSolver::short_range(const BodySystem& system, int idx, double G_const, double eps2, double cutoff, double gravity[3]) const {
+    int per_side = this->cells_per_side;
+    int cell = this->body_cell[idx];
+    int c[3] = {cell / (per_side * per_side), (cell / per_side) % per_side, cell % per_side};
+    double position[3] = {system.x[idx], system.y[idx], system.z[idx]};
+    double cutoff2 = cutoff * cutoff;
+    double min_dist = this->min_dist;
+    double table_scale = share_table_size / cutoff;
+
+    for (int di = std::max(0, c[0] - 1); di <= std::min(per_side - 1, c[0] + 1); di++) {
+        for (int dj = std::max(0, c[1] - 1); dj <= std::min(per_side - 1, c[1] + 1); dj++) {
+            for (int dk = std::max(0, c[2] - 1); dk <= std::min(per_side - 1, c[2] + 1); dk++) {
+                int neighbor = (di * per_side + dj) * per_side + dk;
+
+                for (int k = this->cell_start[neighbor]; k < this->cell_start[neighbor + 1]; k++) {
+                    int body = this->cell_bodies[k];
+                    double R[3] = {system.x[body] - position[0], system.y[body] - position[1], system.z[body] - position[2]};
+                    double R2 = R[0] * R[0] + R[1] * R[1] + R[2] * R[2] + eps2;
+
+                    if (body == idx || R2 >= cutoff2 || R2 <= min_kernel_r2) {
+                        continue;
+                    }
+
+                    double r = std::max(std::sqrt(R2), min_dist);
+                    double position_in_table = std::min(r * table_scale, (double)share_table_size);
+                    int entry = (int)position_in_table;
+                    double fraction = position_in_table - entry;
+
+                    double share = this->share_table[entry] + fraction * (this->share_table[entry + 1] - this->share_table[entry]);
+                    double gravity_total = G_const * system.mass[body] * share / (r * r * r);
+
+                    gravity[0] += gravity_total * R[0];
+                    gravity[1] += gravity_total * R[1];
+                    gravity[2] += gravity_total * R[2];
+                }
+            }
+        }
+    }
+
+    return;
+}
+
+void P3MSolver::compute_accelerations(const BodySystem& system, double G_const, double softening, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az) {
+    int size = system.size();
+    double eps2 = softening * softening;
+
+    ax.assign(size, 0.0);
+    ay.assign(size, 0.0);
+    az.assign(size, 0.0);
+
+    if (size == 0) {
+        return;
+    }
+
+    this->place_mesh(system);
+
+    // Split in mesh cells, rounded to eighths so the Green's function is only rebuilt when the scale really changes
+    double split = (this->distance_cutoff > 0.0) ? this->distance_cutoff / cutoff_splits / this->spacing : 1.25;
+    split = std::round(split * 8.0) / 8.0;
+
+    double max_split = (this->grid_size - 2 * mesh_border) / cutoff_splits;
+    if ((split < 1.0 || split > max_split) && !this->warned_clamp) {
+        printf("Warning: P3M cutoff %g is %.3g mesh cells of %g, clamped to %g cells, set p3m_cutoff between %g and %g\n", this->distance_cutoff,
+            this->distance_cutoff / this->spacing, this->spacing, std::max(1.0, std::min(split, max_split)) * cutoff_splits, cutoff_splits * this->spacing,
+            max_split * cutoff_splits * this->spacing);
+        this->warned_clamp = true;
+    }
+    split = std::max(1.0, std::min(split, max_split));
+
+    if (this->green.empty() || this->green_split != split) {
+        this->build_green(split, 0.0);
+    }
+
+    this->solve_mesh(system, G_const);
+
+    double split_radius = split * this->spacing;
+    double cutoff = cutoff_splits * split_radius;
+
+    this->build_cells(system, cutoff);
+
+    parallel_for(this->pool, size, [&](int begin, int end, int) {
+        for (int i = begin; i < end; i++) {
+            double gravity[3] = {0.0, 0.0, 0.0};
+
+            this->field_at(system.x[i], system.y[i], system.z[i], gravity);
+            this->short_range(system, i, G_const, eps2, cutoff, gravity);
+
+            ax[i] = gravity[0];
+            ay[i] = gravity[1];
+            az[i] = gravity[2];
+        }
+    });
+
+    return;
+}
@@ -0,0 +1,525 @@
+#include "../include/ParticleMesh.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <algorithm>
+
+#include "../include/BodySystem.h"
+#include "../include/ForceSolver.h"
+#include "../include/ThreadPool.h"
+
+ParticleMeshSolver::ParticleMeshSolver(int grid_size) {
+    int size = 16;
+    while (size < grid_size) {
+        size *= 2;
+    }
+
+    this->grid_size = size;
+    this->spacing = 1.0;
+    this->origin[0] = this->origin[1] = this->origin[2] = 0.0;
+    this->evaluated = false;
+    this->green_split = 0.0;
+    this->green_softening = 0.0;
+    this->fabric_min_dist = 0.0;
+    this->fabric_cutoff = 0.0;
+    this->fabric_green_spacing = 0.0;
+    this->fabric_green_min_dist = 0.0;
+    this->fabric_green_cutoff = 0.0;
+}
+
+FabricMeshSlice::FabricMeshSlice() {
+    this->origin[0] = this->origin[1] = 0.0;
+    this->spacing = 1.0;
+    this->size = 0;
+    this->valid = false;
+}
+
+bool FabricMeshSlice::sample(double x, double z, float& value) const {
+    value = 0.0f;
+
+    if (!this->valid) {
+        return false;
+    }
+
+    double u = (x - this->origin[0]) / this->spacing;
+    double v = (z - this->origin[1]) / this->spacing;
+    double lower_u = std::floor(u);
+    double lower_v = std::floor(v);
+
+    if (!(lower_u >= 0.0 && lower_u + 1.0 < this->size && lower_v >= 0.0 && lower_v + 1.0 < this->size)) {
+        return false;
+    }
+
+    int i = (int)lower_u;
+    int k = (int)lower_v;
+    double wu = u - lower_u;
+    double wv = v - lower_v;
+    const float* row = this->values.data() + (long long)i * this->size + k;
+
+    value = (float)((1.0 - wu) * ((1.0 - wv) * row[0] + wv * row[1]) + wu * ((1.0 - wv) * row[this->size] + wv * row[this->size + 1]));
+
+    return true;
+}
+
+const char* ParticleMeshSolver::name() const {
+    return "particle_mesh";
+}
+
+int ParticleMeshSolver::node(int i, int j, int k) const {
+    return (i * this->grid_size + j) * this->grid_size + k;
+}
+
+bool ParticleMeshSolver::cloud_in_cell(double x, double y, double z, int cell[3], double weights[3]) const {
+    double position[3] = {x, y, z};
+
+    for (int axis = 0; axis < 3; axis++) {
+        double u = (position[axis] - this->origin[axis]) / this->spacing;
+        double lower = std::floor(u);
+
+        if (!(lower >= 0.0 && lower + 1.0 < this->grid_size)) {
+            return false;
+        }
+
+        cell[axis] = (int)lower;
+        weights[axis] = u - lower;
+    }
+
+    return true;
+}
+
+void ParticleMeshSolver::transform(std::vector<std::complex<double>>& data, int size, bool inverse, int used) {
+    int bits = 0;
+    while ((1 << bits) < size) {
+        bits++;
+    }
+
+    if ((int)this->bit_reversed.size() != size) {
+        this->bit_reversed.assign(size, 0);
+        for (int n = 0; n < size; n++) {
+            for (int bit = 0; bit < bits; bit++) {
+                this->bit_reversed[n] |= ((n >> bit) & 1) << (bits - 1 - bit);
+            }
+        }
+    }
+
+    int workers = (this->pool != nullptr) ? this->pool->size() : 1;
+    if ((long long)this->lines.size() < (long long)workers * size) {
+        this->lines.resize((long long)workers * size);
+    }
+
+    const std::vector<int>& reversed = this->bit_reversed;
+
+    long long strides[3] = {(long long)size * size, size, 1};
+    bool transformed[3] = {false, false, false};
+
+    // One pass of 1D radix-2 transforms along each axis, the lines of a pass are independent. Lines along
+    // which a forward input is still all zero, or whose inverse output is never read, are skipped
+    for (int pass = 0; pass < 3; pass++) {
+        int axis = inverse ? pass : 2 - pass;
+        int first_other = (axis == 0) ? 1 : 0;
+        int second_other = (axis == 2) ? 1 : 2;
+        int first_count = (inverse == transformed[first_other]) ? used : size;
+        int second_count = (inverse == transformed[second_other]) ? used : size;
+        long long stride = strides[axis];
+
+        parallel_for(this->pool, first_count * second_count, [&](int begin, int end, int worker) {
+            std::complex<double>* line = this->lines.data() + (long long)worker * size;
+
+            for (int l = begin; l < end; l++) {
+                long long start = (l / second_count) * strides[first_other] + (l % second_count) * strides[second_other];
+
+                for (int n = 0; n < size; n++) {
+                    line[reversed[n]] = data[start + n * stride];
+                }
+
+                for (int length = 2; length <= size; length *= 2) {
+                    double angle = (inverse ? 2.0 : -2.0) * 3.14159265358979323846 / length;
+                    std::complex<double> root(std::cos(angle), std::sin(angle));
+
+                    for (int first = 0; first < size; first += length) {
+                        std::complex<double> twiddle(1.0, 0.0);
+
+                        for (int n = 0; n < length / 2; n++) {
+                            std::complex<double> even = line[first + n];
+                            std::complex<double> odd = line[first + n + length / 2] * twiddle;
+
+                            line[first + n] = even + odd;
+                            line[first + n + length / 2] = even - odd;
+                            twiddle *= root;
+                        }
+                    }
+                }
+
+                for (int n = 0; n < size; n++) {
+                    data[start + n * stride] = line[n];
+                }
+            }
+        });
+
+        transformed[axis] = true;
+    }
+
+    return;
+}
+
+void ParticleMeshSolver::build_green(double split, double softening) {
+    int padded_size = 2 * this->grid_size;
+
+    this->green.assign((long long)padded_size * padded_size * padded_size, std::complex<double>(0.0, 0.0));
+    this->green_split = split;
+    this->green_softening = softening;
+
+    // -1/r in cells with the nearest image of every offset. Without a split it is smoothed over half a cell
+    // and softened, so r = 0 stays finite, with one only the long range part erf(r / 2 r_s) / r is kept
+    for (int i = 0; i < padded_size; i++) {
+        for (int j = 0; j < padded_size; j++) {
+            for (int k = 0; k < padded_size; k++) {
+                double di = std::min(i, padded_size - i);
+                double dj = std::min(j, padded_size - j);
+                double dk = std::min(k, padded_size - k);
+                double r = std::sqrt(di * di + dj * dj + dk * dk);
+                double value;
+
+                if (split <= 0.0) {
+                    value = -1.0 / std::sqrt(r * r + 0.25 + softening * softening);
+                }
+                else if (r > 0.0) {
+                    value = -std::erf(r / (2.0 * split)) / r;
+                }
+                else {
+                    value = -1.0 / (std::sqrt(3.14159265358979323846) * split);
+                }
+
+                this->green[((long long)i * padded_size + j) * padded_size + k] = value;
+            }
+        }
+    }
+
+    this->transform(this->green, padded_size, false, padded_size);
+
+    if (split <= 0.0) {
+        return;
+    }
+
+    // The long range field is smooth enough to undo the smoothing of the deposit and the interpolation
+    for (int i = 0; i < padded_size; i++) {
+        for (int j = 0; j < padded_size; j++) {
+            for (int k = 0; k < padded_size; k++) {
+                int frequency[3] = {i, j, k};
+                double window = 1.0;
+
+                for (int axis = 0; axis < 3; axis++) {
+                    int m = (frequency[axis] <= padded_size / 2) ? frequency[axis] : frequency[axis] - padded_size;
+                    double argument = 3.14159265358979323846 * m / padded_size;
+                    double sinc = (m == 0) ? 1.0 : std::sin(argument) / argument;
+
+                    window *= sinc * sinc;
+                }
+
+                this->green[((long long)i * padded_size + j) * padded_size + k] /= window * window;
+            }
+        }
+    }
+
+    return;
+}
+
+void ParticleMeshSolver::build_fabric_green() {
+    int padded_size = 2 * this->grid_size;
+
+    this->fabric_green.assign((long long)padded_size * padded_size * padded_size, std::complex<double>(0.0, 0.0));
+    this->fabric_green_spacing = this->spacing;
+    this->fabric_green_min_dist = this->fabric_min_dist;
+    this->fabric_green_cutoff = this->fabric_cutoff;
+
+    // Same clamp and cutoff as fabric_node_field, in the units of the bodies, but never below half a cell
+    // where the deposit spreads the mass anyway
+    double min_dist = std::max(this->fabric_min_dist, 0.5 * this->spacing);
+    double min_dist2 = min_dist * min_dist;
+    double cutoff2 = this->fabric_cutoff * this->fabric_cutoff;
+
+    for (int i = 0; i < padded_size; i++) {
+        for (int j = 0; j < padded_size; j++) {
+            for (int k = 0; k < padded_size; k++) {
+                double di = std::min(i, padded_size - i) * this->spacing;
+                double dj = std::min(j, padded_size - j) * this->spacing;
+                double dk = std::min(k, padded_size - k) * this->spacing;
+                double r2 = di * di + dj * dj + dk * dk;
+
+                if (r2 <= cutoff2) {
+                    this->fabric_green[((long long)i * padded_size + j) * padded_size + k] = 1.0 / std::max(r2, min_dist2);
+                }
+            }
+        }
+    }
+
+    this->transform(this->fabric_green, padded_size, false, padded_size);
+
+    return;
+}
+
+void ParticleMeshSolver::place_mesh(const BodySystem& system) {
+    int size = system.size();
+    int n = this->grid_size;
+
+    // Cubic mesh around the bounding box of the bodies
+    double lower[3] = {system.x[0], system.y[0], system.z[0]};
+    double upper[3] = {system.x[0], system.y[0], system.z[0]};
+    for (int i = 1; i < size; i++) {
+        double position[3] = {system.x[i], system.y[i], system.z[i]};
+        for (int axis = 0; axis < 3; axis++) {
+            lower[axis] = std::min(lower[axis], position[axis]);
+            upper[axis] = std::max(upper[axis], position[axis]);
+        }
+    }
+
+    double extent = std::max(upper[0] - lower[0], std::max(upper[1] - lower[1], upper[2] - lower[2]));
+    if (!(extent > 0.0)) {
+        extent = 1.0;
+    }
+
+    this->spacing = extent / (n - 2 * mesh_border - 1);
+    for (int axis = 0; axis < 3; axis++) {
+        double center = 0.5 * (lower[axis] + upper[axis]);
+        this->origin[axis] = center - 0.5 * (n - 1) * this->spacing;
+    }
+
+    return;
+}
+
+void ParticleMeshSolver::compute_accelerations(const BodySystem& system, double G_const, double softening, std::vector<double>& ax, std::vector<double>& ay, std::vector<double>& az) {
+    int size = system.size();
+
+    ax.assign(size, 0.0);
+    ay.assign(size, 0.0);
+    az.assign(size, 0.0);
+
+    if (size == 0) {
+        return;
+    }
+
+    this->place_mesh(system);
+
+    // Softening in cells follows the spacing, changes well below the half cell smoothing are not worth a rebuild
+    double softening_cells = softening / this->spacing;
+    if (this->green.empty() || this->green_split != 0.0 || std::fabs(softening_cells - this->green_softening) > 0.01 * std::max(softening_cells, 0.5)) {
+        this->build_green(0.0, softening_cells);
+    }
+
+    this->solve_mesh(system, G_const);
+
+    parallel_for(this->pool, size, [&](int begin, int end, int) {
+        for (int i = begin; i < end; i++) {
+            double gravity[3] = {0.0, 0.0, 0.0};
+            this->field_at(system.x[i], system.y[i], system.z[i], gravity);
+
+            ax[i] = gravity[0];
+            ay[i] = gravity[1];
+            az[i] = gravity[2];
+        }
+    });
+
+    return;
+}
+
+void ParticleMeshSolver::solve_mesh(const BodySystem& system, double G_const) {
+    int size = system.size();
+    int n = this->grid_size;
+    int padded_size = 2 * n;
+    long long padded_nodes = (long long)padded_size * padded_size * padded_size;
+
+    // Cloud-in-cell mass deposit into the first octant of the padded mesh
+    this->padded.assign(padded_nodes, std::complex<double>(0.0, 0.0));
+
+    for (int i = 0; i < size; i++) {
+        int cell[3];
+        double weights[3];
+
+        if (!this->cloud_in_cell(system.x[i], system.y[i], system.z[i], cell, weights)) {
+            continue;
+        }
+
+        for (int corner = 0; corner < 8; corner++) {
+            int offset[3] = {(corner >> 2) & 1, (corner >> 1) & 1, corner & 1};
+            double weight = system.mass[i];
+
+            for (int axis = 0; axis < 3; axis++) {
+                weight *= offset[axis] ? weights[axis] : 1.0 - weights[axis];
+            }
+
+            long long index = ((long long)(cell[0] + offset[0]) * padded_size + (cell[1] + offset[1])) * padded_size + (cell[2] + offset[2]);
+            this->padded[index] += weight;
+        }
+    }
+
+    // Potential = mass (*) Green's function, a product of transforms
+    this->transform(this->padded, padded_size, false, n);
+
+    // Fabric field = mass (*) fabric kernel, from the same transform of the deposit
+    if (this->fabric_cutoff > 0.0) {
+        if (this->fabric_green.empty() || std::fabs(this->spacing - this->fabric_green_spacing) > 0.01 * this->spacing
+            || this->fabric_min_dist != this->fabric_green_min_dist || this->fabric_cutoff != this->fabric_green_cutoff) {
+            this->build_fabric_green();
+        }
+
+        this->fabric_padded.resize(padded_nodes);
+        parallel_for(this->pool, padded_size, [&](int begin, int end, int) {
+            long long plane = (long long)padded_size * padded_size;
+            for (long long index = begin * plane; index < end * plane; index++) {
+                this->fabric_padded[index] = this->padded[index] * this->fabric_green[index];
+            }
+        });
+
+        this->transform(this->fabric_padded, padded_size, true, n);
+
+        this->fabric.assign((long long)n * n * n, 0.0);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                for (int k = 0; k < n; k++) {
+                    this->fabric[this->node(i, j, k)] = this->fabric_padded[((long long)i * padded_size + j) * padded_size + k].real() / (double)padded_nodes;
+                }
+            }
+        }
+    }
+    else {
+        this->fabric.clear();
+    }
+
+    parallel_for(this->pool, padded_size, [&](int begin, int end, int) {
+        long long plane = (long long)padded_size * padded_size;
+        for (long long index = begin * plane; index < end * plane; index++) {
+            this->padded[index] *= this->green[index];
+        }
+    });
+
+    this->transform(this->padded, padded_size, true, n);
+
+    double scale = G_const / (this->spacing * (double)padded_nodes);
+
+    this->potential.assign((long long)n * n * n, 0.0);
+    for (int axis = 0; axis < 3; axis++) {
+        this->field[axis].assign((long long)n * n * n, 0.0);
+    }
+
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            for (int k = 0; k < n; k++) {
+                this->potential[this->node(i, j, k)] = this->padded[((long long)i * padded_size + j) * padded_size + k].real() * scale;
+            }
+        }
+    }
+
+    // Field = -grad potential by fourth order central differences, left at zero on the border nodes
+    parallel_for(this->pool, n - 4, [&](int begin, int end, int) {
+        for (int i = begin + 2; i < end + 2; i++) {
+            for (int j = 2; j < n - 2; j++) {
+                for (int k = 2; k < n - 2; k++) {
+                    int steps[3] = {n * n, n, 1};
+                    int index = this->node(i, j, k);
+
+                    for (int axis = 0; axis < 3; axis++) {
+                        int s = steps[axis];
+                        double difference = 8.0 * (this->potential[index + s] - this->potential[index - s]) - (this->potential[index + 2 * s] - this->potential[index - 2 * s]);
+
+                        this->field[axis][index] = -difference / (12.0 * this->spacing);
+                    }
+                }
+            }
+        }
+    });
+
+    this->evaluated = true;
+
+    return;
+}
+
+bool ParticleMeshSolver::potential_at(double x, double y, double z, double& potential) const {
+    int cell[3];
+    double weights[3];
+
+    potential = 0.0;
+
+    if (!this->evaluated || !this->cloud_in_cell(x, y, z, cell, weights)) {
+        return false;
+    }
+
+    for (int corner = 0; corner < 8; corner++) {
+        int offset[3] = {(corner >> 2) & 1, (corner >> 1) & 1, corner & 1};
+        double weight = 1.0;
+
+        for (int axis = 0; axis < 3; axis++) {
+            weight *= offset[axis] ? weights[axis] : 1.0 - weights[axis];
+        }
+
+        potential += weight * this->potential[this->node(cell[0] + offset[0], cell[1] + offset[1], cell[2] + offset[2])];
+    }
+
+    return true;
+}
+
+bool ParticleMeshSolver::field_at(double x, double y, double z, double gravity[3]) const {
+    int cell[3];
+    double weights[3];
+
+    gravity[0] = gravity[1] = gravity[2] = 0.0;
+
+    if (!this->evaluated || !this->cloud_in_cell(x, y, z, cell, weights)) {
+        return false;
+    }
+
+    // Same weights as the deposit, which keeps the scheme momentum conserving
+    for (int corner = 0; corner < 8; corner++) {
+        int offset[3] = {(corner >> 2) & 1, (corner >> 1) & 1, corner & 1};
+        double weight = 1.0;
+
+        for (int axis = 0; axis < 3; axis++) {
+            weight *= offset[axis] ? weights[axis] : 1.0 - weights[axis];
+        }
+
+        int index = this->node(cell[0] + offset[0], cell[1] + offset[1], cell[2] + offset[2]);
+        for (int axis = 0; axis < 3; axis++) {
+            gravity[axis] += weight * this->field[axis][index];
+        }
+    }
+
+    return true;
+}
+
+bool ParticleMeshSolver::fabric_slice(double y, FabricMeshSlice& slice) const {
+    int n = this->grid_size;
+
+    slice.valid = false;
+
+    if (!this->evaluated || this->fabric.empty()) {
+        return false;
+    }
+
+    double u = (y - this->origin[1]) / this->spacing;
+    double lower = std::floor(u);
+
+    if (!(lower >= 0.0 && lower + 1.0 < n)) {
+        return false;
+    }
+
+    int j = (int)lower;
+    double weight = u - lower;
+
+    slice.origin[0] = this->origin[0];
+    slice.origin[1] = this->origin[2];
+    slice.spacing = this->spacing;
+    slice.size = n;
+    slice.values.resize((long long)n * n);
+
+    // Linear between the two mesh planes around y, the fabric then interpolates within the plane
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < n; k++) {
+            slice.values[(long long)i * n + k] = (float)((1.0 - weight) * this->fabric[this->node(i, j, k)] + weight * this->fabric[this->node(i, j + 1, k)]);
+        }
+    }
+
+    slice.valid = true;
+
+    return true;
+}
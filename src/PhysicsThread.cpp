@@ -0,0 +1,147 @@
+#include "../include/PhysicsThread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include "../include/BodySystem.h"
+#include "../include/Simulation.h"
+#include "../include/SimulationClock.h"
+#include "../include/TripleBuffer.h"
+#include "../include/ParticleMesh.h"
+
+PhysicsThread::PhysicsThread(Simulation simulation, SimulationClock clock) : simulation(std::move(simulation)), clock(clock) {
+    this->time_warp = clock.time_warp;
+    this->paused = false;
+    this->running = false;
+}
+
+PhysicsThread::~PhysicsThread() {
+    this->stop();
+}
+
+void PhysicsThread::start() {
+    if (this->running) {
+        return;
+    }
+
+    // The starting state is published before the thread exists, so the renderer always has a snapshot
+    this->publish();
+    this->snapshots.update();
+
+    this->running = true;
+    this->worker = std::thread(&PhysicsThread::run, this);
+
+    return;
+}
+
+void PhysicsThread::stop() {
+    this->running = false;
+
+    if (this->worker.joinable()) {
+        this->worker.join();
+    }
+
+    return;
+}
+
+void PhysicsThread::run() {
+    auto last = std::chrono::steady_clock::now();
+
+    while (this->running) {
+        auto now = std::chrono::steady_clock::now();
+        this->clock.time_warp = this->paused ? 0.0 : this->time_warp.load();
+        this->clock.advance(this->simulation, std::chrono::duration<double>(now - last).count());
+        last = now;
+
+        if (this->clock.steps > 0) {
+            this->publish();
+        }
+
+        // Sleep until the next step is owed, waking often enough to notice a stop or a change of warp
+        double rate = this->clock.steps_per_second * this->clock.time_warp;
+        double wait = (rate > 0.0) ? (1.0 - this->clock.accumulator) / rate : 0.005;
+        wait = std::min(std::max(wait, 0.0), 0.005);
+
+        if (wait > 0.0) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+        }
+    }
+
+    return;
+}
+
+void PhysicsThread::publish() {
+    BodySnapshot& snapshot = this->snapshots.write_buffer();
+    const BodySystem& system = this->simulation.system;
+    BodyView previous = this->clock.previous(this->simulation);
+
+    // Slots are reused, so once every slot has been filled publishing no longer allocates
+    snapshot.x.assign(system.x.begin(), system.x.end());
+    snapshot.y.assign(system.y.begin(), system.y.end());
+    snapshot.z.assign(system.z.begin(), system.z.end());
+    snapshot.previous_x.assign(previous.x, previous.x + previous.size());
+    snapshot.previous_y.assign(previous.y, previous.y + previous.size());
+    snapshot.previous_z.assign(previous.z, previous.z + previous.size());
+    snapshot.vx.assign(system.vx.begin(), system.vx.end());
+    snapshot.vy.assign(system.vy.begin(), system.vy.end());
+    snapshot.vz.assign(system.vz.begin(), system.vz.end());
+    snapshot.mass.assign(system.mass.begin(), system.mass.end());
+    snapshot.diameter.assign(system.diameter.begin(), system.diameter.end());
+    snapshot.host.assign(system.host.begin(), system.host.end());
+    snapshot.sim_time = this->simulation.sim_time;
+    snapshot.step_count = this->simulation.step_count;
+    snapshot.alpha = this->clock.alpha();
+    snapshot.step_rate = this->clock.steps_per_second * this->clock.time_warp;
+    snapshot.published = std::chrono::steady_clock::now();
+
+    // The mesh belongs to this thread, so the fabric gets a copy of the one plane it samples
+    const ParticleMeshSolver* mesh = dynamic_cast<const ParticleMeshSolver*>(this->simulation.solver.get());
+    if (mesh == nullptr || !mesh->fabric_slice(0.0, snapshot.fabric_mesh)) {
+        snapshot.fabric_mesh.valid = false;
+    }
+
+    this->snapshots.publish();
+
+    return;
+}
+
+BodyView PhysicsThread::bodies() {
+    this->snapshots.update();
+    const BodySnapshot& snapshot = this->snapshots.read_buffer();
+    int count = snapshot.x.size();
+
+    // The clock keeps owing steps while the snapshot ages, the blend follows it until the next one arrives
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - snapshot.published).count();
+    double alpha = std::min(snapshot.alpha + elapsed * snapshot.step_rate, 1.0);
+
+    this->blended_x.resize(count);
+    this->blended_y.resize(count);
+    this->blended_z.resize(count);
+
+    for (int i = 0; i < count; i++) {
+        this->blended_x[i] = snapshot.previous_x[i] + alpha * (snapshot.x[i] - snapshot.previous_x[i]);
+        this->blended_y[i] = snapshot.previous_y[i] + alpha * (snapshot.y[i] - snapshot.previous_y[i]);
+        this->blended_z[i] = snapshot.previous_z[i] + alpha * (snapshot.z[i] - snapshot.previous_z[i]);
+    }
+
+    BodyView bodies;
+    bodies.x = this->blended_x.data();
+    bodies.y = this->blended_y.data();
+    bodies.z = this->blended_z.data();
+    bodies.vx = snapshot.vx.data();
+    bodies.vy = snapshot.vy.data();
+    bodies.vz = snapshot.vz.data();
+    bodies.mass = snapshot.mass.data();
+    bodies.diameter = snapshot.diameter.data();
+    bodies.host = snapshot.host.data();
+    bodies.count = count;
+
+    return bodies;
+}
+
+const BodySnapshot& PhysicsThread::snapshot() const {
+    return this->snapshots.read_buffer();
+}
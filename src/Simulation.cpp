@@ -0,0 +1,168 @@
+#include "../include/Simulation.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../include/json.hpp"
+#include <fstream>
+#include <string>
+#include <cmath>
+
+#include "../include/BodySystem.h"
+#include "../include/ForceSolver.h"
+#include "../include/BarnesHut.h"
+#include "../include/FastMultipole.h"
+#include "../include/ParticleMesh.h"
+#include "../include/P3M.h"
+#include "../include/ThreadPool.h"
+#include "../include/Integrator.h"
+
+SimulationConfig load_simulation_config(const std::string filename) {
+    std::ifstream inFile(filename);
+    nlohmann::json json_file;
+    inFile >> json_file;
+
+    SimulationConfig configs;
+
+    // Keys of the original configuration are required, the ones added since fall back to their defaults so
+    // older configuration files keep loading
+    configs.E_val_km = json_file["E_val_km"];
+    configs.E_val_kg = json_file["E_val_kg"];
+    configs.G_const = json_file["G_const"];
+    configs.G_const *= configs.E_val_kg / (std::pow(configs.E_val_km, 3) * 1e9);
+    configs.softening = json_file.value("softening", 0.0);
+    configs.time_step = json_file["time_step"];
+    configs.integrator = json_file.value("integrator", std::string("leapfrog"));
+    configs.timestep_accuracy = json_file.value("timestep_accuracy", 1.0);
+    configs.max_timestep_level = json_file.value("max_timestep_level", 12);
+    configs.force_solver = json_file.value("force_solver", std::string("direct"));
+    configs.opening_angle = json_file.value("opening_angle", 0.5);
+    configs.fmm_order = json_file.value("fmm_order", 4);
+    configs.pm_grid = json_file.value("pm_grid", 64);
+    configs.p3m_cutoff = json_file.value("p3m_cutoff", 0.0);
+    configs.min_dist = json_file["min_dist"];
+    configs.threads = json_file.value("threads", 0);
+    configs.trajectory_compression = json_file.value("trajectory_compression", std::string("delta"));
+    configs.trajectory_quantum = json_file.value("trajectory_quantum", 1e-6);
+    configs.trajectory_chunk_frames = json_file.value("trajectory_chunk_frames", 64);
+
+    return configs;
+}
+
+std::unique_ptr<ForceSolver> create_force_solver(const SimulationConfig& configs) {
+    if (configs.force_solver == "barnes_hut") {
+        return std::unique_ptr<ForceSolver>(new BarnesHutSolver(configs.opening_angle));
+    }
+    if (configs.force_solver == "fmm") {
+        return std::unique_ptr<ForceSolver>(new FastMultipoleSolver(configs.fmm_order, configs.opening_angle));
+    }
+    if (configs.force_solver == "particle_mesh") {
+        return std::unique_ptr<ForceSolver>(new ParticleMeshSolver(configs.pm_grid));
+    }
+    if (configs.force_solver == "p3m") {
+        return std::unique_ptr<ForceSolver>(new P3MSolver(configs.pm_grid, configs.p3m_cutoff, configs.min_dist));
+    }
+    if (configs.force_solver != "direct") {
+        printf("Unknown force_solver '%s', falling back to direct summation\n", configs.force_solver.c_str());
+    }
+
+    return std::unique_ptr<ForceSolver>(new DirectSumSolver());
+}
+
+std::unique_ptr<Integrator> create_integrator(const SimulationConfig& configs) {
+    if (configs.integrator == "euler") {
+        return std::unique_ptr<Integrator>(new EulerIntegrator());
+    }
+    if (configs.integrator == "hermite") {
+        return std::unique_ptr<Integrator>(new HermiteIntegrator());
+    }
+    if (configs.integrator == "wisdom_holman") {
+        return std::unique_ptr<Integrator>(new WisdomHolmanIntegrator());
+    }
+    if (configs.integrator == "block_timestep") {
+        return std::unique_ptr<Integrator>(new BlockTimestepIntegrator(configs.timestep_accuracy, configs.max_timestep_level));
+    }
+    if (configs.integrator != "leapfrog") {
+        printf("Unknown integrator '%s', falling back to leapfrog\n", configs.integrator.c_str());
+    }
+
+    return std::unique_ptr<Integrator>(new LeapfrogIntegrator());
+}
+
+Simulation::Simulation(BodySystem system, SimulationConfig configs) {
+    this->system = std::move(system);
+    this->G_const = configs.G_const;
+    this->softening = configs.softening;
+    this->time_step = configs.time_step;
+    this->pool = std::unique_ptr<ThreadPool>(new ThreadPool(configs.threads));
+    this->solver = create_force_solver(configs);
+    this->solver->pool = this->pool.get();
+    this->integrator = create_integrator(configs);
+    this->accelerations_current = false;
+    this->force_evaluations = 0;
+
+    this->sim_time = 0.0;
+    this->step_count = 0;
+
+    int size = this->system.size();
+    this->ax.assign(size, 0.0);
+    this->ay.assign(size, 0.0);
+    this->az.assign(size, 0.0);
+}
+
+void Simulation::compute_accelerations() {
+    this->solver->compute_accelerations(this->system, this->G_const, this->softening, this->ax, this->ay, this->az);
+    this->accelerations_current = true;
+    this->force_evaluations += this->system.size();
+
+    return;
+}
+
+void Simulation::compute_accelerations(const std::vector<int>& targets) {
+    // Solvers without a path for a few targets evaluate every body, which is what the run really costs
+    this->force_evaluations += this->solver->compute_target_accelerations(this->system, this->G_const, this->softening, targets, this->ax, this->ay, this->az);
+
+    return;
+}
+
+BodyView Simulation::bodies() const {
+    return this->system.view();
+}
+
+void Simulation::step() {
+    this->integrator->step(*this);
+
+    this->sim_time += this->time_step;
+    this->step_count++;
+
+    return;
+}
+
+void Simulation::run(int steps) {
+    for (int i = 0; i < steps; i++) {
+        this->step();
+    }
+
+    return;
+}
+
+double Simulation::total_energy() {
+    int size = this->system.size();
+    double eps2 = this->softening * this->softening;
+    double kinetic = 0.0;
+    double potential = 0.0;
+
+    for (int i = 0; i < size; i++) {
+        double v2 = this->system.vx[i] * this->system.vx[i] + this->system.vy[i] * this->system.vy[i] + this->system.vz[i] * this->system.vz[i];
+        kinetic += 0.5 * this->system.mass[i] * v2;
+
+        for (int j = i + 1; j < size; j++) {
+            double dx = this->system.x[j] - this->system.x[i];
+            double dy = this->system.y[j] - this->system.y[i];
+            double dz = this->system.z[j] - this->system.z[i];
+
+            potential -= this->G_const * this->system.mass[i] * this->system.mass[j] / std::sqrt(dx * dx + dy * dy + dz * dz + eps2);
+        }
+    }
+
+    return kinetic + potential;
+}
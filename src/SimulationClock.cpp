@@ -0,0 +1,100 @@
+#include "../include/SimulationClock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include "../include/BodySystem.h"
+#include "../include/Simulation.h"
+
+SimulationClock::SimulationClock(double steps_per_second, double time_warp, int max_substeps, double frame_budget) {
+    this->steps_per_second = steps_per_second;
+    this->time_warp = time_warp;
+    this->max_substeps = max_substeps;
+    this->frame_budget = frame_budget;
+    this->accumulator = 0.0;
+    this->steps = 0;
+    this->dropped_steps = 0;
+}
+
+int SimulationClock::advance(Simulation& simulation, double wall_seconds) {
+    const BodySystem& system = simulation.system;
+
+    // Until the first step the previous state is the current one
+    if ((int)this->previous_x.size() != system.size()) {
+        this->previous_x = system.x;
+        this->previous_y = system.y;
+        this->previous_z = system.z;
+    }
+
+    this->accumulator += std::max(wall_seconds, 0.0) * this->steps_per_second * this->time_warp;
+    this->steps = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    while (this->accumulator >= 1.0 && this->steps < this->max_substeps) {
+        this->previous_x.assign(system.x.begin(), system.x.end());
+        this->previous_y.assign(system.y.begin(), system.y.end());
+        this->previous_z.assign(system.z.begin(), system.z.end());
+
+        simulation.step();
+        this->accumulator -= 1.0;
+        this->steps++;
+
+        if (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > this->frame_budget) {
+            break;
+        }
+    }
+
+    // Whole steps that did not fit in this frame are dropped, the simulation falls behind wall time instead of spiralling
+    if (this->accumulator >= 1.0) {
+        double whole = std::floor(this->accumulator);
+        this->dropped_steps += (long long)whole;
+        this->accumulator -= whole;
+    }
+
+    return this->steps;
+}
+
+double SimulationClock::alpha() const {
+    return this->accumulator;
+}
+
+BodyView SimulationClock::view(const Simulation& simulation) {
+    BodyView bodies = simulation.bodies();
+
+    if ((int)this->previous_x.size() != bodies.size()) {
+        return bodies;
+    }
+
+    this->blended_x.resize(bodies.size());
+    this->blended_y.resize(bodies.size());
+    this->blended_z.resize(bodies.size());
+
+    double alpha = this->alpha();
+    for (int i = 0; i < bodies.size(); i++) {
+        this->blended_x[i] = this->previous_x[i] + alpha * (bodies.x[i] - this->previous_x[i]);
+        this->blended_y[i] = this->previous_y[i] + alpha * (bodies.y[i] - this->previous_y[i]);
+        this->blended_z[i] = this->previous_z[i] + alpha * (bodies.z[i] - this->previous_z[i]);
+    }
+
+    bodies.x = this->blended_x.data();
+    bodies.y = this->blended_y.data();
+    bodies.z = this->blended_z.data();
+
+    return bodies;
+}
+
+BodyView SimulationClock::previous(const Simulation& simulation) const {
+    BodyView bodies = simulation.bodies();
+
+    if ((int)this->previous_x.size() != bodies.size()) {
+        return bodies;
+    }
+
+    bodies.x = this->previous_x.data();
+    bodies.y = this->previous_y.data();
+    bodies.z = this->previous_z.data();
+
+    return bodies;
+}
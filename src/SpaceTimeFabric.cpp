@@ -2,7 +2,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <vector>
-#include "../include/Models.h"
+#include "../include/BodySystem.h"
+#include "../include/FabricField.h"
+#include "../include/FabricLod.h"
+#include "../include/GpuResources.h"
 
 #include <glad/glad.h>
 #include <glm/gtc/type_ptr.hpp>
@@ -10,7 +13,7 @@
 
 // float precision = 1000.0f;
 
-Fabric::Fabric(std::vector<Body> bodies, float E_val_km, float E_val_kg, float distance_cutoff, float gridStep, int gridSquares, glm::vec3 position, std::vector<float> color, float y_value, float G_const, float min_dist, float deformation_scale, GLuint shader) {
+Fabric::Fabric(const BodyView& bodies, float E_val_km, float E_val_kg, float distance_cutoff, float gridStep, int gridSquares, glm::vec3 position, std::vector<float> color, float y_value, float G_const, float min_dist, float deformation_scale, GLuint shader) : VBO(GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW), EBO(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW), field(G_const, distance_cutoff, min_dist), lod(0), bodyBuffer(GL_TEXTURE_BUFFER, GL_STREAM_DRAW), bodyTexture(GL_TEXTURE_BUFFER) {
     this->bodies = bodies;
     this->E_val_km = E_val_km;
     this->E_val_kg = E_val_kg;
@@ -35,167 +38,237 @@ Fabric::Fabric(std::vector<Body> bodies, float E_val_km, float E_val_kg, float d
     this->deformation_scale = deformation_scale;
 
     this->shader = shader;
+    this->cameraPosition = glm::vec3(0.0f);
+    this->deformShader = 0;
 
     this->compute_vertices();
+    this->compute_indices();
     this->create_fabric();
 
     return;
 }
 
 void Fabric::compute_vertices() {
-    // Emptzing vertices vector before calculation
-    // std::vector<float>().swap(this->vertices);
-    vertices.clear();
+    if (this->lod.max_vertices > 0) {
+        // The quadtree is refined for the camera's position over the drawn plane of the fabric
+        glm::vec3 camera = this->cameraPosition - this->position;
+        float cameraLocal[3] = {camera.x, camera.y - this->y_value, camera.z};
 
-    float x, z_1, z_2;
-    float x_1, x_2, z;
+        this->lod.build(this->field, this->bodies, this->gridSquares * this->gridStep, this->deformation_scale, cameraLocal);
 
-    std::vector<float> masses;
-    std::vector<glm::vec3> positions;
-
-    int bodies_size = this->bodies.size();
-
-    float distance;
-    float gravity_field;
+        this->vertices = this->lod.vertices;
+        for (size_t vertex = 1; vertex < this->vertices.size(); vertex += 3) {
+            this->vertices[vertex] = this->y_value - this->vertices[vertex] * this->deformation_scale;
+        }
+        this->indices = this->lod.indices;
 
-    // Getting masses and positions for all bodies in scene in order
-    for (int body = 0; body < bodies_size; body++) {
-        masses.push_back(bodies[body].mass);
-        positions.push_back(bodies[body].position);
+        return;
     }
 
-    // Forming vertices for top-down lines of grid
-    for (int idx = -this->gridSquares; idx <= this->gridSquares; idx++) {
-        for (int idz = -this->gridSquares; idz < this->gridSquares; idz++) {
-
-            // Calculating first coordinate for a line segment
-            x = idx * this->gridStep;
-            z_1 = idz * this->gridStep;
+    int nodesPerSide = 2 * this->gridSquares + 1;
+    this->vertices.resize(nodesPerSide * nodesPerSide * 3);
 
-            // Calculating second coordinate for a line segment
-            z_2 = (idz + 1) * this->gridStep;
+    // One field evaluation per grid node, the lines between nodes come from the static index buffer. Only
+    // bodies that moved past the field's tolerance are redrawn, so only the rows they reach are rebuilt
+    this->field.update(this->bodies, nodesPerSide, this->gridStep, this->heights);
 
-            gravity_field = 0;
-
-            for (int body = 0; body < bodies_size; body++) {
-                distance = glm::sqrt(glm::pow(x - positions[body][0], 2) + glm::pow(z_1 - positions[body][2], 2) + glm::pow(0 - positions[body][1], 2));
-                distance = (distance * precision) / precision;
-                
-                if (distance <= this->min_dist) {
-                    distance = this->min_dist;
-                }
-
-                if (distance <= distance_cutoff) {
-                    gravity_field += ((this->G_const * masses[body]) / (distance * distance));
-                }
-            }
-
-            this->vertices.push_back(x);
-            this->vertices.push_back(this->y_value - gravity_field * this->deformation_scale);
-            this->vertices.push_back(z_1);
+    for (int row = this->field.dirty_first_row; row <= this->field.dirty_last_row; row++) {
+        if (!this->field.dirty_rows[row]) {
+            continue;
+        }
 
-            gravity_field = 0;
+        for (int column = 0; column < nodesPerSide; column++) {
+            float x = (column - this->gridSquares) * this->gridStep;
+            float z = (row - this->gridSquares) * this->gridStep;
+            float gravity_field = this->heights[row * nodesPerSide + column];
 
-            for (int body = 0; body < bodies_size; body++) {
-                distance = glm::sqrt(glm::pow(x - positions[body][0], 2) + glm::pow(z_2 - positions[body][2], 2) + glm::pow(0 - positions[body][1], 2));
-                distance = (distance * precision) / precision;
+            float* vertex = &this->vertices[(row * nodesPerSide + column) * 3];
+            vertex[0] = x;
+            vertex[1] = this->y_value - gravity_field * this->deformation_scale;
+            vertex[2] = z;
+        }
+    }
 
-                if (distance <= this->min_dist) {
-                    distance = this->min_dist;
-                }
+    return;
+}
 
-                if (distance <= distance_cutoff) {
-                    gravity_field += ((this->G_const * masses[body]) / (distance * distance));
-                }
-            }
+void Fabric::compute_indices() {
+    int nodesPerSide = 2 * this->gridSquares + 1;
+    this->indices.clear();
 
-            this->vertices.push_back(x);
-            this->vertices.push_back(this->y_value - gravity_field * this->deformation_scale);
-            this->vertices.push_back(z_2);
+    // Line segments along the rows, then along the columns, between neighbouring nodes
+    for (int row = 0; row < nodesPerSide; row++) {
+        for (int column = 0; column + 1 < nodesPerSide; column++) {
+            this->indices.push_back(row * nodesPerSide + column);
+            this->indices.push_back(row * nodesPerSide + column + 1);
+        }
+    }
+    for (int column = 0; column < nodesPerSide; column++) {
+        for (int row = 0; row + 1 < nodesPerSide; row++) {
+            this->indices.push_back(row * nodesPerSide + column);
+            this->indices.push_back((row + 1) * nodesPerSide + column);
         }
     }
 
-    // Forming vertices for left-right lines of grid
-    for (int idz = -this->gridSquares; idz <= this->gridSquares; idz++) {
-        for (int idx = -this->gridSquares; idx < this->gridSquares; idx++) {
+    return;
+}
 
-            // Calculating first coordinate for a line segment
-            x_1 = idx * this->gridStep;
-            z = idz * this->gridStep;
+void Fabric::draw_fabric(const BodyView& bodies) {
+    this->prepare_fabric(bodies);
+    this->render_fabric();
 
-            // Calculating second coordinate for a line segment
-            x_2 = (idx + 1) * this->gridStep;
+    return;
+}
 
-            gravity_field = 0;
+void Fabric::prepare_fabric(const BodyView& bodies) {
+    // Only CPU memory is touched, so this can run off the thread owning the OpenGL context
+    this->bodies = bodies;
 
-            for (int body = 0; body < bodies_size; body++) {
-                distance = glm::sqrt(glm::pow(x_1 - positions[body][0], 2) + glm::pow(z - positions[body][2], 2) + glm::pow(0 - positions[body][1], 2));
+    if (this->deformShader != 0) {
+        this->compute_body_texels();
+    }
+    else {
+        this->compute_vertices();
+    }
 
-                if (distance <= this->min_dist) {
-                    distance = this->min_dist;
-                }
+    return;
+}
 
-                if (distance <= distance_cutoff) {
-                    gravity_field += ((this->G_const * masses[body]) / (distance * distance));
-                }
-            }
+void Fabric::render_fabric() {
+    GLuint program = this->shader;
+
+    if (this->deformShader != 0) {
+        // The grid stays flat on the GPU, only the bodies are uploaded and every vertex sums their field itself.
+        // 16 bytes per body each frame, against 12 bytes per vertex when the CPU deforms the grid
+        this->bodyBuffer.upload(this->bodyTexels.data(), this->bodyTexels.size() * sizeof(float));
+        program = this->deformShader;
+
+        glUseProgram(program);
+        glActiveTexture(GL_TEXTURE0);
+        this->bodyTexture.bind();
+        glUniform1i(glGetUniformLocation(program, "Bodies"), 0);
+        glUniform1i(glGetUniformLocation(program, "BodyCount"), this->bodies.size());
+        glUniform1f(glGetUniformLocation(program, "G_const"), this->G_const);
+        glUniform1f(glGetUniformLocation(program, "MinDist2"), this->min_dist * this->min_dist);
+        glUniform1f(glGetUniformLocation(program, "Cutoff2"), this->distance_cutoff * this->distance_cutoff);
+        glUniform1f(glGetUniformLocation(program, "DeformationScale"), this->deformation_scale);
+    }
+    else {
+        this->update_fabric();
 
-            this->vertices.push_back(x_1);
-            this->vertices.push_back(this->y_value - gravity_field * this->deformation_scale);
-            this->vertices.push_back(z);
+        glUseProgram(program);
+    }
 
-            gravity_field = 0;
+    glm::mat4 Model = glm::mat4(1.0f);
+    Model = glm::translate(Model, this->position);
+    glUniformMatrix4fv(glGetUniformLocation(program, "Model"), 1, GL_FALSE, glm::value_ptr(Model));
 
-            for (int body = 0; body < bodies_size; body++) {
-                distance = glm::sqrt(glm::pow(x_2 - positions[body][0], 2) + glm::pow(z - positions[body][2], 2) + glm::pow(0 - positions[body][1], 2));
+    glUniform4f(glGetUniformLocation(program, "currentColor"), this->color[0], this->color[1], this->color[2], this->color[3]);
+    this->VAO.bind();
+    glDrawElements(GL_LINES, this->indices.size(), GL_UNSIGNED_INT, (void*)0);
+    glBindVertexArray(0);
 
-                if (distance <= this->min_dist) {
-                    distance = this->min_dist;
-                }
-                
-                if (distance <= distance_cutoff) {
-                    gravity_field += ((this->G_const * masses[body]) / (distance * distance));
-                }
-            }
+    return;
+}
 
-            this->vertices.push_back(x_2);
-            this->vertices.push_back(this->y_value - gravity_field * this->deformation_scale);
-            this->vertices.push_back(z);
+void Fabric::use_gpu_deformation(GLuint deformShader) {
+    this->deformShader = deformShader;
+
+    // The quadtree is refined from the field on the CPU, the GPU displaces the uniform grid
+    this->lod.max_vertices = 0;
+    this->vertices.resize((2 * this->gridSquares + 1) * (2 * this->gridSquares + 1) * 3);
+    this->compute_indices();
+
+    int nodesPerSide = 2 * this->gridSquares + 1;
+    for (int row = 0; row < nodesPerSide; row++) {
+        for (int column = 0; column < nodesPerSide; column++) {
+            float* vertex = &this->vertices[(row * nodesPerSide + column) * 3];
+            vertex[0] = (column - this->gridSquares) * this->gridStep;
+            vertex[1] = this->y_value;
+            vertex[2] = (row - this->gridSquares) * this->gridStep;
         }
     }
 
+    // Uploaded once, the flat grid is never rewritten
+    this->VAO.bind();
+    this->VBO.upload(this->vertices.data(), this->vertices.size() * sizeof(float));
+    this->EBO.upload(this->indices.data(), this->indices.size() * sizeof(unsigned int));
+    glBindVertexArray(0);
+
+    // A generated name only becomes a buffer once bound, so the bodies are uploaded before the texture is attached to them
+    this->update_body_buffer();
+    this->bodyTexture.bind();
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, this->bodyBuffer.id());
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
     return;
 }
 
-void Fabric::draw_fabric(std::vector<Body> bodies) {
-    this->bodies = bodies;
+void Fabric::update_body_buffer() {
+    this->compute_body_texels();
+    this->bodyBuffer.upload(this->bodyTexels.data(), this->bodyTexels.size() * sizeof(float));
 
-    this->compute_vertices();
-    this->create_fabric();
+    return;
+}
 
-    glm::mat4 Model = glm::mat4(1.0f);
-    Model = glm::translate(Model, this->position);
-    glUniformMatrix4fv(glGetUniformLocation(this->shader, "Model"), 1, GL_FALSE, glm::value_ptr(Model));
+void Fabric::compute_body_texels() {
+    this->bodyTexels.resize(this->bodies.size() * 4);
 
-    glUniform4f(glGetUniformLocation(this->shader, "currentColor"), this->color[0], this->color[1], this->color[2], this->color[3]);
-    glBindVertexArray(this->VAO);
-    glDrawArrays(GL_LINES, 0, vertices.size() / 3);
+    for (int i = 0; i < this->bodies.size(); i++) {
+        float* texel = &this->bodyTexels[i * 4];
+        texel[0] = this->bodies.x[i];
+        texel[1] = this->bodies.y[i];
+        texel[2] = this->bodies.z[i];
+        texel[3] = this->bodies.mass[i];
+    }
 
     return;
 }
 
 void Fabric::create_fabric() {
-    glGenVertexArrays(1, &this->VAO);
-    glGenBuffers(1, &this->VBO);
-
-    glBindVertexArray(this->VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-    glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(float), this->vertices.data(), GL_STATIC_DRAW);
+    this->VAO.bind();
+    this->VBO.upload(this->vertices.data(), this->vertices.size() * sizeof(float));
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
+    // The grid topology never changes, its index buffer is uploaded once and recorded in the vertex array
+    this->EBO.upload(this->indices.data(), this->indices.size() * sizeof(unsigned int));
+
     glBindVertexArray(0);
 
     return;
-}
\ No newline at end of file
+}
+
+void Fabric::update_fabric() {
+    if (this->lod.max_vertices > 0) {
+        // The quadtree changes its topology every frame, both buffers are rewritten and keep their storage while their size holds
+        this->VBO.upload(this->vertices.data(), this->vertices.size() * sizeof(float));
+
+        this->VAO.bind();
+        this->EBO.upload(this->indices.data(), this->indices.size() * sizeof(unsigned int));
+        glBindVertexArray(0);
+
+        return;
+    }
+
+    // The grid keeps its vertex count, so only the runs of rows changed since the last frame are rewritten in place
+    long long rowFloats = (2 * this->gridSquares + 1) * 3;
+    int row = this->field.dirty_first_row;
+
+    while (row <= this->field.dirty_last_row) {
+        if (!this->field.dirty_rows[row]) {
+            row++;
+            continue;
+        }
+
+        int first = row;
+        while (row <= this->field.dirty_last_row && this->field.dirty_rows[row]) {
+            row++;
+        }
+
+        this->VBO.update(first * rowFloats * sizeof(float), &this->vertices[first * rowFloats], (row - first) * rowFloats * sizeof(float));
+    }
+
+    return;
+}
@@ -0,0 +1,239 @@
+#include "../include/TaskGraph.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+// Rounds an idle worker yields before it sleeps, covering tasks about to be released by a running one
+static const int idle_spins = 64;
+
+TaskGraph::TaskGraph(int threads) {
+    if (threads <= 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads <= 0) {
+        threads = 1;
+    }
+
+    this->steals = 0;
+    this->waiting_size = 0;
+    this->remaining = 0;
+    this->ready = 0;
+    this->pending = 0;
+    this->generation = 0;
+    this->stopping = false;
+
+    for (int worker = 0; worker < threads; worker++) {
+        this->queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+    }
+
+    // The calling thread works as worker 0, so only threads - 1 extra threads are started
+    for (int worker = 1; worker < threads; worker++) {
+        this->workers.push_back(std::thread(&TaskGraph::worker_loop, this, worker));
+    }
+}
+
+TaskGraph::~TaskGraph() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+
+    for (std::thread& worker : this->workers) {
+        worker.join();
+    }
+}
+
+int TaskGraph::size() const {
+    return this->workers.size() + 1;
+}
+
+int TaskGraph::add_task(std::function<void()> work) {
+    Task task;
+    task.work = std::move(work);
+    task.prerequisites = 0;
+
+    this->tasks.push_back(std::move(task));
+
+    return this->tasks.size() - 1;
+}
+
+void TaskGraph::add_dependency(int task, int prerequisite) {
+    this->tasks[prerequisite].successors.push_back(task);
+    this->tasks[task].prerequisites++;
+
+    return;
+}
+
+void TaskGraph::push(int worker, int task) {
+    WorkQueue& queue = *this->queues[worker];
+    {
+        std::lock_guard<std::mutex> lock(queue.lock);
+        queue.tasks[queue.tail++] = task;
+    }
+
+    // Taking the idle mutex after counting the task means a worker about to sleep either sees it or is woken
+    this->ready.fetch_add(1, std::memory_order_acq_rel);
+    {
+        std::lock_guard<std::mutex> lock(this->idle_mutex);
+    }
+    this->idle.notify_one();
+
+    return;
+}
+
+bool TaskGraph::pop(int worker, int& task) {
+    WorkQueue& queue = *this->queues[worker];
+    std::lock_guard<std::mutex> lock(queue.lock);
+
+    if (queue.tail == queue.head) {
+        return false;
+    }
+
+    task = queue.tasks[--queue.tail];
+    this->ready.fetch_sub(1, std::memory_order_acq_rel);
+
+    return true;
+}
+
+bool TaskGraph::steal(int worker, int& task) {
+    int threads = this->size();
+
+    for (int offset = 1; offset < threads; offset++) {
+        WorkQueue& queue = *this->queues[(worker + offset) % threads];
+        std::lock_guard<std::mutex> lock(queue.lock);
+
+        if (queue.tail != queue.head) {
+            task = queue.tasks[queue.head++];
+            this->ready.fetch_sub(1, std::memory_order_acq_rel);
+            this->steals.fetch_add(1, std::memory_order_relaxed);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TaskGraph::work(int worker) {
+    int task;
+    int idle_rounds = 0;
+
+    while (this->remaining.load(std::memory_order_acquire) > 0) {
+        if (!this->pop(worker, task) && !this->steal(worker, task)) {
+            if (++idle_rounds < idle_spins) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(this->idle_mutex);
+            this->idle.wait(lock, [&]() { return this->ready.load(std::memory_order_acquire) > 0 || this->remaining.load(std::memory_order_acquire) == 0; });
+            idle_rounds = 0;
+            continue;
+        }
+
+        idle_rounds = 0;
+        this->tasks[task].work();
+
+        // The last prerequisite to finish hands the successor to its own worker
+        for (int successor : this->tasks[task].successors) {
+            if (this->waiting[successor].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                this->push(worker, successor);
+            }
+        }
+
+        // The last task of the run wakes every sleeping worker so they leave
+        if (this->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            {
+                std::lock_guard<std::mutex> lock(this->idle_mutex);
+            }
+            this->idle.notify_all();
+        }
+    }
+
+    return;
+}
+
+void TaskGraph::worker_loop(int worker) {
+    long seen = 0;
+
+    while (true) {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->wake.wait(lock, [&]() { return this->stopping || this->generation != seen; });
+
+        if (this->stopping) {
+            return;
+        }
+
+        seen = this->generation;
+        lock.unlock();
+
+        this->work(worker);
+
+        lock.lock();
+        this->pending--;
+        if (this->pending == 0) {
+            this->done.notify_one();
+        }
+    }
+}
+
+void TaskGraph::run() {
+    int count = this->tasks.size();
+
+    if (count == 0) {
+        return;
+    }
+
+    // Storage is only reallocated when tasks were added since the last run
+    if (this->waiting_size != count) {
+        this->waiting.reset(new std::atomic<int>[count]);
+        this->waiting_size = count;
+
+        for (auto& queue : this->queues) {
+            queue->tasks.resize(count);
+        }
+    }
+
+    for (auto& queue : this->queues) {
+        queue->head = 0;
+        queue->tail = 0;
+    }
+
+    // Tasks without prerequisites are dealt round the workers, the rest wait for their prerequisites
+    int threads = this->size();
+    int dealt = 0;
+
+    for (int task = 0; task < count; task++) {
+        this->waiting[task].store(this->tasks[task].prerequisites, std::memory_order_relaxed);
+
+        if (this->tasks[task].prerequisites == 0) {
+            this->push(dealt++ % threads, task);
+        }
+    }
+
+    this->remaining.store(count, std::memory_order_release);
+
+    if (!this->workers.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->pending = this->workers.size();
+            this->generation++;
+        }
+        this->wake.notify_all();
+    }
+
+    this->work(0);
+
+    // Every worker has left its loop before the deques are reset by the next run
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->done.wait(lock, [&]() { return this->pending == 0; });
+
+    return;
+}
@@ -0,0 +1,118 @@
+#include "../include/ThreadPool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+ThreadPool::ThreadPool(int threads) {
+    if (threads <= 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads <= 0) {
+        threads = 1;
+    }
+
+    this->task = nullptr;
+    this->count = 0;
+    this->pending = 0;
+    this->generation = 0;
+    this->stopping = false;
+
+    // The calling thread works as worker 0, so only threads - 1 extra threads are started
+    for (int worker = 1; worker < threads; worker++) {
+        this->workers.push_back(std::thread(&ThreadPool::worker_loop, this, worker));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+
+    for (std::thread& worker : this->workers) {
+        worker.join();
+    }
+}
+
+int ThreadPool::size() const {
+    return this->workers.size() + 1;
+}
+
+void ThreadPool::run_chunk(int worker) {
+    int threads = this->size();
+    int begin = (int)((long long)this->count * worker / threads);
+    int end = (int)((long long)this->count * (worker + 1) / threads);
+
+    if (end > begin) {
+        (*this->task)(begin, end, worker);
+    }
+
+    return;
+}
+
+void ThreadPool::worker_loop(int worker) {
+    long seen = 0;
+
+    while (true) {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->wake.wait(lock, [&]() { return this->stopping || this->generation != seen; });
+
+        if (this->stopping) {
+            return;
+        }
+
+        seen = this->generation;
+        lock.unlock();
+
+        this->run_chunk(worker);
+
+        lock.lock();
+        this->pending--;
+        if (this->pending == 0) {
+            this->done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::parallel_for(int count, TaskRef task) {
+    if (this->workers.empty() || count < 2) {
+        if (count > 0) {
+            task(0, count, 0);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->task = &task;
+        this->count = count;
+        this->pending = this->workers.size();
+        this->generation++;
+    }
+    this->wake.notify_all();
+
+    this->run_chunk(0);
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->done.wait(lock, [&]() { return this->pending == 0; });
+    this->task = nullptr;
+
+    return;
+}
+
+void parallel_for(ThreadPool* pool, int count, TaskRef task) {
+    if (pool == nullptr) {
+        if (count > 0) {
+            task(0, count, 0);
+        }
+        return;
+    }
+
+    pool->parallel_for(count, task);
+
+    return;
+}
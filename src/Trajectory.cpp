@@ -0,0 +1,525 @@
+#include "../include/Trajectory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "../include/BodySystem.h"
+
+static_assert(sizeof(TrajectoryHeader) == 40, "trajectory header must have no padding");
+static_assert(sizeof(TrajectoryChunk) == 64, "trajectory index entries must have no padding");
+
+// Largest chunk of raw values, bounding the memory of the writer's buffers and of a reader's cached chunk
+const long long max_chunk_bytes = 32LL << 20;
+
+TrajectoryCompression trajectory_compression(const std::string name) {
+    if (name == "raw") {
+        return trajectory_raw;
+    }
+    if (name == "quantized") {
+        return trajectory_quantized;
+    }
+    if (name != "delta") {
+        printf("Unknown trajectory_compression '%s', falling back to delta\n", name.c_str());
+    }
+
+    return trajectory_delta;
+}
+
+static bool seek_file(FILE* file, uint64_t offset, int origin) {
+#ifdef _WIN32
+    return _fseeki64(file, offset, origin) == 0;
+#else
+    return fseeko(file, offset, origin) == 0;
+#endif
+}
+
+static uint64_t file_position(FILE* file) {
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return ftello(file);
+#endif
+}
+
+// Nearest multiple of the quantum, clamped so the integer and the differences of two of them never overflow
+static int64_t quantize(double value, double quantum) {
+    double scaled = value / quantum;
+
+    if (!std::isfinite(scaled)) {
+        return 0;
+    }
+
+    return std::llround(std::min(std::max(scaled, -4e18), 4e18));
+}
+
+// Zigzag folds the sign into the lowest bit, so small values of either sign take few bytes
+static void put_varint(std::vector<unsigned char>& out, int64_t value) {
+    uint64_t folded = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+
+    while (folded >= 0x80) {
+        out.push_back((unsigned char)(folded | 0x80));
+        folded >>= 7;
+    }
+    out.push_back((unsigned char)folded);
+
+    return;
+}
+
+static bool get_varint(const std::vector<unsigned char>& in, size_t& cursor, int64_t& value) {
+    uint64_t folded = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (cursor >= in.size()) {
+            return false;
+        }
+
+        unsigned char byte = in[cursor++];
+        folded |= (uint64_t)(byte & 0x7f) << shift;
+
+        if (byte < 0x80) {
+            value = (int64_t)(folded >> 1) ^ -(int64_t)(folded & 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+TrajectoryWriter::TrajectoryWriter(const std::string filename, int body_count, TrajectoryCompression compression,
+    double quantum, int chunk_frames, bool velocities) {
+    this->frames_written = 0;
+    this->bytes_written = 0;
+    this->current = nullptr;
+    this->stopping = false;
+    this->failed = false;
+    this->frames_before = 0;
+
+    long long frame_values = (long long)body_count * (velocities ? 6 : 3);
+
+    memset(&this->header, 0, sizeof(this->header));
+    memcpy(this->header.magic, "CHIROTRJ", 8);
+    this->header.version = trajectory_version;
+    this->header.columns = velocities ? 6 : 3;
+    this->header.body_count = body_count;
+    this->header.quantum = (quantum > 0.0) ? quantum : 1e-6;
+    this->header.compression = compression;
+    this->header.chunk_frames = std::max(1LL, std::min((long long)std::max(chunk_frames, 1), max_chunk_bytes / std::max(frame_values * 8, 1LL)));
+
+    this->file = fopen(filename.c_str(), "wb");
+    this->index = fopen((filename + ".index").c_str(), "wb");
+
+    TrajectoryHeader index_header = this->header;
+    memcpy(index_header.magic, "CHIROTRI", 8);
+
+    if (this->file == nullptr || this->index == nullptr || fwrite(&this->header, sizeof(this->header), 1, this->file) != 1
+        || fwrite(&index_header, sizeof(index_header), 1, this->index) != 1) {
+        printf("Could not create trajectory '%s'\n", filename.c_str());
+        this->close();
+        return;
+    }
+
+    // One chunk filling while one is written, allocated before the run so its first frames do not pay for them
+    for (int buffer = 0; buffer < 2; buffer++) {
+        this->free_buffers.push_back(this->take_buffer());
+    }
+
+    this->file_offset = sizeof(this->header);
+    this->worker = std::thread(&TrajectoryWriter::run, this);
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    this->close();
+}
+
+bool TrajectoryWriter::is_open() const {
+    return this->file != nullptr;
+}
+
+TrajectoryWriter::ChunkBuffer* TrajectoryWriter::take_buffer() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    if (!this->free_buffers.empty()) {
+        ChunkBuffer* buffer = this->free_buffers.back();
+        this->free_buffers.pop_back();
+        return buffer;
+    }
+
+    // A new buffer is only needed while the I/O thread holds every existing one
+    int frames = this->header.chunk_frames;
+    std::unique_ptr<ChunkBuffer> buffer(new ChunkBuffer());
+    buffer->steps.resize(frames);
+    buffer->times.resize(frames);
+    buffer->values.resize((size_t)frames * this->header.columns * this->header.body_count);
+    buffer->frames = 0;
+
+    this->buffers.push_back(std::move(buffer));
+
+    return this->buffers.back().get();
+}
+
+void TrajectoryWriter::append(const BodyView& bodies, long step, double sim_time) {
+    if (!this->is_open() || bodies.size() != (int)this->header.body_count) {
+        return;
+    }
+
+    if (this->current == nullptr) {
+        this->current = this->take_buffer();
+    }
+
+    ChunkBuffer& chunk = *this->current;
+    int size = bodies.size();
+    const double* columns[6] = {bodies.x, bodies.y, bodies.z, bodies.vx, bodies.vy, bodies.vz};
+    double* values = chunk.values.data() + (size_t)chunk.frames * this->header.columns * size;
+
+    for (uint32_t column = 0; column < this->header.columns; column++) {
+        std::copy(columns[column], columns[column] + size, values + (size_t)column * size);
+    }
+
+    chunk.steps[chunk.frames] = step;
+    chunk.times[chunk.frames] = sim_time;
+    chunk.frames++;
+
+    if (chunk.frames == (int)this->header.chunk_frames) {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->queue.push_back(this->current);
+        }
+        this->wake.notify_one();
+        this->current = nullptr;
+    }
+
+    return;
+}
+
+int TrajectoryWriter::pending_chunks() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->queue.size();
+}
+
+void TrajectoryWriter::close() {
+    if (this->worker.joinable()) {
+        // The partly filled chunk is written as a shorter one
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (this->current != nullptr && this->current->frames > 0) {
+                this->queue.push_back(this->current);
+            }
+            this->current = nullptr;
+            this->stopping = true;
+        }
+        this->wake.notify_one();
+        this->worker.join();
+    }
+
+    if (this->file != nullptr) {
+        fclose(this->file);
+    }
+    if (this->index != nullptr) {
+        fclose(this->index);
+    }
+    this->file = nullptr;
+    this->index = nullptr;
+
+    return;
+}
+
+void TrajectoryWriter::run() {
+    while (true) {
+        ChunkBuffer* chunk;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->wake.wait(lock, [this]() { return !this->queue.empty() || this->stopping; });
+
+            // Stopping still drains every queued chunk first
+            if (this->queue.empty()) {
+                break;
+            }
+
+            chunk = this->queue.front();
+            this->queue.pop_front();
+        }
+
+        this->write_chunk(*chunk);
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        chunk->frames = 0;
+        this->free_buffers.push_back(chunk);
+    }
+
+    return;
+}
+
+void TrajectoryWriter::write_chunk(const ChunkBuffer& chunk) {
+    if (this->failed) {
+        return;
+    }
+
+    int frames = chunk.frames;
+    size_t frame_values = (size_t)this->header.columns * this->header.body_count;
+    TrajectoryCompression compression = (TrajectoryCompression)this->header.compression;
+
+    this->encoded.clear();
+
+    if (compression == trajectory_raw) {
+        const unsigned char* raw = (const unsigned char*)chunk.values.data();
+        this->encoded.assign(raw, raw + frames * frame_values * sizeof(double));
+    }
+    else {
+        this->previous.assign(frame_values, 0);
+
+        for (int frame = 0; frame < frames; frame++) {
+            const double* values = chunk.values.data() + frame * frame_values;
+
+            for (size_t value = 0; value < frame_values; value++) {
+                int64_t quantized = quantize(values[value], this->header.quantum);
+
+                put_varint(this->encoded, (compression == trajectory_delta) ? quantized - this->previous[value] : quantized);
+                this->previous[value] = quantized;
+            }
+
+            // Encoding a chunk takes a while, so on a busy processor the physics thread gets the core back between frames
+            std::this_thread::yield();
+        }
+    }
+
+    TrajectoryChunk entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.first_step = chunk.steps[0];
+    entry.last_step = chunk.steps[frames - 1];
+    entry.first_time = chunk.times[0];
+    entry.last_time = chunk.times[frames - 1];
+    entry.first_frame = this->frames_before;
+    entry.offset = this->file_offset;
+    entry.bytes = frames * (sizeof(int64_t) + sizeof(double)) + this->encoded.size();
+    entry.frames = frames;
+    entry.compression = compression;
+
+    // The chunk is flushed before its index entry, so the index only ever lists complete chunks
+    bool written = fwrite(chunk.steps.data(), sizeof(int64_t), frames, this->file) == (size_t)frames
+        && fwrite(chunk.times.data(), sizeof(double), frames, this->file) == (size_t)frames
+        && fwrite(this->encoded.data(), 1, this->encoded.size(), this->file) == this->encoded.size()
+        && fflush(this->file) == 0
+        && fwrite(&entry, sizeof(entry), 1, this->index) == 1
+        && fflush(this->index) == 0;
+
+    if (!written) {
+        printf("Could not write the trajectory, frames from step %lld on are lost\n", (long long)entry.first_step);
+        this->failed = true;
+        return;
+    }
+
+    this->file_offset += entry.bytes;
+    this->frames_before += frames;
+    this->frames_written += frames;
+    this->bytes_written = this->file_offset;
+
+    return;
+}
+
+TrajectoryReader::TrajectoryReader() {
+    memset(&this->header, 0, sizeof(this->header));
+    this->file = nullptr;
+    this->cached_chunk = -1;
+    this->decoded_frame = -1;
+    this->cursor = 0;
+}
+
+TrajectoryReader::~TrajectoryReader() {
+    this->close();
+}
+
+bool TrajectoryReader::open(const std::string filename) {
+    this->close();
+
+    FILE* index = fopen((filename + ".index").c_str(), "rb");
+    this->file = fopen(filename.c_str(), "rb");
+
+    TrajectoryHeader index_header;
+    bool valid = index != nullptr && this->file != nullptr
+        && fread(&index_header, sizeof(index_header), 1, index) == 1
+        && fread(&this->header, sizeof(this->header), 1, this->file) == 1
+        && memcmp(index_header.magic, "CHIROTRI", 8) == 0 && memcmp(this->header.magic, "CHIROTRJ", 8) == 0
+        && this->header.version == trajectory_version && index_header.version == trajectory_version
+        && index_header.body_count == this->header.body_count && index_header.columns == this->header.columns
+        && (this->header.columns == 3 || this->header.columns == 6);
+
+    // A writer stopped mid-chunk leaves a partial entry or bytes past the last entry, both are ignored
+    uint64_t file_bytes = (valid && seek_file(this->file, 0, SEEK_END)) ? file_position(this->file) : 0;
+    TrajectoryChunk entry;
+
+    while (valid && fread(&entry, sizeof(entry), 1, index) == 1) {
+        uint64_t first_frame = this->chunks.empty() ? 0 : this->chunks.back().first_frame + this->chunks.back().frames;
+
+        if (entry.frames == 0 || entry.first_frame != first_frame || entry.offset > file_bytes || entry.bytes > file_bytes - entry.offset) {
+            break;
+        }
+        this->chunks.push_back(entry);
+    }
+
+    if (index != nullptr) {
+        fclose(index);
+    }
+
+    if (!valid) {
+        printf("'%s' is not a version %u trajectory with an index\n", filename.c_str(), trajectory_version);
+        this->close();
+        return false;
+    }
+
+    return true;
+}
+
+void TrajectoryReader::close() {
+    if (this->file != nullptr) {
+        fclose(this->file);
+    }
+
+    this->file = nullptr;
+    this->chunks.clear();
+    this->cached_chunk = -1;
+    this->decoded_frame = -1;
+
+    return;
+}
+
+long long TrajectoryReader::frame_count() const {
+    return this->chunks.empty() ? 0 : this->chunks.back().first_frame + this->chunks.back().frames;
+}
+
+bool TrajectoryReader::load_chunk(int chunk) {
+    const TrajectoryChunk& entry = this->chunks[chunk];
+
+    this->cached_chunk = -1;
+    this->chunk_bytes.resize(entry.bytes);
+
+    if (!seek_file(this->file, entry.offset, SEEK_SET) || fread(this->chunk_bytes.data(), 1, entry.bytes, this->file) != entry.bytes) {
+        printf("Could not read the trajectory chunk at frame %llu\n", (unsigned long long)entry.first_frame);
+        return false;
+    }
+
+    this->cached_chunk = chunk;
+    this->decoded_frame = -1;
+    this->cursor = entry.frames * (sizeof(int64_t) + sizeof(double));
+    this->previous.assign((size_t)this->header.columns * this->header.body_count, 0);
+    this->values.resize(this->previous.size());
+
+    return true;
+}
+
+bool TrajectoryReader::decode_next() {
+    const TrajectoryChunk& entry = this->chunks[this->cached_chunk];
+    size_t frame_values = this->values.size();
+
+    if (entry.compression == trajectory_raw) {
+        if (this->cursor + frame_values * sizeof(double) > this->chunk_bytes.size()) {
+            return false;
+        }
+
+        memcpy(this->values.data(), this->chunk_bytes.data() + this->cursor, frame_values * sizeof(double));
+        this->cursor += frame_values * sizeof(double);
+    }
+    else {
+        for (size_t value = 0; value < frame_values; value++) {
+            int64_t stored;
+            if (!get_varint(this->chunk_bytes, this->cursor, stored)) {
+                return false;
+            }
+
+            this->previous[value] = (entry.compression == trajectory_delta) ? this->previous[value] + stored : stored;
+            this->values[value] = this->previous[value] * this->header.quantum;
+        }
+    }
+
+    this->decoded_frame++;
+
+    return true;
+}
+
+bool TrajectoryReader::read_frame(long long frame, TrajectoryFrame& result) {
+    if (this->file == nullptr || frame < 0 || frame >= this->frame_count()) {
+        return false;
+    }
+
+    // Last chunk starting at or before the frame
+    auto found = std::upper_bound(this->chunks.begin(), this->chunks.end(), (uint64_t)frame,
+        [](uint64_t value, const TrajectoryChunk& entry) { return value < entry.first_frame; });
+    int chunk = (found - this->chunks.begin()) - 1;
+    int target = frame - this->chunks[chunk].first_frame;
+
+    // Frames of raw chunks stand alone, the others are decoded in order from the start of their chunk
+    if (chunk != this->cached_chunk || target <= this->decoded_frame) {
+        if (chunk != this->cached_chunk && !this->load_chunk(chunk)) {
+            return false;
+        }
+
+        this->decoded_frame = -1;
+        this->cursor = this->chunks[chunk].frames * (sizeof(int64_t) + sizeof(double));
+        std::fill(this->previous.begin(), this->previous.end(), 0);
+    }
+
+    if (this->chunks[chunk].compression == trajectory_raw && target > this->decoded_frame + 1) {
+        this->cursor += (target - this->decoded_frame - 1) * this->values.size() * sizeof(double);
+        this->decoded_frame = target - 1;
+    }
+
+    while (this->decoded_frame < target) {
+        if (!this->decode_next()) {
+            printf("Trajectory chunk at frame %llu is corrupt\n", (unsigned long long)this->chunks[chunk].first_frame);
+            this->cached_chunk = -1;
+            return false;
+        }
+    }
+
+    int frames = this->chunks[chunk].frames;
+    int size = this->header.body_count;
+    std::vector<double>* columns[6] = {&result.x, &result.y, &result.z, &result.vx, &result.vy, &result.vz};
+
+    int64_t step;
+    memcpy(&step, this->chunk_bytes.data() + target * sizeof(int64_t), sizeof(step));
+    memcpy(&result.sim_time, this->chunk_bytes.data() + frames * sizeof(int64_t) + target * sizeof(double), sizeof(double));
+    result.step = step;
+
+    for (int column = 0; column < 6; column++) {
+        if (column < (int)this->header.columns) {
+            columns[column]->assign(this->values.begin() + (size_t)column * size, this->values.begin() + (size_t)(column + 1) * size);
+        }
+        else {
+            columns[column]->clear();
+        }
+    }
+
+    return true;
+}
+
+bool TrajectoryReader::read_step(long step, TrajectoryFrame& result) {
+    // First chunk ending at or after the step, steps grow from chunk to chunk
+    auto found = std::lower_bound(this->chunks.begin(), this->chunks.end(), (int64_t)step,
+        [](const TrajectoryChunk& entry, int64_t value) { return entry.last_step < value; });
+
+    if (found == this->chunks.end() || found->first_step > step) {
+        return false;
+    }
+
+    int chunk = found - this->chunks.begin();
+    if (chunk != this->cached_chunk && !this->load_chunk(chunk)) {
+        return false;
+    }
+
+    for (uint32_t frame = 0; frame < found->frames; frame++) {
+        int64_t stored;
+        memcpy(&stored, this->chunk_bytes.data() + frame * sizeof(int64_t), sizeof(stored));
+
+        if (stored == step) {
+            return this->read_frame(found->first_frame + frame, result);
+        }
+    }
+
+    return false;
+}
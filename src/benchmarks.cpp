@@ -0,0 +1,1900 @@
+// Headless benchmarks and accuracy reports for the libchiro core
+// Usage: benchmarks <report> [arguments]
+//   bh-accuracy [N | bodies json file] [theta ...] -> Barnes-Hut error and speed against direct summation
+//   fmm-scaling [max N] [order] [theta] [tree theta] -> FMM scaling and crossover against direct summation and Barnes-Hut
+//   simd [N ...] -> pairwise interactions per second of the scalar, AVX2 and AVX-512 direct summation kernels
+//   threads [N] [force solver] [max threads] -> strong scaling of one force evaluation over 1..max threads
+//   energy-drift [N | bodies json file] [simulated time] [time step ...] -> energy error of every integrator against the time step
+//   pm-accuracy [N] [grid size ...] -> Particle-Mesh error and speed against direct summation for a uniform cloud
+//   p3m-accuracy [N] [grid size] [cutoff ...] -> P3M error and speed against Particle-Mesh and direct summation for a clumpy sphere
+//   convergence [N | bodies json file] [simulated time] [max steps] -> position error against step count and cost of every integrator
+//   wisdom-holman [stars] [planets per star] [simulated time] -> energy error of Wisdom-Holman against Cartesian integrators for planetary systems
+//   block-timesteps [stars] [planets per star] [simulated time] [accuracy ...] -> force evaluations of block timesteps against one global timestep of the same energy error
+//   allocations [N ...] [force solver ...] -> heap allocations of steady-state frames of stepping and reading the bodies, fails on any
+//   fabric [grid squares] [max threads] [N ...] -> spacetime fabric nodes x bodies per second for every SIMD level and thread count
+//   fabric-cutoff [grid squares] [cutoff] [N ...] -> fabric evaluation time with and without the spatial index of the distance cutoff
+//   fabric-incremental [grid squares] [cutoff] [N] [moving bodies] [frames] -> per frame fabric cost of incremental updates against full evaluation
+//   fabric-lod [grid squares] [vertex budget ...] -> error of quadtree refined fabrics, with and without the camera weight, against uniform grids of as many vertices
+//   fixed-timestep [N] [wall seconds] -> simulated time and smoothness of fixed timestep pacing against one step per frame
+//   physics-thread [N] [frames] -> render thread cost per frame of stepping in the frame against reading snapshots of a physics thread
+//   task-graph [N] [grid squares] [frames] -> frame time of the viewer's CPU stages run serially and as a task graph, and the scheduling overhead
+//   checkpoint [N] -> exactness of restarts for every integrator, and checkpoint save, open and restore time against parsing json
+//   trajectory [N] [frames] -> physics side cost, size, error and random access time of trajectory output for every compression
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+#include "../include/BodySystem.h"
+#include "../include/Simulation.h"
+#include "../include/ForceSolver.h"
+#include "../include/BarnesHut.h"
+#include "../include/FastMultipole.h"
+#include "../include/ParticleMesh.h"
+#include "../include/P3M.h"
+#include "../include/DirectSumKernel.h"
+#include "../include/ThreadPool.h"
+#include "../include/Integrator.h"
+#include "../include/FabricField.h"
+#include "../include/FabricLod.h"
+#include "../include/SimulationClock.h"
+#include "../include/PhysicsThread.h"
+#include "../include/TaskGraph.h"
+#include "../include/Checkpoint.h"
+#include "../include/Trajectory.h"
+#include "../include/json.hpp"
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <new>
+
+const double bench_pi = 3.14159265358979323846;
+
+// Every heap allocation of the process goes through these, so a report can count them
+std::atomic<long long> heap_allocations(0);
+
+void* operator new(std::size_t size) {
+    heap_allocations++;
+
+    void* memory = malloc(size > 0 ? size : 1);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    return memory;
+}
+
+// The replacement new allocates with malloc, which GCC cannot see once these are inlined into a caller
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    free(memory);
+}
+#pragma GCC diagnostic pop
+
+// Plummer sphere of equal mass bodies with total mass 1 and scale radius 1, a standard clustered test system
+BodySystem make_plummer_sphere(int count, unsigned int seed) {
+    BodySystem system;
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    for (int i = 0; i < count; i++) {
+        double radius = 1.0 / std::sqrt(std::pow(uniform(generator) * 0.999 + 1e-6, -2.0 / 3.0) - 1.0);
+        double cos_theta = 2.0 * uniform(generator) - 1.0;
+        double sin_theta = std::sqrt(1.0 - cos_theta * cos_theta);
+        double phi = 2.0 * bench_pi * uniform(generator);
+
+        double speed = 0.1 * std::sqrt(2.0) * std::pow(1.0 + radius * radius, -0.25);
+        double v_cos_theta = 2.0 * uniform(generator) - 1.0;
+        double v_sin_theta = std::sqrt(1.0 - v_cos_theta * v_cos_theta);
+        double v_phi = 2.0 * bench_pi * uniform(generator);
+
+        system.add_body("body" + std::to_string(i), 1.0 / count, 0.01,
+            radius * sin_theta * std::cos(phi), radius * sin_theta * std::sin(phi), radius * cos_theta,
+            speed * v_sin_theta * std::cos(v_phi), speed * v_sin_theta * std::sin(v_phi), speed * v_cos_theta,
+            {1.0f, 1.0f, 1.0f, 1.0f}, -1);
+    }
+
+    return system;
+}
+
+// Uniform sphere of radius 1 of equal mass bodies with total mass 1, the dense and smooth case of mesh solvers
+BodySystem make_uniform_sphere(int count, unsigned int seed) {
+    BodySystem system;
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+    while (system.size() < count) {
+        double position[3] = {uniform(generator), uniform(generator), uniform(generator)};
+
+        if (position[0] * position[0] + position[1] * position[1] + position[2] * position[2] > 1.0) {
+            continue;
+        }
+
+        system.add_body("body" + std::to_string(system.size()), 1.0 / count, 0.01, position[0], position[1], position[2], 0.0, 0.0, 0.0, {1.0f, 1.0f, 1.0f, 1.0f}, -1);
+    }
+
+    return system;
+}
+
+// Uniform sphere of radius 1 where half the bodies sit in small Plummer clumps, clustered but resolvable by a mesh
+BodySystem make_clumpy_sphere(int count, int clumps, unsigned int seed) {
+    BodySystem system = make_uniform_sphere(count - count / 2, seed);
+    BodySystem centers = make_uniform_sphere(clumps, seed + 1);
+    std::mt19937 generator(seed + 2);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    for (int i = 0; i < count / 2; i++) {
+        int clump = i % clumps;
+        double radius = 0.01 / std::sqrt(std::pow(uniform(generator) * 0.99 + 1e-6, -2.0 / 3.0) - 1.0);
+        double cos_theta = 2.0 * uniform(generator) - 1.0;
+        double sin_theta = std::sqrt(1.0 - cos_theta * cos_theta);
+        double phi = 2.0 * bench_pi * uniform(generator);
+
+        system.add_body("clumped" + std::to_string(i), 1.0 / count, 0.01,
+            centers.x[clump] + radius * sin_theta * std::cos(phi), centers.y[clump] + radius * sin_theta * std::sin(phi), centers.z[clump] + radius * cos_theta,
+            0.0, 0.0, 0.0, {1.0f, 1.0f, 1.0f, 1.0f}, -1);
+    }
+
+    for (int i = 0; i < system.size(); i++) {
+        system.mass[i] = 1.0 / system.size();
+    }
+
+    return system;
+}
+
+// Stars of mass 1 scattered over a wide cluster, each with light planets on circular orbits whose periods span a factor of 1000
+BodySystem make_planetary_systems(int stars, int planets, unsigned int seed) {
+    BodySystem system;
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    for (int s = 0; s < stars; s++) {
+        double star[3] = {1000.0 * (uniform(generator) - 0.5), 1000.0 * (uniform(generator) - 0.5), 1000.0 * (uniform(generator) - 0.5)};
+        double drift[3] = {0.01 * (uniform(generator) - 0.5), 0.01 * (uniform(generator) - 0.5), 0.01 * (uniform(generator) - 0.5)};
+        int host = system.size();
+
+        system.add_body("star" + std::to_string(s), 1.0, 0.1, star[0], star[1], star[2], drift[0], drift[1], drift[2], {1.0f, 1.0f, 0.0f, 1.0f}, -1);
+
+        for (int p = 0; p < planets; p++) {
+            double radius = 0.1 * std::pow(100.0, uniform(generator));
+            double phi = 2.0 * bench_pi * uniform(generator);
+            double speed = std::sqrt(1.0 / radius);
+
+            system.add_body("planet" + std::to_string(s) + "_" + std::to_string(p), 1e-7, 0.01,
+                star[0] + radius * std::cos(phi), star[1] + radius * std::sin(phi), star[2],
+                drift[0] - speed * std::sin(phi), drift[1] + speed * std::cos(phi), drift[2],
+                {0.0f, 0.5f, 1.0f, 1.0f}, host);
+        }
+    }
+
+    return system;
+}
+
+// Either a generated Plummer sphere of N bodies or a scenario loaded from a bodies json file
+BodySystem load_scenario(const std::string argument, SimulationConfig& configs) {
+    if (argument.size() > 5 && argument.substr(argument.size() - 5) == ".json") {
+        configs = load_simulation_config("data/Configurations.json");
+        return BodySystem(argument, configs.E_val_km, configs.E_val_kg);
+    }
+
+    configs.E_val_km = 1.0f;
+    configs.E_val_kg = 1.0f;
+    configs.G_const = 1.0f;
+    configs.softening = 1e-3f;
+    configs.time_step = 1e-3f;
+    configs.integrator = "leapfrog";
+    configs.timestep_accuracy = 1.0f;
+    configs.max_timestep_level = 12;
+    configs.force_solver = "direct";
+    configs.opening_angle = 0.5f;
+    configs.fmm_order = 4;
+    configs.pm_grid = 64;
+    configs.p3m_cutoff = 0.0f;
+    configs.min_dist = 0.0f;
+    configs.threads = 0;
+    configs.trajectory_compression = "delta";
+    configs.trajectory_quantum = 1e-6f;
+    configs.trajectory_chunk_frames = 64;
+
+    return make_plummer_sphere(atoi(argument.c_str()), 42);
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Relative acceleration error of every body against the reference, sorted ascending
+std::vector<double> relative_errors(const std::vector<double> reference[3], const std::vector<double> approximate[3]) {
+    int size = reference[0].size();
+    std::vector<double> errors(size);
+
+    for (int i = 0; i < size; i++) {
+        double difference = 0.0;
+        double magnitude = 0.0;
+
+        for (int axis = 0; axis < 3; axis++) {
+            double delta = approximate[axis][i] - reference[axis][i];
+            difference += delta * delta;
+            magnitude += reference[axis][i] * reference[axis][i];
+        }
+
+        errors[i] = (magnitude > 0.0) ? std::sqrt(difference / magnitude) : std::sqrt(difference);
+    }
+
+    std::sort(errors.begin(), errors.end());
+
+    return errors;
+}
+
+// Median and maximum relative error of a few sampled bodies against direct summation, affordable at any N
+void sampled_errors(const BodySystem& system, const SimulationConfig& configs, const std::vector<double> approximate[3], int samples, double& median, double& maximum) {
+    int size = system.size();
+    double eps2 = configs.softening * configs.softening;
+    std::vector<double> reference[3];
+    std::vector<double> picked[3];
+
+    samples = std::min(samples, size);
+
+    for (int s = 0; s < samples; s++) {
+        int i = (int)((long long)s * size / samples);
+        double gravity[3] = {0.0, 0.0, 0.0};
+
+        for (int j = 0; j < size; j++) {
+            if (j == i) {
+                continue;
+            }
+
+            double R[3] = {system.x[j] - system.x[i], system.y[j] - system.y[i], system.z[j] - system.z[i]};
+            double R2 = R[0] * R[0] + R[1] * R[1] + R[2] * R[2] + eps2;
+            double R_inv = 1.0 / std::sqrt(R2);
+            double gravity_total = configs.G_const * system.mass[j] * R_inv * R_inv * R_inv;
+
+            for (int axis = 0; axis < 3; axis++) {
+                gravity[axis] += gravity_total * R[axis];
+            }
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            reference[axis].push_back(gravity[axis]);
+            picked[axis].push_back(approximate[axis][i]);
+        }
+    }
+
+    std::vector<double> errors = relative_errors(reference, picked);
+    median = samples > 0 ? errors[samples / 2] : 0.0;
+    maximum = samples > 0 ? errors[samples - 1] : 0.0;
+
+    return;
+}
+
+int bh_accuracy(int argc, char* argv[]) {
+    SimulationConfig configs;
+    BodySystem system = load_scenario(argc > 2 ? argv[2] : "20000", configs);
+    int size = system.size();
+
+    std::vector<float> thetas;
+    for (int i = 3; i < argc; i++) {
+        thetas.push_back(atof(argv[i]));
+    }
+    if (thetas.empty()) {
+        thetas = {0.2f, 0.3f, 0.5f, 0.7f, 1.0f};
+    }
+
+    std::vector<double> reference[3];
+    DirectSumSolver direct;
+
+    auto start = std::chrono::steady_clock::now();
+    direct.compute_accelerations(system, configs.G_const, configs.softening, reference[0], reference[1], reference[2]);
+    double direct_seconds = seconds_since(start);
+
+    printf("Barnes-Hut accuracy against direct summation, %d bodies\n", size);
+    printf("direct: %.4f s\n", direct_seconds);
+    printf("%8s %12s %10s %14s %14s %14s\n", "theta", "time (s)", "speedup", "median err", "99% err", "max err");
+
+    for (float theta : thetas) {
+        std::vector<double> approximate[3];
+        BarnesHutSolver tree(theta);
+
+        start = std::chrono::steady_clock::now();
+        tree.compute_accelerations(system, configs.G_const, configs.softening, approximate[0], approximate[1], approximate[2]);
+        double tree_seconds = seconds_since(start);
+
+        std::vector<double> errors = relative_errors(reference, approximate);
+        double median = size > 0 ? errors[size / 2] : 0.0;
+        double percentile = size > 0 ? errors[std::min(size - 1, (int)(0.99 * size))] : 0.0;
+        double maximum = size > 0 ? errors[size - 1] : 0.0;
+
+        printf("%8.2f %12.4f %10.2f %14.3e %14.3e %14.3e\n", theta, tree_seconds, direct_seconds / tree_seconds, median, percentile, maximum);
+    }
+
+    return 0;
+}
+
+int fmm_scaling(int argc, char* argv[]) {
+    int max_count = (argc > 2) ? atoi(argv[2]) : 262144;
+    int order = (argc > 3) ? atoi(argv[3]) : 4;
+    float theta = (argc > 4) ? atof(argv[4]) : 0.7f;
+    float tree_theta = (argc > 5) ? atof(argv[5]) : 0.5f;
+
+    // Direct summation is only timed up to this size and extrapolated as N^2 beyond it
+    const int max_direct_count = 32768;
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+
+    printf("FMM scaling, order %d, theta %.2f against Barnes-Hut at theta %.2f\n", order, theta, tree_theta);
+    printf("%10s %14s %12s %12s %14s %14s %14s\n", "N", "direct (s)", "tree (s)", "fmm (s)", "fmm ns/body", "tree med err", "fmm med err");
+
+    double direct_seconds = 0.0;
+    int direct_count = 0;
+    int crossover_direct = -1;
+    int crossover_tree = -1;
+
+    for (int count = 1024; count <= max_count; count *= 4) {
+        BodySystem system = make_plummer_sphere(count, 42);
+        std::vector<double> reference[3];
+        std::vector<double> tree_result[3];
+        std::vector<double> fmm_result[3];
+        bool extrapolated = count > max_direct_count;
+
+        if (!extrapolated) {
+            DirectSumSolver direct;
+            auto start = std::chrono::steady_clock::now();
+            direct.compute_accelerations(system, configs.G_const, configs.softening, reference[0], reference[1], reference[2]);
+            direct_seconds = seconds_since(start);
+            direct_count = count;
+        }
+
+        double direct_estimate = direct_seconds * ((double)count / direct_count) * ((double)count / direct_count);
+
+        BarnesHutSolver tree(tree_theta);
+        auto start = std::chrono::steady_clock::now();
+        tree.compute_accelerations(system, configs.G_const, configs.softening, tree_result[0], tree_result[1], tree_result[2]);
+        double tree_seconds = seconds_since(start);
+
+        FastMultipoleSolver fmm(order, theta);
+        start = std::chrono::steady_clock::now();
+        fmm.compute_accelerations(system, configs.G_const, configs.softening, fmm_result[0], fmm_result[1], fmm_result[2]);
+        double fmm_seconds = seconds_since(start);
+
+        double tree_median, tree_max, fmm_median, fmm_max;
+        sampled_errors(system, configs, tree_result, 256, tree_median, tree_max);
+        sampled_errors(system, configs, fmm_result, 256, fmm_median, fmm_max);
+
+        if (crossover_direct == -1 && fmm_seconds < direct_estimate) {
+            crossover_direct = count;
+        }
+        if (crossover_tree == -1 && fmm_seconds < tree_seconds) {
+            crossover_tree = count;
+        }
+
+        printf("%10d %13.4f%s %12.4f %12.4f %14.1f %14.3e %14.3e\n", count, direct_estimate, extrapolated ? "*" : " ", tree_seconds, fmm_seconds, 1e9 * fmm_seconds / count, tree_median, fmm_median);
+    }
+
+    printf("* extrapolated as N^2 from N = %d\n", direct_count);
+    printf("FMM faster than direct summation from N = %d, faster than Barnes-Hut from N = %d (-1: not within tested range)\n", crossover_direct, crossover_tree);
+
+    return 0;
+}
+
+int simd_throughput(int argc, char* argv[]) {
+    std::vector<int> counts;
+    for (int i = 2; i < argc; i++) {
+        counts.push_back(atoi(argv[i]));
+    }
+    if (counts.empty()) {
+        counts = {256, 1024, 4096, 16384};
+    }
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+    SimdLevel best = detect_simd_level();
+
+    printf("Direct summation kernel throughput, processor supports up to %s\n", simd_level_name(best));
+    printf("%8s %8s %14s %16s %10s %14s\n", "N", "kernel", "time (s)", "interactions/s", "speedup", "max rel err");
+
+    for (int count : counts) {
+        BodySystem system = make_plummer_sphere(count, 42);
+        std::vector<double> reference[3];
+        double scalar_rate = 0.0;
+
+        for (int level = simd_scalar; level <= best; level++) {
+            DirectSumSolver direct((SimdLevel)level);
+            std::vector<double> result[3];
+
+            // Repeat small systems so every measurement covers at least about 1e8 interactions
+            int repeats = std::max(1, (int)(1e8 / ((double)count * count)));
+
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < repeats; r++) {
+                direct.compute_accelerations(system, configs.G_const, configs.softening, result[0], result[1], result[2]);
+            }
+            double seconds = seconds_since(start) / repeats;
+            double rate = (double)count * count / seconds;
+
+            if (level == simd_scalar) {
+                scalar_rate = rate;
+                for (int axis = 0; axis < 3; axis++) {
+                    reference[axis] = result[axis];
+                }
+            }
+
+            std::vector<double> errors = relative_errors(reference, result);
+
+            printf("%8d %8s %14.6f %16.3e %10.2f %14.3e\n", count, simd_level_name((SimdLevel)level), seconds, rate, rate / scalar_rate, errors.back());
+        }
+    }
+
+    return 0;
+}
+
+int strong_scaling(int argc, char* argv[]) {
+    int count = (argc > 2) ? atoi(argv[2]) : 32768;
+    std::string solver_name = (argc > 3) ? argv[3] : "direct";
+    int max_threads = (argc > 4) ? atoi(argv[4]) : std::thread::hardware_concurrency();
+
+    if (max_threads <= 0) {
+        max_threads = 1;
+    }
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+    configs.force_solver = solver_name;
+    configs.fmm_order = 3;
+
+    BodySystem system = make_plummer_sphere(count, 42);
+    std::unique_ptr<ForceSolver> solver = create_force_solver(configs);
+    std::vector<double> reference[3];
+
+    printf("Strong scaling of the %s solver, %d bodies, %u hardware threads\n", solver->name(), count, std::thread::hardware_concurrency());
+    printf("%8s %12s %10s %12s %12s\n", "threads", "time (s)", "speedup", "efficiency", "identical");
+
+    double serial_seconds = 0.0;
+
+    for (int threads = 1; threads <= max_threads; threads++) {
+        ThreadPool pool(threads);
+        std::vector<double> result[3];
+        solver->pool = &pool;
+
+        // Warm up once so thread start up and first touch of the buffers are not timed
+        solver->compute_accelerations(system, configs.G_const, configs.softening, result[0], result[1], result[2]);
+
+        int repeats = 3;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++) {
+            solver->compute_accelerations(system, configs.G_const, configs.softening, result[0], result[1], result[2]);
+        }
+        double seconds = seconds_since(start) / repeats;
+
+        if (threads == 1) {
+            serial_seconds = seconds;
+            for (int axis = 0; axis < 3; axis++) {
+                reference[axis] = result[axis];
+            }
+        }
+
+        bool identical = result[0] == reference[0] && result[1] == reference[1] && result[2] == reference[2];
+
+        printf("%8d %12.4f %10.2f %11.1f%% %12s\n", threads, seconds, serial_seconds / seconds, 100.0 * serial_seconds / seconds / threads, identical ? "yes" : "no");
+
+        solver->pool = nullptr;
+    }
+
+    return 0;
+}
+
+
+int energy_drift(int argc, char* argv[]) {
+    std::string scenario = (argc > 2) ? argv[2] : "data/BodiesData.json";
+    double duration = (argc > 3) ? atof(argv[3]) : 0.0;
+    std::vector<double> time_steps;
+    const char* integrators[] = {"euler", "leapfrog"};
+
+    SimulationConfig configs;
+    BodySystem system = load_scenario(scenario, configs);
+
+    for (int i = 4; i < argc; i++) {
+        time_steps.push_back(atof(argv[i]));
+    }
+    if (time_steps.empty()) {
+        for (int factor = 1; factor <= 16; factor *= 2) {
+            time_steps.push_back(configs.time_step * factor);
+        }
+    }
+    if (duration <= 0.0) {
+        duration = 1000.0 * time_steps.front();
+    }
+
+    printf("Energy drift over %g simulated time units, %d bodies, %s solver\n", duration, system.size(), configs.force_solver.c_str());
+    printf("%10s %12s %10s %16s %12s\n", "integrator", "time step", "steps", "energy error", "time (s)");
+
+    for (const char* integrator : integrators) {
+        for (double time_step : time_steps) {
+            configs.integrator = integrator;
+            configs.time_step = time_step;
+
+            Simulation simulation(system, configs);
+            int steps = (int)std::ceil(duration / time_step);
+            double initial_energy = simulation.total_energy();
+
+            auto start = std::chrono::steady_clock::now();
+            simulation.run(steps);
+            double seconds = seconds_since(start);
+
+            double error = std::fabs((simulation.total_energy() - initial_energy) / initial_energy);
+
+            printf("%10s %12.4g %10d %16.3e %12.4f\n", integrator, time_step, steps, error, seconds);
+        }
+    }
+
+    return 0;
+}
+
+// Root mean square distance between the bodies of two runs, relative to the root mean square extent of the reference
+double position_error(const BodySystem& reference, const BodySystem& result) {
+    int size = reference.size();
+    double difference = 0.0;
+    double extent = 0.0;
+
+    for (int i = 0; i < size; i++) {
+        double delta[3] = {result.x[i] - reference.x[i], result.y[i] - reference.y[i], result.z[i] - reference.z[i]};
+        difference += delta[0] * delta[0] + delta[1] * delta[1] + delta[2] * delta[2];
+        extent += reference.x[i] * reference.x[i] + reference.y[i] * reference.y[i] + reference.z[i] * reference.z[i];
+    }
+
+    return (extent > 0.0) ? std::sqrt(difference / extent) : std::sqrt(difference / size);
+}
+
+int pm_accuracy(int argc, char* argv[]) {
+    int count = (argc > 2) ? atoi(argv[2]) : 200000;
+    std::vector<int> grid_sizes;
+
+    for (int i = 3; i < argc; i++) {
+        grid_sizes.push_back(atoi(argv[i]));
+    }
+    if (grid_sizes.empty()) {
+        grid_sizes = {32, 64, 128};
+    }
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+    configs.softening = 0.0f;
+
+    BodySystem system = make_uniform_sphere(count, 42);
+    ThreadPool pool(configs.threads);
+
+    printf("Particle-Mesh accuracy, uniform sphere of %d bodies, errors of 1000 sampled bodies\n", count);
+    printf("Direct summation includes the graininess of the bodies, the smooth error compares with the field -G M r / R^3 of a continuous sphere\n");
+    printf("%8s %12s %14s %14s %14s\n", "grid", "time (s)", "median error", "max error", "smooth error");
+
+    for (int grid_size : grid_sizes) {
+        ParticleMeshSolver solver(grid_size);
+        std::vector<double> result[3];
+        solver.pool = &pool;
+
+        // The first evaluation also transforms the Green's function, which is not part of the steady state cost
+        solver.compute_accelerations(system, configs.G_const, configs.softening, result[0], result[1], result[2]);
+
+        auto start = std::chrono::steady_clock::now();
+        solver.compute_accelerations(system, configs.G_const, configs.softening, result[0], result[1], result[2]);
+        double seconds = seconds_since(start);
+
+        double median = 0.0;
+        double maximum = 0.0;
+        sampled_errors(system, configs, result, 1000, median, maximum);
+
+        std::vector<double> smooth[3];
+        std::vector<double> picked[3];
+        for (int s = 0; s < 1000; s++) {
+            int i = (int)((long long)s * count / 1000);
+            double position[3] = {system.x[i], system.y[i], system.z[i]};
+
+            for (int axis = 0; axis < 3; axis++) {
+                smooth[axis].push_back(-configs.G_const * position[axis]);
+                picked[axis].push_back(result[axis][i]);
+            }
+        }
+        std::vector<double> smooth_errors = relative_errors(smooth, picked);
+
+        printf("%8d %12.4f %14.3e %14.3e %14.3e\n", solver.grid_size, seconds, median, maximum, smooth_errors[smooth_errors.size() / 2]);
+    }
+
+    return 0;
+}
+
+int p3m_accuracy(int argc, char* argv[]) {
+    int count = (argc > 2) ? atoi(argv[2]) : 100000;
+    int grid_size = (argc > 3) ? atoi(argv[3]) : 128;
+    std::vector<double> cutoffs;
+
+    for (int i = 4; i < argc; i++) {
+        cutoffs.push_back(atof(argv[i]));
+    }
+    if (cutoffs.empty()) {
+        cutoffs = {0.1, 0.2, 0.5};
+    }
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+    BodySystem system = make_clumpy_sphere(count, 1000, 42);
+    ThreadPool pool(configs.threads);
+
+    printf("P3M accuracy, uniform sphere of %d bodies with half of them in 1000 clumps, %d^3 mesh, errors of 1000 sampled bodies\n", count, grid_size);
+    printf("%14s %10s %12s %14s %14s\n", "solver", "cutoff", "time (s)", "median error", "max error");
+
+    // Direct summation timed on the sampled bodies only and scaled up to all of them
+    {
+        DirectSumSolver direct;
+        std::vector<int> targets;
+        std::vector<double> result[3];
+
+        direct.pool = &pool;
+        for (int s = 0; s < 1000; s++) {
+            targets.push_back((int)((long long)s * count / 1000));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        direct.compute_target_accelerations(system, configs.G_const, configs.softening, targets, result[0], result[1], result[2]);
+        double seconds = seconds_since(start) * count / targets.size();
+
+        printf("%14s %10s %12.4f %14.3e %14.3e\n", "direct", "-", seconds, 0.0, 0.0);
+    }
+
+    for (int c = -1; c < (int)cutoffs.size(); c++) {
+        std::unique_ptr<ForceSolver> solver;
+
+        if (c == -1) {
+            solver = std::unique_ptr<ForceSolver>(new ParticleMeshSolver(grid_size));
+        }
+        else {
+            solver = std::unique_ptr<ForceSolver>(new P3MSolver(grid_size, cutoffs[c], configs.min_dist));
+        }
+
+        std::vector<double> result[3];
+        solver->pool = &pool;
+
+        // The first evaluation also transforms the Green's function, which is not part of the steady state cost
+        solver->compute_accelerations(system, configs.G_const, configs.softening, result[0], result[1], result[2]);
+
+        auto start = std::chrono::steady_clock::now();
+        solver->compute_accelerations(system, configs.G_const, configs.softening, result[0], result[1], result[2]);
+        double seconds = seconds_since(start);
+
+        double median = 0.0;
+        double maximum = 0.0;
+        sampled_errors(system, configs, result, 1000, median, maximum);
+
+        printf("%14s %10g %12.4f %14.3e %14.3e\n", solver->name(), (c == -1) ? 0.0 : cutoffs[c], seconds, median, maximum);
+    }
+
+    return 0;
+}
+
+int convergence(int argc, char* argv[]) {
+    std::string scenario = (argc > 2) ? argv[2] : "data/BodiesData.json";
+    double duration = (argc > 3) ? atof(argv[3]) : 0.0;
+    int max_steps = (argc > 4) ? atoi(argv[4]) : 4096;
+    const char* integrators[] = {"euler", "leapfrog", "hermite"};
+
+    SimulationConfig configs;
+    BodySystem system = load_scenario(scenario, configs);
+    configs.force_solver = "direct";
+
+    if (duration <= 0.0) {
+        duration = 100.0 * configs.time_step;
+    }
+
+    // Reference from Hermite with 16 times more steps than any run compared against it
+    configs.integrator = "hermite";
+    configs.time_step = duration / (16.0 * max_steps);
+    Simulation reference(system, configs);
+    reference.run(16 * max_steps);
+
+    printf("Convergence over %g simulated time units, %d bodies, reference of %d hermite steps\n", duration, system.size(), 16 * max_steps);
+    printf("%10s %10s %18s %12s %16s %16s\n", "integrator", "steps", "force evaluations", "time (s)", "position error", "energy error");
+
+    for (const char* integrator : integrators) {
+        for (int steps = 16; steps <= max_steps; steps *= 2) {
+            configs.integrator = integrator;
+            configs.time_step = duration / steps;
+
+            Simulation simulation(system, configs);
+            double initial_energy = simulation.total_energy();
+
+            auto start = std::chrono::steady_clock::now();
+            simulation.run(steps);
+            double seconds = seconds_since(start);
+
+            double energy_error = std::fabs((simulation.total_energy() - initial_energy) / initial_energy);
+
+            printf("%10s %10d %18lld %12.4f %16.3e %16.3e\n", integrator, steps, simulation.force_evaluations, seconds,
+                position_error(reference.system, simulation.system), energy_error);
+        }
+    }
+
+    return 0;
+}
+
+int wisdom_holman(int argc, char* argv[]) {
+    int stars = (argc > 2) ? atoi(argv[2]) : 1;
+    int planets = (argc > 3) ? atoi(argv[3]) : 8;
+    double duration = (argc > 4) ? atof(argv[4]) : 100.0;
+    const char* integrators[] = {"leapfrog", "hermite", "wisdom_holman"};
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+    configs.softening = 0.0f;
+    configs.threads = 1;
+
+    BodySystem system = make_planetary_systems(stars, planets, 42);
+
+    // Time steps are fractions of the shortest orbital period in the scenario
+    double shortest_period = 1e300;
+    for (int idx = 0; idx < system.size(); idx++) {
+        if (system.host[idx] != -1) {
+            int host = system.host[idx];
+            double R[3] = {system.x[idx] - system.x[host], system.y[idx] - system.y[host], system.z[idx] - system.z[host]};
+            double radius = std::sqrt(R[0] * R[0] + R[1] * R[1] + R[2] * R[2]);
+            shortest_period = std::min(shortest_period, 2.0 * bench_pi * std::sqrt(radius * radius * radius / (configs.G_const * system.mass[host])));
+        }
+    }
+
+    printf("Wisdom-Holman, %d stars with %d planets each, %g simulated time units, shortest period %g\n", stars, planets, duration, shortest_period);
+    printf("%14s %14s %10s %18s %16s %12s\n", "integrator", "steps / orbit", "steps", "force evaluations", "energy error", "time (s)");
+
+    for (const char* integrator : integrators) {
+        for (int per_orbit = 10; per_orbit <= 1000; per_orbit *= 10) {
+            configs.integrator = integrator;
+            configs.time_step = shortest_period / per_orbit;
+
+            Simulation simulation(system, configs);
+            int steps = (int)std::ceil(duration / configs.time_step);
+            double initial_energy = simulation.total_energy();
+
+            auto start = std::chrono::steady_clock::now();
+            simulation.run(steps);
+            double seconds = seconds_since(start);
+
+            double error = std::fabs((simulation.total_energy() - initial_energy) / initial_energy);
+
+            printf("%14s %14d %10d %18lld %16.3e %12.4f\n", integrator, per_orbit, steps, simulation.force_evaluations, error, seconds);
+        }
+    }
+
+    return 0;
+}
+
+int block_timesteps(int argc, char* argv[]) {
+    int stars = (argc > 2) ? atoi(argv[2]) : 8;
+    int planets = (argc > 3) ? atoi(argv[3]) : 16;
+    double duration = (argc > 4) ? atof(argv[4]) : 100.0;
+    std::vector<double> accuracies;
+    for (int i = 5; i < argc; i++) {
+        accuracies.push_back(atof(argv[i]));
+    }
+    if (accuracies.empty()) {
+        accuracies = {0.1, 0.5, 1.0};
+    }
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+    configs.softening = 0.0f;
+    configs.time_step = 1.0f;
+    configs.threads = 1;
+
+    BodySystem system = make_planetary_systems(stars, planets, 42);
+    int steps = (int)std::ceil(duration / configs.time_step);
+
+    printf("Block timesteps, %d stars with %d planets each, %g simulated time units\n", stars, planets, duration);
+    printf("%16s %12s %18s %16s %12s %s\n", "integrator", "accuracy", "force evaluations", "energy error", "time (s)", "  bodies per level at the end");
+
+    std::vector<long long> block_evaluations;
+    std::vector<double> block_errors;
+    int deepest = 0;
+    double initial_energy = 0.0;
+
+    for (double accuracy : accuracies) {
+        configs.integrator = "block_timestep";
+        configs.timestep_accuracy = accuracy;
+        Simulation block(system, configs);
+        initial_energy = block.total_energy();
+
+        auto start = std::chrono::steady_clock::now();
+        block.run(steps);
+        double block_seconds = seconds_since(start);
+        double block_error = std::fabs((block.total_energy() - initial_energy) / initial_energy);
+
+        BlockTimestepIntegrator* integrator = dynamic_cast<BlockTimestepIntegrator*>(block.integrator.get());
+        int block_deepest = *std::max_element(integrator->levels.begin(), integrator->levels.end());
+        std::vector<int> population(integrator->max_level + 1, 0);
+        for (int level : integrator->levels) {
+            population[level]++;
+        }
+
+        printf("%16s %12.4g %18lld %16.3e %12.4f  ", "block_timestep", accuracy, block.force_evaluations, block_error, block_seconds);
+        for (int level = 0; level <= block_deepest; level++) {
+            printf(" %d", population[level]);
+        }
+        printf("\n");
+
+        block_evaluations.push_back(block.force_evaluations);
+        block_errors.push_back(block_error);
+        deepest = std::max(deepest, block_deepest);
+    }
+
+    // Global timesteps halved from the longest block down to the shortest any body reached
+    std::vector<long long> global_evaluations;
+    std::vector<double> global_errors;
+
+    printf("%16s %12s %18s %16s %12s\n", "integrator", "time step", "force evaluations", "energy error", "time (s)");
+
+    configs.integrator = "leapfrog";
+    for (int level = 0; level <= deepest; level++) {
+        configs.time_step = 1.0 / (double)(1LL << level);
+        Simulation global(system, configs);
+
+        auto start = std::chrono::steady_clock::now();
+        global.run(steps << level);
+        double global_seconds = seconds_since(start);
+        double global_error = std::fabs((global.total_energy() - initial_energy) / initial_energy);
+
+        printf("%16s %12.4g %18lld %16.3e %12.4f\n", "leapfrog", configs.time_step, global.force_evaluations, global_error, global_seconds);
+
+        global_evaluations.push_back(global.force_evaluations);
+        global_errors.push_back(global_error);
+    }
+
+    // The saving is counted against the longest global timestep at least as accurate as the block timesteps
+    printf("Force evaluations saved at matched energy error:\n");
+    for (int run = 0; run < (int)accuracies.size(); run++) {
+        int matched = -1;
+        for (int level = 0; level <= deepest && matched < 0; level++) {
+            if (global_errors[level] <= block_errors[run]) {
+                matched = level;
+            }
+        }
+
+        if (matched >= 0) {
+            printf("  accuracy %-8g %.2fx against leapfrog with time step %g\n", accuracies[run], (double)global_evaluations[matched] / block_evaluations[run], 1.0 / (double)(1LL << matched));
+        }
+        else {
+            printf("  accuracy %-8g no global timestep down to the deepest level is as accurate\n", accuracies[run]);
+        }
+    }
+
+    return 0;
+}
+
+int allocations(int argc, char* argv[]) {
+    std::vector<int> counts;
+    std::vector<std::string> solvers;
+    for (int i = 2; i < argc; i++) {
+        if (atoi(argv[i]) > 0) {
+            counts.push_back(atoi(argv[i]));
+        }
+        else {
+            solvers.push_back(argv[i]);
+        }
+    }
+    if (counts.empty()) {
+        counts = {1000, 2000, 4000, 8000};
+    }
+    if (solvers.empty()) {
+        solvers = {"direct", "barnes_hut", "fmm", "particle_mesh", "p3m"};
+    }
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+    configs.time_step = 1e-3f;
+
+    int warm_up = 3;
+    int frames = 30;
+    int failures = 0;
+
+    printf("Heap allocations of leapfrog frames, %d warm up and %d measured frames, any steady-state allocation fails\n", warm_up, frames);
+    printf("%16s %10s %14s %16s\n", "force solver", "N", "first frame", "steady frames");
+
+    for (const std::string& solver_name : solvers) {
+        for (int count : counts) {
+            configs.force_solver = solver_name;
+            Simulation simulation(make_plummer_sphere(count, 42), configs);
+            double checksum = 0.0;
+
+            // A frame steps the simulation and reads every body back through the view, as the viewer does
+            auto frame = [&]() {
+                simulation.step();
+                BodyView bodies = simulation.bodies();
+
+                for (int i = 0; i < bodies.size(); i++) {
+                    checksum += bodies.x[i] + bodies.y[i] + bodies.z[i];
+                }
+            };
+
+            long long before = heap_allocations.load();
+            frame();
+            long long first = heap_allocations.load() - before;
+
+            for (int f = 1; f < warm_up; f++) {
+                frame();
+            }
+
+            before = heap_allocations.load();
+            for (int f = 0; f < frames; f++) {
+                frame();
+            }
+            long long steady = heap_allocations.load() - before;
+
+            printf("%16s %10d %14lld %16lld%s\n", simulation.solver->name(), count, first, steady, (steady > 0) ? "  FAIL" : "");
+
+            if (steady > 0) {
+                failures++;
+            }
+            if (!std::isfinite(checksum)) {
+                printf("Non-finite body state with %s\n", solver_name.c_str());
+            }
+        }
+    }
+
+    if (failures > 0) {
+        printf("%d runs allocated in steady state\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+int fabric_throughput(int argc, char* argv[]) {
+    int grid_squares = (argc > 2) ? atoi(argv[2]) : 100;
+    int max_threads = (argc > 3) ? atoi(argv[3]) : std::thread::hardware_concurrency();
+    std::vector<int> counts;
+    for (int i = 4; i < argc; i++) {
+        counts.push_back(atoi(argv[i]));
+    }
+    if (counts.empty()) {
+        counts = {100, 1000, 10000};
+    }
+    if (max_threads <= 0) {
+        max_threads = 1;
+    }
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+
+    // The viewer's grid, nodes one step apart over [-grid_squares, grid_squares] on both axes
+    int nodes_per_side = 2 * grid_squares + 1;
+    long long nodes = (long long)nodes_per_side * nodes_per_side;
+    float step = 1.0f;
+
+    printf("Fabric field throughput, %lld nodes, %u hardware threads\n", nodes, std::thread::hardware_concurrency());
+    printf("%8s %8s %8s %12s %20s %16s\n", "bodies", "simd", "threads", "time (s)", "node-bodies / s", "max difference");
+
+    for (int count : counts) {
+        // Bodies spread over the grid, with a cutoff reaching every node so all pairs are summed
+        BodySystem system = make_plummer_sphere(count, 42);
+        for (int i = 0; i < count; i++) {
+            system.x[i] *= 0.25 * grid_squares;
+            system.y[i] *= 0.25 * grid_squares;
+            system.z[i] *= 0.25 * grid_squares;
+        }
+
+        BodyView bodies = system.view();
+        std::vector<float> reference;
+
+        for (int level = simd_scalar; level <= detect_simd_level(); level++) {
+            for (int threads = 1; threads <= max_threads; threads++) {
+                ThreadPool pool(threads);
+                FabricField field(configs.G_const, 1e30f, 0.5f);
+                field.spatial_index = false;
+                std::vector<float> result;
+
+                field.simd_level = (SimdLevel)level;
+                field.pool = &pool;
+
+                // Warm up once so thread start up and first touch of the buffers are not timed
+                field.evaluate(bodies, nodes_per_side, step, result);
+
+                int repeats = 3;
+                auto start = std::chrono::steady_clock::now();
+                for (int r = 0; r < repeats; r++) {
+                    field.evaluate(bodies, nodes_per_side, step, result);
+                }
+                double seconds = seconds_since(start) / repeats;
+
+                if (reference.empty()) {
+                    reference = result;
+                }
+
+                double difference = 0.0;
+                for (long long n = 0; n < nodes; n++) {
+                    difference = std::max(difference, std::fabs((double)result[n] - reference[n]) / std::fabs((double)reference[n]));
+                }
+
+                printf("%8d %8s %8d %12.4f %20.3e %16.2e\n", count, simd_level_name((SimdLevel)level), threads, seconds, (double)nodes * count / seconds, difference);
+            }
+        }
+    }
+
+    return 0;
+}
+
+int fabric_cutoff(int argc, char* argv[]) {
+    int grid_squares = (argc > 2) ? atoi(argv[2]) : 100;
+    float cutoff = (argc > 3) ? atof(argv[3]) : 5.0f;
+    std::vector<int> counts;
+    for (int i = 4; i < argc; i++) {
+        counts.push_back(atoi(argv[i]));
+    }
+    if (counts.empty()) {
+        counts = {1000, 10000, 100000};
+    }
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+
+    int nodes_per_side = 2 * grid_squares + 1;
+    long long nodes = (long long)nodes_per_side * nodes_per_side;
+
+    printf("Fabric distance cutoff %g over %lld nodes one unit apart, bodies spread uniformly over the grid\n", cutoff, nodes);
+    printf("%8s %16s %16s %10s %16s\n", "bodies", "all bodies (s)", "cell index (s)", "speedup", "max difference");
+
+    for (int count : counts) {
+        BodySystem system;
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<double> uniform(-grid_squares, grid_squares);
+
+        for (int i = 0; i < count; i++) {
+            system.add_body("body" + std::to_string(i), 1.0, 0.01, uniform(generator), 0.1 * uniform(generator), uniform(generator), 0.0, 0.0, 0.0, {1.0f, 1.0f, 1.0f, 1.0f}, -1);
+        }
+
+        std::vector<float> result[2];
+        double seconds[2];
+
+        for (int indexed = 0; indexed < 2; indexed++) {
+            FabricField field(configs.G_const, cutoff, 0.5f);
+            field.spatial_index = indexed == 1;
+
+            field.evaluate(system.view(), nodes_per_side, 1.0f, result[indexed]);
+
+            int repeats = 3;
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < repeats; r++) {
+                field.evaluate(system.view(), nodes_per_side, 1.0f, result[indexed]);
+            }
+            seconds[indexed] = seconds_since(start) / repeats;
+        }
+
+        double difference = 0.0;
+        for (long long n = 0; n < nodes; n++) {
+            double scale = std::max(std::fabs((double)result[0][n]), 1e-30);
+            difference = std::max(difference, std::fabs((double)result[1][n] - result[0][n]) / scale);
+        }
+
+        printf("%8d %16.4f %16.4f %10.1f %16.2e\n", count, seconds[0], seconds[1], seconds[0] / seconds[1], difference);
+    }
+
+    return 0;
+}
+
+int fabric_incremental(int argc, char* argv[]) {
+    int grid_squares = (argc > 2) ? atoi(argv[2]) : 100;
+    float cutoff = (argc > 3) ? atof(argv[3]) : 20.0f;
+    int count = (argc > 4) ? atoi(argv[4]) : 2000;
+    int moving = (argc > 5) ? atoi(argv[5]) : 10;
+    int frames = (argc > 6) ? atoi(argv[6]) : 100;
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+
+    int nodes_per_side = 2 * grid_squares + 1;
+    long long nodes = (long long)nodes_per_side * nodes_per_side;
+    moving = std::min(moving, count);
+
+    BodySystem system;
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> uniform(-grid_squares, grid_squares);
+
+    for (int i = 0; i < count; i++) {
+        system.add_body("body" + std::to_string(i), 1.0, 0.01, uniform(generator), 0.1 * uniform(generator), uniform(generator), 0.0, 0.0, 0.0, {1.0f, 1.0f, 1.0f, 1.0f}, -1);
+    }
+
+    // The first bodies circle their starting point one node per frame, the rest stay put
+    std::vector<double> start_x(system.x.begin(), system.x.begin() + moving);
+    std::vector<double> start_z(system.z.begin(), system.z.begin() + moving);
+
+    FabricField full(configs.G_const, cutoff, 0.5f);
+    FabricField incremental(configs.G_const, cutoff, 0.5f);
+    incremental.tolerance = 0.05f;
+
+    std::vector<float> full_field, incremental_field;
+    full.evaluate(system.view(), nodes_per_side, 1.0f, full_field);
+    incremental.update(system.view(), nodes_per_side, 1.0f, incremental_field);
+
+    double full_seconds = 0.0;
+    double incremental_seconds = 0.0;
+    long long dirty_rows = 0;
+
+    for (int frame = 1; frame <= frames; frame++) {
+        for (int i = 0; i < moving; i++) {
+            double angle = 0.2 * frame;
+            system.x[i] = start_x[i] + 5.0 * std::cos(angle);
+            system.z[i] = start_z[i] + 5.0 * std::sin(angle);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        full.evaluate(system.view(), nodes_per_side, 1.0f, full_field);
+        full_seconds += seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        incremental.update(system.view(), nodes_per_side, 1.0f, incremental_field);
+        incremental_seconds += seconds_since(start);
+
+        for (unsigned char dirty : incremental.dirty_rows) {
+            dirty_rows += dirty;
+        }
+    }
+
+    double peak = 0.0;
+    double difference = 0.0;
+    for (long long n = 0; n < nodes; n++) {
+        peak = std::max(peak, std::fabs((double)full_field[n]));
+        difference = std::max(difference, std::fabs((double)incremental_field[n] - full_field[n]));
+    }
+
+    printf("Incremental fabric, %lld nodes, cutoff %g, %d bodies of which %d move, %d frames\n", nodes, cutoff, count, moving, frames);
+    printf("%16s %16s %16s\n", "update", "time / frame (s)", "rows / frame");
+    printf("%16s %16.5f %16d\n", "full", full_seconds / frames, nodes_per_side);
+    printf("%16s %16.5f %16.1f\n", "incremental", incremental_seconds / frames, (double)dirty_rows / frames);
+    printf("Speedup %.1fx, max difference %.2e of the peak field\n", full_seconds / incremental_seconds, difference / peak);
+
+    return 0;
+}
+
+int fabric_lod(int argc, char* argv[]) {
+    int grid_squares = (argc > 2) ? atoi(argv[2]) : 100;
+    std::vector<int> budgets;
+    for (int i = 3; i < argc; i++) {
+        budgets.push_back(atoi(argv[i]));
+    }
+    if (budgets.empty()) {
+        budgets = {2500, 10000, 40401};
+    }
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+
+    // The viewer's defaults, nodes two units apart, a minimum separation of 5 and the camera off the grid's edge
+    float step = 2.0f;
+    float half_size = grid_squares * step;
+    float min_dist = 5.0f;
+    float deformation_scale = 5.0f;
+    float camera[3] = {-0.5f * half_size, 14.0f, 0.0f};
+
+    // A few stars carving wells into a fabric otherwise only rippled by light bodies
+    BodySystem system;
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> uniform(-0.75 * half_size, 0.75 * half_size);
+    std::vector<double> star_x, star_z;
+
+    for (int i = 0; i < 5; i++) {
+        star_x.push_back(uniform(generator));
+        star_z.push_back(uniform(generator));
+        system.add_body("star" + std::to_string(i), 1.0 + i, 1.0, star_x.back(), 0.0, star_z.back(), 0.0, 0.0, 0.0, {1.0f, 1.0f, 1.0f, 1.0f}, -1);
+    }
+    for (int i = 0; i < 200; i++) {
+        system.add_body("body" + std::to_string(i), 1e-3, 0.1, uniform(generator), 0.1 * uniform(generator), uniform(generator), 0.0, 0.0, 0.0, {1.0f, 1.0f, 1.0f, 1.0f}, -1);
+    }
+
+    FabricField field(configs.G_const, 1e30f, min_dist);
+    field.load_bodies(system.view());
+
+    // Exact field at points spread over the whole fabric and at points within 20 units of a star
+    std::vector<float> sample_x, sample_z, exact;
+    std::uniform_real_distribution<float> anywhere(-half_size, half_size);
+    std::uniform_real_distribution<float> offset(-20.0f, 20.0f);
+    int samples = 20000;
+
+    for (int s = 0; s < 2 * samples; s++) {
+        float x = anywhere(generator);
+        float z = anywhere(generator);
+        if (s >= samples) {
+            x = std::min(std::max((float)star_x[s % star_x.size()] + offset(generator), -half_size), half_size);
+            z = std::min(std::max((float)star_z[s % star_z.size()] + offset(generator), -half_size), half_size);
+        }
+
+        sample_x.push_back(x);
+        sample_z.push_back(z);
+        exact.push_back(field.field_at(x, z));
+    }
+
+    float peak = *std::max_element(exact.begin(), exact.end());
+
+    printf("Fabric level of detail over [-%g, %g]^2, %d bodies, errors of the drawn surface relative to the deepest well\n", half_size, half_size, system.size());
+    printf("%-10s %10s %10s %12s %12s %12s %12s\n", "fabric", "vertices", "lines", "time (s)", "rms error", "well rms", "well max");
+
+    auto report = [&](const char* name, long long vertices, long long lines, double seconds, auto&& drawn) {
+        double squares[2] = {0.0, 0.0};
+        double maximum = 0.0;
+
+        for (int s = 0; s < 2 * samples; s++) {
+            double error = std::fabs((double)drawn(sample_x[s], sample_z[s]) - exact[s]) / peak;
+            squares[s >= samples] += error * error;
+            if (s >= samples) {
+                maximum = std::max(maximum, error);
+            }
+        }
+
+        printf("%-10s %10lld %10lld %12.5f %12.2e %12.2e %12.2e\n", name, vertices, lines, seconds, std::sqrt(squares[0] / samples), std::sqrt(squares[1] / samples), maximum);
+    };
+
+    // Uniform grids of the viewer's node spacing and of the spacing spending each budget evenly
+    std::vector<int> uniform_sides = {2 * grid_squares + 1};
+    for (int budget : budgets) {
+        uniform_sides.push_back(std::max(2, (int)std::sqrt((double)budget)));
+    }
+
+    for (int nodes_per_side : uniform_sides) {
+        float spacing = 2.0f * half_size / (nodes_per_side - 1);
+        std::vector<float> grid;
+
+        auto start = std::chrono::steady_clock::now();
+        field.evaluate(system.view(), nodes_per_side, spacing, grid);
+        double seconds = seconds_since(start);
+
+        auto bilinear = [&](float x, float z) {
+            float u = std::min((x + half_size) / spacing, nodes_per_side - 1.0001f);
+            float v = std::min((z + half_size) / spacing, nodes_per_side - 1.0001f);
+            int column = (int)u;
+            int row = (int)v;
+            float s = u - column;
+            float t = v - row;
+            const float* low = &grid[(long long)row * nodes_per_side + column];
+            const float* high = low + nodes_per_side;
+
+            return (1.0f - t) * ((1.0f - s) * low[0] + s * low[1]) + t * ((1.0f - s) * high[0] + s * high[1]);
+        };
+
+        long long vertices = (long long)nodes_per_side * nodes_per_side;
+        report("uniform", vertices, 2LL * nodes_per_side * (nodes_per_side - 1), seconds, bilinear);
+    }
+
+    // Quadtrees refined by the deformation alone and also towards the camera with the default weight
+    float camera_weights[] = {0.0f, FabricLod(0).camera_weight};
+
+    for (float camera_weight : camera_weights) {
+        for (int budget : budgets) {
+            FabricLod lod(budget);
+            lod.camera_weight = camera_weight;
+
+            auto start = std::chrono::steady_clock::now();
+            lod.build(field, system.view(), half_size, deformation_scale, camera);
+            double seconds = seconds_since(start);
+
+            auto interpolate = [&](float x, float z) {
+                return lod.interpolate(x, z);
+            };
+
+            report((camera_weight > 0.0f) ? "quad+cam" : "quadtree", lod.vertices.size() / 3, lod.indices.size() / 2, seconds, interpolate);
+        }
+    }
+
+    return 0;
+}
+
+int fixed_timestep(int argc, char* argv[]) {
+    int count = (argc > 2) ? atoi(argv[2]) : 256;
+    double wall_seconds = (argc > 3) ? atof(argv[3]) : 2.0;
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+    configs.time_step = 1e-3f;
+
+    BodySystem system = make_plummer_sphere(count, 42);
+
+    // Frame times of displays at common refresh rates, and of a 60 Hz display stalling 100 ms every 20th frame
+    struct FramePattern {
+        const char* name;
+        double frame_seconds;
+        int stall_every;
+    };
+    std::vector<FramePattern> patterns = {{"30 Hz", 1.0 / 30.0, 0}, {"60 Hz", 1.0 / 60.0, 0}, {"144 Hz", 1.0 / 144.0, 0}, {"60 Hz stalls", 1.0 / 60.0, 20}};
+
+    printf("Physics pacing over %g wall seconds, %d bodies, 60 steps per wall second, frame times simulated\n", wall_seconds, count);
+    printf("Speed spread is the fastest over the slowest drawn speed of the bodies across frames, near 1 when motion is smooth\n");
+    printf("%-14s %-12s %8s %12s %10s %10s %14s\n", "frames", "pacing", "frames", "sim time", "max steps", "dropped", "speed spread");
+
+    for (const FramePattern& pattern : patterns) {
+        for (int paced = 0; paced < 2; paced++) {
+            Simulation simulation(system, configs);
+            SimulationClock clock(60.0);
+
+            // The clock's budget is in real time, lifted here so the drawn motion only depends on the frame times
+            clock.frame_budget = 1e30;
+
+            std::vector<double> last_x, last_y, last_z;
+            double fastest = 0.0;
+            double slowest = 1e300;
+            double elapsed = 0.0;
+            int frames = 0;
+            int max_steps = 0;
+
+            while (elapsed < wall_seconds) {
+                double frame_seconds = pattern.frame_seconds;
+                if (pattern.stall_every > 0 && frames % pattern.stall_every == pattern.stall_every - 1) {
+                    frame_seconds = 0.1;
+                }
+                elapsed += frame_seconds;
+                frames++;
+
+                // Unpaced, the simulation steps once per frame as the viewer used to
+                BodyView bodies;
+                if (paced) {
+                    clock.advance(simulation, frame_seconds);
+                    max_steps = std::max(max_steps, clock.steps);
+                    bodies = clock.view(simulation);
+                }
+                else {
+                    simulation.step();
+                    max_steps = 1;
+                    bodies = simulation.bodies();
+                }
+
+                if (!last_x.empty()) {
+                    double distance = 0.0;
+                    for (int i = 0; i < bodies.size(); i++) {
+                        double dx = bodies.x[i] - last_x[i];
+                        double dy = bodies.y[i] - last_y[i];
+                        double dz = bodies.z[i] - last_z[i];
+                        distance += std::sqrt(dx * dx + dy * dy + dz * dz);
+                    }
+
+                    // The first tenth of a second is left out, while the clock's accumulator first fills up
+                    if (elapsed > 0.1) {
+                        fastest = std::max(fastest, distance / frame_seconds);
+                        slowest = std::min(slowest, distance / frame_seconds);
+                    }
+                }
+
+                last_x.assign(bodies.x, bodies.x + bodies.size());
+                last_y.assign(bodies.y, bodies.y + bodies.size());
+                last_z.assign(bodies.z, bodies.z + bodies.size());
+            }
+
+            printf("%-14s %-12s %8d %12.4f %10d %10lld %14.2f\n", pattern.name, paced ? "fixed step" : "per frame", frames, simulation.sim_time, max_steps, clock.dropped_steps, fastest / slowest);
+        }
+    }
+
+    return 0;
+}
+
+int physics_thread(int argc, char* argv[]) {
+    int count = (argc > 2) ? atoi(argv[2]) : 2048;
+    int frames = (argc > 3) ? atoi(argv[3]) : 120;
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+    configs.time_step = 1e-3f;
+
+    BodySystem system = make_plummer_sphere(count, 42);
+    double frame_seconds = 1.0 / 60.0;
+
+    printf("Render thread cost of getting the bodies for a frame, %d bodies, %d frames at 60 Hz, 60 physics steps per second\n", count, frames);
+    printf("%-16s %16s %16s %16s %12s\n", "physics", "median (ms)", "max (ms)", "steps / second", "sim time");
+
+    for (int threaded = 0; threaded < 2; threaded++) {
+        Simulation serial(system, configs);
+        SimulationClock clock(60.0);
+        std::unique_ptr<PhysicsThread> physics;
+        double checksum = 0.0;
+
+        if (threaded) {
+            physics.reset(new PhysicsThread(Simulation(system, configs), clock));
+            physics->start();
+        }
+
+        std::vector<double> costs;
+        auto begin = std::chrono::steady_clock::now();
+        auto last = begin;
+
+        for (int frame = 0; frame < frames; frame++) {
+            auto next_frame = begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((frame + 1) * frame_seconds));
+            auto start = std::chrono::steady_clock::now();
+
+            // Serially the frame runs the steps it owes itself, threaded it only takes the newest snapshot
+            BodyView bodies;
+            if (threaded) {
+                bodies = physics->bodies();
+            }
+            else {
+                clock.advance(serial, std::chrono::duration<double>(start - last).count());
+                bodies = clock.view(serial);
+            }
+            last = start;
+
+            costs.push_back(seconds_since(start) * 1e3);
+            checksum += bodies.x[0];
+
+            std::this_thread::sleep_until(next_frame);
+        }
+
+        double wall = seconds_since(begin);
+        long steps = serial.step_count;
+        double sim_time = serial.sim_time;
+
+        if (threaded) {
+            physics->stop();
+            physics->bodies();
+            steps = physics->snapshot().step_count;
+            sim_time = physics->snapshot().sim_time;
+        }
+        std::sort(costs.begin(), costs.end());
+
+        printf("%-16s %16.3f %16.3f %16.1f %12.4f\n", threaded ? "own thread" : "render thread", costs[costs.size() / 2], costs.back(), steps / wall, sim_time);
+
+        if (!std::isfinite(checksum)) {
+            printf("Non-finite body state\n");
+        }
+    }
+
+    return 0;
+}
+
+int task_graph(int argc, char* argv[]) {
+    int count = (argc > 2) ? atoi(argv[2]) : 2000;
+    int grid_squares = (argc > 3) ? atoi(argv[3]) : 100;
+    int frames = (argc > 4) ? atoi(argv[4]) : 50;
+    int max_threads = std::max(2, (int)std::thread::hardware_concurrency());
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+
+    BodySystem system;
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> uniform(-grid_squares, grid_squares);
+    for (int i = 0; i < count; i++) {
+        system.add_body("body" + std::to_string(i), 1.0, 0.5, uniform(generator), 0.1 * uniform(generator), uniform(generator), 0.1 * uniform(generator), 0.0, 0.1 * uniform(generator), {1.0f, 1.0f, 1.0f, 1.0f}, -1);
+    }
+
+    int nodes_per_side = 2 * grid_squares + 1;
+
+    printf("Frame task graph, %d bodies, %d fabric nodes, %d frames, %u hardware threads\n", count, nodes_per_side * nodes_per_side, frames, std::thread::hardware_concurrency());
+    printf("Frame: blend the bodies, then the fabric field, the instance data and the diagnostics from them\n");
+    printf("%-12s %8s %16s %10s %12s\n", "schedule", "threads", "frame (ms)", "speedup", "steals");
+
+    double serial_seconds = 0.0;
+
+    for (int threads = 0; threads <= max_threads; threads++) {
+        Simulation simulation(system, configs);
+        SimulationClock clock(60.0);
+        FabricField field(configs.G_const, 20.0f, 0.5f);
+        std::vector<float> heights, instances(count * 8);
+        double kinetic_energy = 0.0;
+        BodyView bodies;
+
+        // The stages of the viewer's frame, without the OpenGL calls
+        auto snapshot = [&]() {
+            clock.advance(simulation, 1.0 / 60.0);
+            bodies = clock.view(simulation);
+        };
+        auto fabric = [&]() {
+            field.evaluate(bodies, nodes_per_side, 1.0f, heights);
+        };
+        auto pack = [&]() {
+            for (int i = 0; i < bodies.size(); i++) {
+                float* instance = &instances[i * 8];
+                instance[0] = bodies.x[i];
+                instance[1] = bodies.y[i];
+                instance[2] = bodies.z[i];
+                instance[3] = bodies.diameter[i];
+                for (int channel = 0; channel < 4; channel++) {
+                    instance[4 + channel] = 1.0f;
+                }
+            }
+        };
+        auto diagnostics = [&]() {
+            kinetic_energy = 0.0;
+            for (int i = 0; i < bodies.size(); i++) {
+                kinetic_energy += 0.5 * bodies.mass[i] * (bodies.vx[i] * bodies.vx[i] + bodies.vy[i] * bodies.vy[i] + bodies.vz[i] * bodies.vz[i]);
+            }
+        };
+
+        // Threads 0 runs the stages one after another, as DrawModels and DrawGrid did
+        TaskGraph graph(std::max(threads, 1));
+        int first = graph.add_task(snapshot);
+        for (int stage : {graph.add_task(fabric), graph.add_task(pack), graph.add_task(diagnostics)}) {
+            graph.add_dependency(stage, first);
+        }
+
+        auto frame = [&]() {
+            if (threads == 0) {
+                snapshot();
+                fabric();
+                pack();
+                diagnostics();
+            }
+            else {
+                graph.run();
+            }
+        };
+
+        frame();
+        auto start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++) {
+            frame();
+        }
+        double seconds = seconds_since(start) / frames;
+
+        if (threads == 0) {
+            serial_seconds = seconds;
+        }
+
+        printf("%-12s %8d %16.3f %10.2f %12lld\n", threads == 0 ? "serial" : "task graph", std::max(threads, 1), seconds * 1e3, serial_seconds / seconds, (long long)graph.steals);
+
+        if (!std::isfinite(kinetic_energy)) {
+            printf("Non-finite kinetic energy\n");
+        }
+    }
+
+    // Cost of the scheduler itself, a fan of empty tasks behind one root
+    int empty_tasks = 1000;
+    for (int threads = 1; threads <= max_threads; threads++) {
+        TaskGraph graph(threads);
+        int root = graph.add_task([]() {});
+        for (int t = 1; t < empty_tasks; t++) {
+            graph.add_dependency(graph.add_task([]() {}), root);
+        }
+
+        graph.run();
+        int repeats = 100;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++) {
+            graph.run();
+        }
+
+        printf("Scheduling overhead with %d threads: %.3f us per task\n", threads, seconds_since(start) / repeats / empty_tasks * 1e6);
+    }
+
+    return 0;
+}
+
+int checkpoint(int argc, char* argv[]) {
+    int count = (argc > 2) ? atoi(argv[2]) : 1000000;
+    int json_count = std::min(count, 100000);
+    std::string filename = "build/benchmark.chk";
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+
+    // A restart must continue every integrator exactly as the uninterrupted run
+    printf("Restart of a run checkpointed after 10 of 20 steps, 4 planetary systems of 8 planets\n");
+    printf("%-16s %20s\n", "integrator", "max state difference");
+
+    BodySystem planets = make_planetary_systems(4, 8, 7);
+
+    for (std::string integrator : {"euler", "leapfrog", "hermite", "wisdom_holman", "block_timestep"}) {
+        configs.integrator = integrator;
+
+        Simulation uninterrupted(planets, configs);
+        uninterrupted.run(20);
+
+        Simulation first_half(planets, configs);
+        first_half.run(10);
+        save_checkpoint(first_half, filename);
+
+        Simulation restarted(BodySystem(), configs);
+        CheckpointFile file;
+        if (!file.open(filename) || !file.restore(restarted)) {
+            return 1;
+        }
+        restarted.run(10);
+
+        double difference = 0.0;
+        const std::vector<double>* expected[6] = {&uninterrupted.system.x, &uninterrupted.system.y, &uninterrupted.system.z, &uninterrupted.system.vx, &uninterrupted.system.vy, &uninterrupted.system.vz};
+        const std::vector<double>* result[6] = {&restarted.system.x, &restarted.system.y, &restarted.system.z, &restarted.system.vx, &restarted.system.vy, &restarted.system.vz};
+
+        for (int column = 0; column < 6; column++) {
+            for (int i = 0; i < planets.size(); i++) {
+                difference = std::max(difference, std::fabs((*expected[column])[i] - (*result[column])[i]));
+            }
+        }
+
+        printf("%-16s %20.3e\n", integrator.c_str(), difference);
+    }
+
+    configs.integrator = "leapfrog";
+
+    // Initial conditions in the bodies json format, parsed the way every run starts today
+    nlohmann::json bodies_json;
+    bodies_json["planets"] = nlohmann::json::array();
+    for (int i = 0; i < json_count; i++) {
+        bodies_json["stars"].push_back({{"name", "body" + std::to_string(i)}, {"mass (kg)", 1.0}, {"diameter (km)", 0.01},
+            {"color", {1.0, 1.0, 1.0, 1.0}}, {"center position (km)", {0.001 * i, -0.001 * i}}, {"init_velocity (km/s)", {0.0, 0.0, 0.0}}});
+    }
+    {
+        std::ofstream json_file("build/benchmark.json");
+        json_file << bodies_json;
+    }
+    bodies_json = nlohmann::json();
+
+    auto start = std::chrono::steady_clock::now();
+    BodySystem parsed("build/benchmark.json", 1.0f, 1.0f);
+    double json_seconds = seconds_since(start) * count / json_count;
+    remove("build/benchmark.json");
+
+    double save_seconds, open_seconds, restore_seconds, checksum = 0.0;
+    long long file_bytes;
+    {
+        Simulation simulation(make_plummer_sphere(count, 42), configs);
+
+        start = std::chrono::steady_clock::now();
+        save_checkpoint(simulation, filename);
+        save_seconds = seconds_since(start);
+    }
+
+    CheckpointFile file;
+    start = std::chrono::steady_clock::now();
+    if (!file.open(filename)) {
+        return 1;
+    }
+    BodyView bodies = file.bodies();
+    open_seconds = seconds_since(start);
+    file_bytes = file.header->file_bytes;
+
+    // Reading every position pages the mapped columns in
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < bodies.size(); i++) {
+        checksum += bodies.x[i] + bodies.y[i] + bodies.z[i];
+    }
+    double read_seconds = seconds_since(start);
+
+    {
+        Simulation restarted(BodySystem(), configs);
+        start = std::chrono::steady_clock::now();
+        file.restore(restarted);
+        restore_seconds = seconds_since(start);
+    }
+    file.close();
+    remove(filename.c_str());
+
+    printf("\nCheckpoint of %d bodies, %.1f MB, from the page cache\n", count, file_bytes / 1e6);
+    printf("%-44s %12s\n", "operation", "time (ms)");
+    printf("%-44s %12.1f\n", "save (write, fsync and rename)", save_seconds * 1e3);
+    printf("%-44s %12.3f\n", "open (map and check the sections)", open_seconds * 1e3);
+    printf("%-44s %12.1f\n", "read every position through the mapping", read_seconds * 1e3);
+    printf("%-44s %12.1f\n", "restore into a simulation", restore_seconds * 1e3);
+    printf("%-44s %12.1f\n", json_count < count ? "parse bodies json (extrapolated)" : "parse bodies json", json_seconds * 1e3);
+
+    if (!std::isfinite(checksum)) {
+        printf("Non-finite body state\n");
+    }
+
+    return 0;
+}
+
+int trajectory(int argc, char* argv[]) {
+    int count = (argc > 2) ? atoi(argv[2]) : 4096;
+    int frames = (argc > 3) ? atoi(argv[3]) : 200;
+    std::string filename = "build/benchmark.traj";
+    double quantum = 1e-6;
+
+    SimulationConfig configs;
+    load_scenario("0", configs);
+
+    // Frames of a real run, recorded once so every writer sees the same steps
+    Simulation simulation(make_plummer_sphere(count, 42), configs);
+    std::vector<std::vector<double>> recorded(frames);
+    std::vector<double> step_seconds(frames);
+
+    for (int frame = 0; frame < frames; frame++) {
+        auto start = std::chrono::steady_clock::now();
+        simulation.step();
+        step_seconds[frame] = seconds_since(start);
+
+        const BodySystem& system = simulation.system;
+        for (const std::vector<double>* column : {&system.x, &system.y, &system.z, &system.vx, &system.vy, &system.vz}) {
+            recorded[frame].insert(recorded[frame].end(), column->begin(), column->end());
+        }
+    }
+    std::sort(step_seconds.begin(), step_seconds.end());
+
+    printf("Trajectory of %d bodies over %d steps, positions and velocities, quantum %g, median step %.3f ms\n", count, frames, quantum, step_seconds[frames / 2] * 1e3);
+    printf("%-24s %14s %14s %12s %14s %16s %16s\n", "writer", "append (ms)", "99% (ms)", "bytes/frame", "compression", "max error", "random read (ms)");
+
+    // Synchronous raw writes in the loop, the cost the physics loop would pay without the I/O thread. The
+    // frames are appended between real steps, so the I/O thread works while the physics does, as in a run
+    Simulation physics(make_plummer_sphere(count, 43), configs);
+
+    for (int mode = -1; mode < 3; mode++) {
+        std::vector<double> append_seconds;
+        long long bytes = 0;
+
+        {
+            std::unique_ptr<TrajectoryWriter> writer;
+            FILE* direct = nullptr;
+
+            if (mode >= 0) {
+                writer.reset(new TrajectoryWriter(filename, count, (TrajectoryCompression)mode, quantum, 64));
+            }
+            else {
+                direct = fopen(filename.c_str(), "wb");
+            }
+
+            for (int frame = 0; frame < frames; frame++) {
+                const double* values = recorded[frame].data();
+                BodyView bodies = simulation.bodies();
+                bodies.x = values;
+                bodies.y = values + count;
+                bodies.z = values + 2 * count;
+                bodies.vx = values + 3 * count;
+                bodies.vy = values + 4 * count;
+                bodies.vz = values + 5 * count;
+
+                auto start = std::chrono::steady_clock::now();
+                if (writer) {
+                    writer->append(bodies, frame + 1, (frame + 1) * configs.time_step);
+                }
+                else {
+                    fwrite(values, sizeof(double), recorded[frame].size(), direct);
+                    fflush(direct);
+                }
+                append_seconds.push_back(seconds_since(start));
+
+                physics.step();
+            }
+
+            if (writer) {
+                writer->close();
+                bytes = writer->bytes_written;
+            }
+            else {
+                fclose(direct);
+                bytes = (long long)frames * recorded[0].size() * sizeof(double);
+            }
+        }
+        std::sort(append_seconds.begin(), append_seconds.end());
+
+        double raw_bytes = (double)frames * recorded[0].size() * sizeof(double);
+        double max_error = 0.0;
+        double read_seconds = 0.0;
+
+        if (mode >= 0) {
+            // Every frame read back in order, then a few steps at random through the index
+            TrajectoryReader reader;
+            TrajectoryFrame result;
+            if (!reader.open(filename) || reader.frame_count() != frames) {
+                printf("Trajectory read back %lld of %d frames\n", reader.frame_count(), frames);
+                return 1;
+            }
+
+            for (int frame = 0; frame < frames; frame++) {
+                reader.read_frame(frame, result);
+                const std::vector<double>* columns[6] = {&result.x, &result.y, &result.z, &result.vx, &result.vy, &result.vz};
+
+                for (int column = 0; column < 6; column++) {
+                    for (int i = 0; i < count; i++) {
+                        max_error = std::max(max_error, std::fabs((*columns[column])[i] - recorded[frame][column * count + i]));
+                    }
+                }
+            }
+
+            std::mt19937 generator(7);
+            std::uniform_int_distribution<int> pick(1, frames);
+            int reads = 20;
+            auto start = std::chrono::steady_clock::now();
+
+            for (int r = 0; r < reads; r++) {
+                long step = pick(generator);
+                if (!reader.read_step(step, result) || result.step != step) {
+                    printf("Step %ld not found\n", step);
+                }
+            }
+            read_seconds = seconds_since(start) / reads;
+        }
+
+        const char* names[4] = {"synchronous raw", "I/O thread, raw", "I/O thread, quantized", "I/O thread, delta"};
+        printf("%-24s %14.4f %14.4f %12.0f %14.2f %16.3e %16.3f\n", names[mode + 1], append_seconds[frames / 2] * 1e3, append_seconds[frames * 99 / 100] * 1e3,
+            (double)bytes / frames, raw_bytes / bytes, max_error, read_seconds * 1e3);
+    }
+
+    remove(filename.c_str());
+    remove((filename + ".index").c_str());
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string report = (argc > 1) ? argv[1] : "";
+
+    if (report == "bh-accuracy") {
+        return bh_accuracy(argc, argv);
+    }
+    if (report == "fmm-scaling") {
+        return fmm_scaling(argc, argv);
+    }
+    if (report == "simd") {
+        return simd_throughput(argc, argv);
+    }
+    if (report == "threads") {
+        return strong_scaling(argc, argv);
+    }
+    if (report == "energy-drift") {
+        return energy_drift(argc, argv);
+    }
+    if (report == "pm-accuracy") {
+        return pm_accuracy(argc, argv);
+    }
+    if (report == "p3m-accuracy") {
+        return p3m_accuracy(argc, argv);
+    }
+    if (report == "convergence") {
+        return convergence(argc, argv);
+    }
+    if (report == "wisdom-holman") {
+        return wisdom_holman(argc, argv);
+    }
+    if (report == "block-timesteps") {
+        return block_timesteps(argc, argv);
+    }
+    if (report == "allocations") {
+        return allocations(argc, argv);
+    }
+    if (report == "fabric") {
+        return fabric_throughput(argc, argv);
+    }
+    if (report == "fabric-cutoff") {
+        return fabric_cutoff(argc, argv);
+    }
+    if (report == "fabric-incremental") {
+        return fabric_incremental(argc, argv);
+    }
+    if (report == "fabric-lod") {
+        return fabric_lod(argc, argv);
+    }
+    if (report == "fixed-timestep") {
+        return fixed_timestep(argc, argv);
+    }
+    if (report == "physics-thread") {
+        return physics_thread(argc, argv);
+    }
+    if (report == "task-graph") {
+        return task_graph(argc, argv);
+    }
+    if (report == "checkpoint") {
+        return checkpoint(argc, argv);
+    }
+    if (report == "trajectory") {
+        return trajectory(argc, argv);
+    }
+
+    printf("Usage: benchmarks <report> [arguments]\n");
+    printf("  bh-accuracy [N | bodies json file] [theta ...]\n");
+    printf("  fmm-scaling [max N] [order] [theta] [tree theta]\n");
+    printf("  simd [N ...]\n");
+    printf("  threads [N] [force solver] [max threads]\n");
+    printf("  energy-drift [N | bodies json file] [simulated time] [time step ...]\n");
+    printf("  pm-accuracy [N] [grid size ...]\n");
+    printf("  p3m-accuracy [N] [grid size] [cutoff ...]\n");
+    printf("  convergence [N | bodies json file] [simulated time] [max steps]\n");
+    printf("  wisdom-holman [stars] [planets per star] [simulated time]\n");
+    printf("  block-timesteps [stars] [planets per star] [simulated time] [accuracy ...]\n");
+    printf("  allocations [N ...] [force solver ...]\n");
+    printf("  fabric [grid squares] [max threads] [N ...]\n");
+    printf("  fabric-cutoff [grid squares] [cutoff] [N ...]\n");
+    printf("  fabric-incremental [grid squares] [cutoff] [N] [moving bodies] [frames]\n");
+    printf("  fabric-lod [grid squares] [vertex budget ...]\n");
+    printf("  fixed-timestep [N] [wall seconds]\n");
+    printf("  physics-thread [N] [frames]\n");
+    printf("  task-graph [N] [grid squares] [frames]\n");
+    printf("  checkpoint [N]\n");
+    printf("  trajectory [N] [frames]\n");
+
+    return 1;
+}
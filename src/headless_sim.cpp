@@ -0,0 +1,110 @@
+// Headless batch runner for the libchiro core, needs no window or OpenGL context
+// Usage: headless_sim [steps] [bodies json or checkpoint file] [configurations json file] [checkpoint file] [checkpoint interval]
+//                     [trajectory file] [trajectory interval]
+// A run started from a checkpoint continues where it was saved. With a checkpoint file the state is saved
+// there every checkpoint interval steps (only at the end when 0) and after the last step. With a trajectory
+// file the bodies are streamed to it at the start and on every step that is a multiple of the trajectory interval
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+
+#include "../include/BodySystem.h"
+#include "../include/Simulation.h"
+#include "../include/Checkpoint.h"
+#include "../include/Trajectory.h"
+
+int main(int argc, char* argv[]) {
+    int steps = 1000;
+    std::string bodies_file = "data/BodiesData.json";
+    std::string configs_file = "data/Configurations.json";
+    std::string checkpoint_file;
+    int checkpoint_interval = 0;
+    std::string trajectory_file;
+    int trajectory_interval = 1;
+
+    if (argc > 1) {
+        steps = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        bodies_file = argv[2];
+    }
+    if (argc > 3) {
+        configs_file = argv[3];
+    }
+    if (argc > 4) {
+        checkpoint_file = argv[4];
+    }
+    if (argc > 5) {
+        checkpoint_interval = atoi(argv[5]);
+    }
+    if (argc > 6) {
+        trajectory_file = argv[6];
+    }
+    if (argc > 7) {
+        trajectory_interval = std::max(atoi(argv[7]), 1);
+    }
+
+    SimulationConfig sim_configs = load_simulation_config(configs_file);
+    bool restart = bodies_file.size() < 5 || bodies_file.substr(bodies_file.size() - 5) != ".json";
+    Simulation simulation(restart ? BodySystem() : BodySystem(bodies_file, sim_configs.E_val_km, sim_configs.E_val_kg), sim_configs);
+
+    if (restart) {
+        CheckpointFile checkpoint;
+        auto load_start = std::chrono::steady_clock::now();
+
+        if (!checkpoint.open(bodies_file) || !checkpoint.restore(simulation)) {
+            return 1;
+        }
+
+        printf("Restored step %ld (simulated time %g s) in %.6f s\n", simulation.step_count, simulation.sim_time,
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count());
+    }
+
+    double initial_energy = simulation.total_energy();
+
+    std::unique_ptr<TrajectoryWriter> trajectory;
+    if (!trajectory_file.empty()) {
+        trajectory.reset(new TrajectoryWriter(trajectory_file, simulation.system.size(), trajectory_compression(sim_configs.trajectory_compression),
+            sim_configs.trajectory_quantum, sim_configs.trajectory_chunk_frames));
+        trajectory->append(simulation.bodies(), simulation.step_count, simulation.sim_time);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int done = 1; done <= steps; done++) {
+        simulation.step();
+
+        if (trajectory && simulation.step_count % trajectory_interval == 0) {
+            trajectory->append(simulation.bodies(), simulation.step_count, simulation.sim_time);
+        }
+        if (!checkpoint_file.empty() && ((checkpoint_interval > 0 && done % checkpoint_interval == 0) || done == steps)) {
+            save_checkpoint(simulation, checkpoint_file);
+        }
+    }
+
+    // The run is only over once the I/O thread has written the last frames
+    if (trajectory) {
+        trajectory->close();
+        printf("Trajectory: %lld frames, %lld bytes\n", trajectory->frames_written.load(), trajectory->bytes_written.load());
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double final_energy = simulation.total_energy();
+
+    printf("Bodies: %d\n", simulation.system.size());
+    printf("Steps: %ld (simulated time %g s)\n", simulation.step_count, simulation.sim_time);
+    printf("Wall time: %.6f s (%.1f steps/s)\n", seconds, steps / seconds);
+    printf("Integrator: %s, force evaluations: %lld\n", simulation.integrator->name(), simulation.force_evaluations);
+    printf("Relative energy error: %.3e\n", (final_energy - initial_energy) / initial_energy);
+
+    for (int idx = 0; idx < simulation.system.size(); idx++) {
+        printf("%s: position (%g, %g, %g) velocity (%g, %g, %g)\n", simulation.system.names[idx].c_str(),
+            simulation.system.x[idx], simulation.system.y[idx], simulation.system.z[idx],
+            simulation.system.vx[idx], simulation.system.vy[idx], simulation.system.vz[idx]);
+    }
+
+    return 0;
+}